@@ -1,6 +1,7 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
-uniform mat4 mvp;
+#include "frame_uniforms.glsl"
+uniform mat4 model;
 void main() {
-    gl_Position = mvp * vec4(aPos, 1.0);
+    gl_Position = viewProjection * (model * vec4(aPos, 1.0));
 }
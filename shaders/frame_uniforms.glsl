@@ -0,0 +1,6 @@
+// Per-frame values shared by every program, uploaded once per frame
+// (FrameUniforms in shader_manager.h, std140 layout)
+layout(std140) uniform Frame {
+    mat4 viewProjection;
+    mat4 view; // World to eye space; normals only need its rotation
+};
@@ -4,29 +4,29 @@ out vec4 FragColor;
 in vec2 TexCoord; // The 2D coordinate from the vertex shader
 
 uniform sampler3D volumeTexture;
+uniform float valueScale; // Texel value to data units (normalized integer formats)
 uniform sampler1D colormapTexture;
 uniform float minScalar;
 uniform float maxScalar;
 
-// New uniforms to tell the shader where the slice is
-uniform float sliceNorm;
-uniform int slicingAxis; // 0=Z, 1=Y, 2=X
+// The slice quad in grid coordinates relative to the texture's first texel:
+// TexCoord (s, t) lies at planeOrigin + s * planeAxisU + t * planeAxisV.
+// Any plane works, axis-aligned or oblique.
+uniform vec3 planeOrigin;
+uniform vec3 planeAxisU;
+uniform vec3 planeAxisV;
 
 void main()
 {
-    // 1. Construct the 3D texture coordinate based on the slicing axis
-    vec3 texCoord3D;
-    if (slicingAxis == 0) { // Z-Slice
-        texCoord3D = vec3(TexCoord.x, TexCoord.y, sliceNorm);
-    } else if (slicingAxis == 1) { // Y-Slice
-        texCoord3D = vec3(TexCoord.x, sliceNorm, TexCoord.y);
-    } else { // X-Slice
-        texCoord3D = vec3(sliceNorm, TexCoord.x, TexCoord.y);
-    }
+    // 1. Position on the plane, dropping the parts of the quad outside the volume
+    vec3 gridPos = planeOrigin + TexCoord.x * planeAxisU + TexCoord.y * planeAxisV;
+    vec3 lastTexel = vec3(textureSize(volumeTexture, 0) - 1);
+    if (any(lessThan(gridPos, vec3(-1e-3))) || any(greaterThan(gridPos, lastTexel + 1e-3))) discard;
+
+    // 2. Sample the volume at the texel-centred coordinate
+    vec3 texCoord3D = (gridPos + 0.5) / vec3(textureSize(volumeTexture, 0));
+    float scalarValue = texture(volumeTexture, texCoord3D).r * valueScale;
 
-    // 2. Sample the volume with the newly constructed coordinate
-    float scalarValue = texture(volumeTexture, texCoord3D).r;
-    
     // 3. Normalize and get color (same as before)
     float normalizedScalar = 0.0;
     if (maxScalar > minScalar) {
@@ -1,9 +1,15 @@
 #version 330 core
 out vec4 FragColor;
 
-in vec3 f_color;
+in float f_scalar;
+in vec3 f_normal;
+
+uniform sampler1D colormapTexture;
 
 void main()
 {
-    FragColor = vec4(f_color, 1.0);
+    // Two-sided headlight: the light sits at the camera, looking down -Z
+    float diffuse = abs(normalize(f_normal).z);
+    vec3 color = texture(colormapTexture, f_scalar).rgb;
+    FragColor = vec4(color * (0.25 + 0.75 * diffuse), 1.0);
 }
@@ -1,13 +1,28 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aColor;
+layout (location = 0) in vec3 aPos;       // unorm16 position in unit space
+layout (location = 1) in float aScalar;   // unorm16 colormap coordinate
+layout (location = 2) in vec2 aNormalOct; // snorm16 octahedral normal
 
-uniform mat4 mvp;
+#include "frame_uniforms.glsl"
+uniform mat4 model;
 
-out vec3 f_color;
+out float f_scalar;
+out vec3 f_normal;
+
+vec2 signNotZero(vec2 v) {
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// Inverse of Vertex::setNormal in marching_cubes.h
+vec3 decodeOctahedral(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) n.xy = (1.0 - abs(e.yx)) * signNotZero(e);
+    return normalize(n);
+}
 
 void main()
 {
-    gl_Position = mvp * vec4(aPos, 1.0);
-    f_color = aColor;
+    gl_Position = viewProjection * (model * vec4(aPos, 1.0));
+    f_scalar = aScalar;
+    f_normal = mat3(view) * decodeOctahedral(aNormalOct);
 }
@@ -5,28 +5,55 @@ layout(triangle_strip, max_vertices = 15) out;
 flat in uint g_cubeID[];
 
 // UNIFORMS
-uniform mat4 mvp;
+#include "frame_uniforms.glsl"
+uniform mat4 model;
 uniform ivec3 dataDimensions;
+uniform ivec3 roiOrigin; // First grid point of the region of interest; the textures hold only that box
 uniform float isovalue;
-uniform uint totalCubes;
+uniform uint totalCubes; // Cells in the region of interest
 
 // TEXTURES
 uniform sampler3D volumeTexture;
+uniform float valueScale; // Texel value to data units (normalized integer formats)
+uniform sampler3D gradientTexture; // Cached central-difference gradients
 uniform isampler1D edgeTable;
 uniform isampler2D triTable;
 
+// OPTIONAL COLOUR FIELD (a second field on the same grid)
+uniform bool useColorField;
+uniform sampler3D colorTexture;
+uniform float colorValueScale;
+uniform float colorMin; // Maps to the start of the colormap
+uniform float colorMax; // Maps to the end of the colormap
+
 // OUTPUT TO FRAGMENT SHADER
-out vec3 f_color;
+out float f_scalar; // Colormap coordinate
+out vec3 f_normal;
 
 // Helper to interpolate vertex positions
-vec3 vertexInterp(float isoval, vec3 p1, vec3 p2, float val1, float val2) {
+vec3 vertexInterp(float isoval, vec3 p1, vec3 p2, float val1, float val2, out float mu) {
+    mu = 0.0;
     if (abs(isoval - val1) < 1e-6) return p1;
-    if (abs(isoval - val2) < 1e-6) return p2;
+    if (abs(isoval - val2) < 1e-6) { mu = 1.0; return p2; }
     if (abs(val1 - val2) < 1e-6) return p1;
-    float mu = (isoval - val1) / (val2 - val1);
+    mu = (isoval - val1) / (val2 - val1);
     return p1 + mu * (p2 - p1);
 }
 
+// The two corners joined by each of the 12 cube edges, lower corner first
+// (matches marching_cubes.cpp, so shared edges give identical vertices)
+const ivec2 edge_corners[12] = ivec2[12](
+    ivec2(0, 1), ivec2(1, 2), ivec2(3, 2), ivec2(0, 3), ivec2(4, 5), ivec2(5, 6),
+    ivec2(7, 6), ivec2(4, 7), ivec2(0, 4), ivec2(1, 5), ivec2(2, 6), ivec2(3, 7)
+);
+
+// Surface normal at a grid-space position, pointing towards lower values
+vec3 gradientNormal(vec3 p_grid) {
+    vec3 g = texture(gradientTexture, (p_grid - vec3(roiOrigin) + 0.5) / vec3(textureSize(gradientTexture, 0))).xyz;
+    float len = length(g);
+    return mat3(view) * (len > 0.0 ? -g / len : vec3(0.0, 0.0, 1.0));
+}
+
 // *** THE FIX: A lookup array to match the C++ vertex order ***
 const ivec3 corner_offsets[8] = ivec3[8](
     ivec3(0, 0, 0), // i = 0
@@ -40,24 +67,32 @@ const ivec3 corner_offsets[8] = ivec3[8](
 );
 
 void main() {
+    mat4 mvp = viewProjection * model;
     int id = int(g_cubeID[0]);
     ivec3 dims_no_border = dataDimensions - 1;
 
-    int x = id % dims_no_border.x;
-    int y = (id / dims_no_border.x) % dims_no_border.y;
-    int z = id / (dims_no_border.x * dims_no_border.y);
-    ivec3 cubePos = ivec3(x, y, z);
+    ivec3 roiCells = textureSize(volumeTexture, 0) - 1;
+
+    int x = id % roiCells.x;
+    int y = (id / roiCells.x) % roiCells.y;
+    int z = id / (roiCells.x * roiCells.y);
+    ivec3 cubePos = roiOrigin + ivec3(x, y, z);
 
     vec3 cornerPos[8];
     float cornerVal[8];
+    float cornerColor[8];
     int cubeindex = 0;
     for (int i = 0; i < 8; i++) {
         // Use the lookup array instead of bitwise logic
         ivec3 offset = corner_offsets[i];
         ivec3 current_pos = cubePos + offset;
         
-        cornerVal[i] = texelFetch(volumeTexture, current_pos, 0).r;
+        cornerVal[i] = texelFetch(volumeTexture, current_pos - roiOrigin, 0).r * valueScale;
         cornerPos[i] = vec3(current_pos);
+        if (useColorField) {
+            float c = texelFetch(colorTexture, current_pos - roiOrigin, 0).r * colorValueScale;
+            cornerColor[i] = (c - colorMin) / max(colorMax - colorMin, 1e-20);
+        }
 
         if (cornerVal[i] < isovalue) {
             cubeindex |= (1 << i);
@@ -68,29 +103,29 @@ void main() {
     if (edges == 0) return;
 
     vec3 vertlist[12];
-    if ((edges & 1)    != 0) vertlist[0] = vertexInterp(isovalue, cornerPos[0], cornerPos[1], cornerVal[0], cornerVal[1]);
-    if ((edges & 2)    != 0) vertlist[1] = vertexInterp(isovalue, cornerPos[1], cornerPos[2], cornerVal[1], cornerVal[2]);
-    if ((edges & 4)    != 0) vertlist[2] = vertexInterp(isovalue, cornerPos[2], cornerPos[3], cornerVal[2], cornerVal[3]);
-    if ((edges & 8)    != 0) vertlist[3] = vertexInterp(isovalue, cornerPos[3], cornerPos[0], cornerVal[3], cornerVal[0]);
-    if ((edges & 16)   != 0) vertlist[4] = vertexInterp(isovalue, cornerPos[4], cornerPos[5], cornerVal[4], cornerVal[5]);
-    if ((edges & 32)   != 0) vertlist[5] = vertexInterp(isovalue, cornerPos[5], cornerPos[6], cornerVal[5], cornerVal[6]);
-    if ((edges & 64)   != 0) vertlist[6] = vertexInterp(isovalue, cornerPos[6], cornerPos[7], cornerVal[6], cornerVal[7]);
-    if ((edges & 128)  != 0) vertlist[7] = vertexInterp(isovalue, cornerPos[7], cornerPos[4], cornerVal[7], cornerVal[4]);
-    if ((edges & 256)  != 0) vertlist[8] = vertexInterp(isovalue, cornerPos[0], cornerPos[4], cornerVal[0], cornerVal[4]);
-    if ((edges & 512)  != 0) vertlist[9] = vertexInterp(isovalue, cornerPos[1], cornerPos[5], cornerVal[1], cornerVal[5]);
-    if ((edges & 1024) != 0) vertlist[10] = vertexInterp(isovalue, cornerPos[2], cornerPos[6], cornerVal[2], cornerVal[6]);
-    if ((edges & 2048) != 0) vertlist[11] = vertexInterp(isovalue, cornerPos[3], cornerPos[7], cornerVal[3], cornerVal[7]);
-
     float progress = float(id) / float(totalCubes);
-    f_color = vec3(progress, 1.0 - progress, 0.0);
+    float colorlist[12]; // Colormap coordinate per edge
+    for (int e = 0; e < 12; e++) {
+        if ((edges & (1 << e)) == 0) continue;
+        ivec2 c = edge_corners[e];
+        float mu;
+        vertlist[e] = vertexInterp(isovalue, cornerPos[c.x], cornerPos[c.y], cornerVal[c.x], cornerVal[c.y], mu);
+        colorlist[e] = useColorField ? mix(cornerColor[c.x], cornerColor[c.y], mu) : progress;
+    }
 
     for (int i = 0; texelFetch(triTable, ivec2(i, cubeindex), 0).r != -1; i += 3) {
-        vec3 v1_grid = vertlist[texelFetch(triTable, ivec2(i,     cubeindex), 0).r];
-        vec3 v2_grid = vertlist[texelFetch(triTable, ivec2(i + 1, cubeindex), 0).r];
-        vec3 v3_grid = vertlist[texelFetch(triTable, ivec2(i + 2, cubeindex), 0).r];
+        int e1 = texelFetch(triTable, ivec2(i,     cubeindex), 0).r;
+        int e2 = texelFetch(triTable, ivec2(i + 1, cubeindex), 0).r;
+        int e3 = texelFetch(triTable, ivec2(i + 2, cubeindex), 0).r;
+        vec3 v1_grid = vertlist[e1];
+        vec3 v2_grid = vertlist[e2];
+        vec3 v3_grid = vertlist[e3];
 
+        f_scalar = colorlist[e1]; f_normal = gradientNormal(v1_grid);
         gl_Position = mvp * vec4(v1_grid / vec3(dims_no_border), 1.0); EmitVertex();
+        f_scalar = colorlist[e2]; f_normal = gradientNormal(v2_grid);
         gl_Position = mvp * vec4(v2_grid / vec3(dims_no_border), 1.0); EmitVertex();
+        f_scalar = colorlist[e3]; f_normal = gradientNormal(v3_grid);
         gl_Position = mvp * vec4(v3_grid / vec3(dims_no_border), 1.0); EmitVertex();
         EndPrimitive();
     }
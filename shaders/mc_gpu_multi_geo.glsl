@@ -0,0 +1,138 @@
+#version 330 core
+// Multi-isovalue variant of mc_gpu_geo.glsl: the 8 corner texels are fetched
+// once per cell and classified against every level in `isovalues`.
+#define MAX_LEVELS 8
+layout(points) in;
+// 15 vertices per level; 120 x 8 output components stays under the GL 3.3 limit of 1024
+layout(triangle_strip, max_vertices = 120) out;
+
+flat in uint g_cubeID[];
+
+// UNIFORMS
+#include "frame_uniforms.glsl"
+uniform mat4 model;
+uniform ivec3 dataDimensions;
+uniform ivec3 roiOrigin; // First grid point of the region of interest; the textures hold only that box
+uniform float isovalues[MAX_LEVELS]; // sorted ascending
+uniform int numIsovalues;
+uniform uint totalCubes; // Cells in the region of interest
+
+// TEXTURES
+uniform sampler3D volumeTexture;
+uniform float valueScale; // Texel value to data units (normalized integer formats)
+uniform sampler3D gradientTexture; // Cached central-difference gradients
+uniform isampler1D edgeTable;
+uniform isampler2D triTable;
+
+// OPTIONAL COLOUR FIELD (a second field on the same grid)
+uniform bool useColorField;
+uniform sampler3D colorTexture;
+uniform float colorValueScale;
+uniform float colorMin; // Maps to the start of the colormap
+uniform float colorMax; // Maps to the end of the colormap
+
+// OUTPUT TO FRAGMENT SHADER
+out float f_scalar; // Colormap coordinate
+out vec3 f_normal;
+
+vec3 vertexInterp(float isoval, vec3 p1, vec3 p2, float val1, float val2, out float mu) {
+    mu = 0.0;
+    if (abs(isoval - val1) < 1e-6) return p1;
+    if (abs(isoval - val2) < 1e-6) { mu = 1.0; return p2; }
+    if (abs(val1 - val2) < 1e-6) return p1;
+    mu = (isoval - val1) / (val2 - val1);
+    return p1 + mu * (p2 - p1);
+}
+
+// The two corners joined by each of the 12 cube edges, lower corner first
+// (matches marching_cubes.cpp, so shared edges give identical vertices)
+const ivec2 edge_corners[12] = ivec2[12](
+    ivec2(0, 1), ivec2(1, 2), ivec2(3, 2), ivec2(0, 3), ivec2(4, 5), ivec2(5, 6),
+    ivec2(7, 6), ivec2(4, 7), ivec2(0, 4), ivec2(1, 5), ivec2(2, 6), ivec2(3, 7)
+);
+
+// Surface normal at a grid-space position, pointing towards lower values
+vec3 gradientNormal(vec3 p_grid) {
+    vec3 g = texture(gradientTexture, (p_grid - vec3(roiOrigin) + 0.5) / vec3(textureSize(gradientTexture, 0))).xyz;
+    float len = length(g);
+    return mat3(view) * (len > 0.0 ? -g / len : vec3(0.0, 0.0, 1.0));
+}
+
+const ivec3 corner_offsets[8] = ivec3[8](
+    ivec3(0, 0, 0), ivec3(1, 0, 0), ivec3(1, 1, 0), ivec3(0, 1, 0),
+    ivec3(0, 0, 1), ivec3(1, 0, 1), ivec3(1, 1, 1), ivec3(0, 1, 1)
+);
+
+void main() {
+    mat4 mvp = viewProjection * model;
+    int id = int(g_cubeID[0]);
+    ivec3 dims_no_border = dataDimensions - 1;
+
+    ivec3 roiCells = textureSize(volumeTexture, 0) - 1;
+
+    int x = id % roiCells.x;
+    int y = (id / roiCells.x) % roiCells.y;
+    int z = id / (roiCells.x * roiCells.y);
+    ivec3 cubePos = roiOrigin + ivec3(x, y, z);
+
+    vec3 cornerPos[8];
+    float cornerVal[8];
+    float cornerColor[8];
+    float cellMin = 1e38;
+    float cellMax = -1e38;
+    for (int i = 0; i < 8; i++) {
+        ivec3 current_pos = cubePos + corner_offsets[i];
+        cornerVal[i] = texelFetch(volumeTexture, current_pos - roiOrigin, 0).r * valueScale;
+        cornerPos[i] = vec3(current_pos);
+        if (useColorField) {
+            float c = texelFetch(colorTexture, current_pos - roiOrigin, 0).r * colorValueScale;
+            cornerColor[i] = (c - colorMin) / max(colorMax - colorMin, 1e-20);
+        }
+        cellMin = min(cellMin, cornerVal[i]);
+        cellMax = max(cellMax, cornerVal[i]);
+    }
+
+    float progress = float(id) / float(totalCubes);
+
+    for (int level = 0; level < numIsovalues; level++) {
+        float isovalue = isovalues[level];
+        // Levels are sorted, so nothing above cellMax can cross this cell
+        if (isovalue > cellMax) break;
+        if (isovalue <= cellMin) continue;
+
+        int cubeindex = 0;
+        for (int i = 0; i < 8; i++) {
+            if (cornerVal[i] < isovalue) cubeindex |= (1 << i);
+        }
+
+        int edges = texelFetch(edgeTable, cubeindex, 0).r;
+        if (edges == 0) continue;
+
+        vec3 vertlist[12];
+        float colorlist[12]; // Colormap coordinate per edge
+        for (int e = 0; e < 12; e++) {
+            if ((edges & (1 << e)) == 0) continue;
+            ivec2 c = edge_corners[e];
+            float mu;
+            vertlist[e] = vertexInterp(isovalue, cornerPos[c.x], cornerPos[c.y], cornerVal[c.x], cornerVal[c.y], mu);
+            colorlist[e] = useColorField ? mix(cornerColor[c.x], cornerColor[c.y], mu) : progress;
+        }
+
+        for (int i = 0; texelFetch(triTable, ivec2(i, cubeindex), 0).r != -1; i += 3) {
+            int e1 = texelFetch(triTable, ivec2(i,     cubeindex), 0).r;
+            int e2 = texelFetch(triTable, ivec2(i + 1, cubeindex), 0).r;
+            int e3 = texelFetch(triTable, ivec2(i + 2, cubeindex), 0).r;
+            vec3 v1_grid = vertlist[e1];
+            vec3 v2_grid = vertlist[e2];
+            vec3 v3_grid = vertlist[e3];
+
+            f_scalar = colorlist[e1]; f_normal = gradientNormal(v1_grid);
+            gl_Position = mvp * vec4(v1_grid / vec3(dims_no_border), 1.0); EmitVertex();
+            f_scalar = colorlist[e2]; f_normal = gradientNormal(v2_grid);
+            gl_Position = mvp * vec4(v2_grid / vec3(dims_no_border), 1.0); EmitVertex();
+            f_scalar = colorlist[e3]; f_normal = gradientNormal(v3_grid);
+            gl_Position = mvp * vec4(v3_grid / vec3(dims_no_border), 1.0); EmitVertex();
+            EndPrimitive();
+        }
+    }
+}
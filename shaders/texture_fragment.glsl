@@ -4,4 +4,5 @@ in vec2 TexCoord;
 uniform sampler2D ourTexture;
 void main() {
     FragColor = texture(ourTexture, TexCoord);
+    if (FragColor.a < 0.5) discard; // Outside the volume (oblique slices)
 }
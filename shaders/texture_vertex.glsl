@@ -2,8 +2,9 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoord;
 out vec2 TexCoord;
-uniform mat4 mvp;
+#include "frame_uniforms.glsl"
+uniform mat4 model;
 void main() {
-    gl_Position = mvp * vec4(aPos, 1.0);
+    gl_Position = viewProjection * (model * vec4(aPos, 1.0));
     TexCoord = aTexCoord;
 }
@@ -57,3 +57,10 @@ void Camera::setZoom(float newZoom) {
     if (this->zoom < 1.0f) this->zoom = 1.0f;
     if (this->zoom > 2000.0f) this->zoom = 2000.0f;
 }
+
+void Camera::setOrientation(float newYaw, float newPitch) {
+    this->yaw = newYaw;
+    this->pitch = newPitch;
+    if (this->pitch > 89.0f) this->pitch = 89.0f;
+    if (this->pitch < -89.0f) this->pitch = -89.0f;
+}
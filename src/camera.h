@@ -16,6 +16,12 @@ public:
     
     // Public setter for zoom
     void setZoom(float newZoom);
+    // Distance from the camera to the orbit centre
+    float getZoom() const { return zoom; }
+    // Orbit angles in degrees; the pitch is clamped like a drag
+    float getYaw() const { return yaw; }
+    float getPitch() const { return pitch; }
+    void setOrientation(float newYaw, float newPitch);
 
 private:
     bool isDragging;
@@ -0,0 +1,133 @@
+#ifndef COMPUTE_WORKER_H
+#define COMPUTE_WORKER_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+// Runs a heavy job (an extraction, a slice) on its own thread so the render
+// loop never waits for it. The mailbox holds only the newest request: posting
+// replaces one that has not started yet. Finished results are handed over
+// through a double buffer; the render thread reads the front result while the
+// worker fills another, and acquire() swaps in the newest finished one.
+// The job itself may use the shared thread pool.
+template <typename Request, typename Result>
+class ComputeWorker {
+public:
+    // Fills `result` for `request`, overwriting whatever it held before
+    // (buffers are recycled, so their capacity can be reused)
+    typedef std::function<void(const Request&, Result&)> Job;
+
+    // `onPublish` runs on the worker thread after every finished job,
+    // e.g. to wake a render loop that waits for events
+    explicit ComputeWorker(Job job, std::function<void()> onPublish = std::function<void()>())
+        : job(job), onPublish(onPublish), posted(false), pending(false), running(false), stopping(false),
+          haveReady(false), haveFront(false) {
+        thread = std::thread(&ComputeWorker::loop, this);
+    }
+
+    // Waits for the job in progress, if any, and stops the thread
+    ~ComputeWorker() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        thread.join();
+    }
+
+    // Queues `request`, superseding a queued one. A request equal to the last
+    // one posted is dropped, so posting the same request every frame is free.
+    bool post(const Request& request) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (posted && request == latest) return false;
+            latest = request;
+            posted = pending = true;
+        }
+        wake.notify_one();
+        return true;
+    }
+
+    // Makes the newest finished result the front one; false if nothing
+    // finished since the last call
+    bool acquire() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!haveReady) return false;
+        std::swap(ready, frontResult);
+        std::swap(readyRequest, frontReq);
+        haveReady = false;
+        haveFront = true;
+        return true;
+    }
+
+    // Front result and the request it answers; valid once hasResult() is true
+    // and owned by the caller until the next acquire()
+    bool hasResult() const { return haveFront; }
+    Result& front() { return frontResult; }
+    const Request& frontRequest() const { return frontReq; }
+
+    // Blocks until no request is queued or running, so the result of the
+    // last one posted can be acquired (used where frames must be reproducible)
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this]() { return !pending && !running; });
+    }
+
+    // True while a request is queued or running, or its result waits for acquire()
+    bool busy() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return pending || running || haveReady;
+    }
+
+private:
+    ComputeWorker(const ComputeWorker&);
+    ComputeWorker& operator=(const ComputeWorker&);
+
+    void loop() {
+        Request request;
+        Result working;
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            wake.wait(lock, [this]() { return pending || stopping; });
+            if (stopping) return;
+            request = latest;
+            pending = false;
+            running = true;
+            lock.unlock();
+            job(request, working);
+            lock.lock();
+            running = false;
+            // Publish; an unconsumed older result is simply overwritten
+            std::swap(working, ready);
+            std::swap(request, readyRequest);
+            haveReady = true;
+            if (!pending) idle.notify_all();
+            if (onPublish) {
+                lock.unlock();
+                onPublish();
+                lock.lock();
+            }
+        }
+    }
+
+    Job job;
+    std::function<void()> onPublish;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle; // Signalled when the mailbox runs dry
+    Request latest;       // Newest posted request
+    bool posted, pending, running, stopping;
+    Request readyRequest; // Newest finished result, not yet acquired
+    Result ready;
+    bool haveReady;
+    Request frontReq;     // Result the render thread is using
+    Result frontResult;
+    bool haveFront;
+    std::thread thread;   // Runs loop()
+};
+
+#endif // COMPUTE_WORKER_H
@@ -0,0 +1,40 @@
+#include "derived_field.h"
+#include "thread_pool.h"
+#include <algorithm>
+
+DerivedField::DerivedField(const FieldExpression& expression)
+    : expression(expression), dimensions(expression.getDimensions()),
+      brickCount((expression.getDimensions() + glm::ivec3(BRICK_SIZE - 1)) / BRICK_SIZE) {}
+
+GridExtent DerivedField::brickExtent(const glm::ivec3& brick) const {
+    glm::ivec3 first = brick * BRICK_SIZE;
+    return GridExtent(first, glm::min(first + glm::ivec3(BRICK_SIZE - 1), dimensions - glm::ivec3(1)));
+}
+
+void DerivedField::materialize(const GridExtent& extent, ScalarField& out) const {
+    if (out.getType() != VoxelFloat32 || out.getDimensions() != dimensions) {
+        out = ScalarField(VoxelFloat32, dimensions);
+    }
+    GridExtent region = extent.resolve(dimensions);
+    if (region.empty() || expression.empty()) return;
+    glm::ivec3 firstBrick = region.first / BRICK_SIZE;
+    glm::ivec3 bricks = region.last / BRICK_SIZE - firstBrick + glm::ivec3(1);
+    float* values = out.values<float>();
+
+    ThreadPool::instance().parallelFor((size_t)bricks.x * bricks.y * bricks.z, 1, [&](size_t begin, size_t end) {
+        FieldExpression::Scratch scratch;
+        for (size_t i = begin; i < end; ++i) {
+            glm::ivec3 b = firstBrick + glm::ivec3((int)(i % bricks.x), (int)(i / bricks.x % bricks.y),
+                                                   (int)(i / ((size_t)bricks.x * bricks.y)));
+            GridExtent whole = brickExtent(b);
+            GridExtent part(glm::max(whole.first, region.first), glm::min(whole.last, region.last));
+            int width = part.last.x - part.first.x + 1;
+            for (int z = part.first.z; z <= part.last.z; ++z) {
+                for (int y = part.first.y; y <= part.last.y; ++y) {
+                    float* row = values + ((size_t)z * dimensions.y + y) * dimensions.x + part.first.x;
+                    expression.evaluate(part.first.x, y, z, width, row, scratch);
+                }
+            }
+        }
+    });
+}
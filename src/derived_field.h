@@ -0,0 +1,36 @@
+#ifndef DERIVED_FIELD_H
+#define DERIVED_FIELD_H
+
+#include "field_expression.h"
+#include "scalar_field.h"
+#include <glm/glm.hpp>
+
+// A field computed from an expression, evaluated one brick of BRICK_SIZE^3
+// grid points at a time. Bricks run in parallel on the shared pool and are
+// written straight into the target field, so the only memory used is the
+// result itself.
+class DerivedField {
+public:
+    static const int BRICK_SIZE = 32;
+
+    explicit DerivedField(const FieldExpression& expression);
+
+    const FieldExpression& getExpression() const { return expression; }
+    const glm::ivec3& getDimensions() const { return dimensions; }
+    const glm::ivec3& getBrickCount() const { return brickCount; }
+
+    // Grid points of `brick` (brick coordinates), clipped at the far faces
+    GridExtent brickExtent(const glm::ivec3& brick) const;
+
+    // Fills the points of `extent` (empty = whole grid) in `out`, a float32
+    // field of getDimensions() that is allocated if it does not match; the rest
+    // of `out` is left alone.
+    void materialize(const GridExtent& extent, ScalarField& out) const;
+
+private:
+    FieldExpression expression;
+    glm::ivec3 dimensions;
+    glm::ivec3 brickCount;
+};
+
+#endif // DERIVED_FIELD_H
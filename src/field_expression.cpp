@@ -0,0 +1,451 @@
+#include "field_expression.h"
+#include "vtk_parser.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+// Values of one row segment converted to float
+struct LoadKernel {
+    size_t begin;
+    int count;
+    float* out;
+    template <typename T> void operator()(const T* v) {
+        const T* src = v + begin;
+        for (int i = 0; i < count; ++i) out[i] = (float)src[i];
+    }
+};
+
+// Gradient magnitude of one row segment by central differences, one-sided at
+// the border (the same stencil as GradientField)
+struct GradientMagnitudeKernel {
+    glm::ivec3 dims;
+    glm::vec3 spacing;
+    int x0, y, z, count;
+    float* out;
+    template <typename T> void operator()(const T* v) {
+        size_t sliceSize = (size_t)dims.x * dims.y;
+        int ym = std::max(y - 1, 0), yp = std::min(y + 1, dims.y - 1);
+        int zm = std::max(z - 1, 0), zp = std::min(z + 1, dims.z - 1);
+        const T* row = v + z * sliceSize + (size_t)y * dims.x;
+        const T* rowYm = v + z * sliceSize + (size_t)ym * dims.x;
+        const T* rowYp = v + z * sliceSize + (size_t)yp * dims.x;
+        const T* rowZm = v + zm * sliceSize + (size_t)y * dims.x;
+        const T* rowZp = v + zp * sliceSize + (size_t)y * dims.x;
+        float fy = (yp > ym) ? 1.0f / ((yp - ym) * spacing.y) : 0.0f;
+        float fz = (zp > zm) ? 1.0f / ((zp - zm) * spacing.z) : 0.0f;
+        for (int i = 0; i < count; ++i) {
+            int x = x0 + i;
+            int xm = std::max(x - 1, 0), xp = std::min(x + 1, dims.x - 1);
+            float fx = (xp > xm) ? 1.0f / ((xp - xm) * spacing.x) : 0.0f;
+            float gx = ((float)row[xp] - (float)row[xm]) * fx;
+            float gy = ((float)rowYp[x] - (float)rowYm[x]) * fy;
+            float gz = ((float)rowZp[x] - (float)rowZm[x]) * fz;
+            out[i] = std::sqrt(gx * gx + gy * gy + gz * gz);
+        }
+    }
+};
+
+// a[i] = f(a[i]) over a block
+template <typename F>
+inline void unaryLoop(float* a, int count, F f) {
+    for (int i = 0; i < count; ++i) a[i] = f(a[i]);
+}
+
+// a[i] = f(a[i], b[i]); a uniform operand is passed as its value instead
+template <typename F>
+inline void binaryLoop(float* a, bool uniformA, float valueA, const float* b, bool uniformB, float valueB,
+                       int count, F f) {
+    if (!uniformA && !uniformB) {
+        for (int i = 0; i < count; ++i) a[i] = f(a[i], b[i]);
+    } else if (!uniformA) {
+        for (int i = 0; i < count; ++i) a[i] = f(a[i], valueB);
+    } else {
+        for (int i = 0; i < count; ++i) a[i] = f(valueA, b[i]);
+    }
+}
+
+} // namespace
+
+// Recursive descent over the grammar
+//   expression := term (('+' | '-') term)*
+//   term       := unary (('*' | '/') unary)*
+//   unary      := '-' unary | power
+//   power      := primary ('^' unary)?
+//   primary    := number | NAME | NAME '(' arguments ')' | '(' expression ')'
+// emitting postfix instructions as it goes
+class FieldExpression::Parser {
+public:
+    Parser(const std::string& text, const VtkParser& vtk, FieldExpression& out)
+        : text(text), vtk(vtk), out(out), pos(0), depth(0) {}
+
+    bool parse(std::string& error) {
+        next();
+        if (!expression()) { error = message; return false; }
+        if (token != TokenEnd) { error = describe("Unexpected"); return false; }
+        return true;
+    }
+
+private:
+    enum TokenType { TokenEnd, TokenNumber, TokenName, TokenSymbol };
+
+    void next() {
+        while (pos < text.size() && std::isspace((unsigned char)text[pos])) ++pos;
+        tokenPos = pos;
+        if (pos >= text.size()) { token = TokenEnd; return; }
+        char c = text[pos];
+        if (std::isdigit((unsigned char)c) || (c == '.' && pos + 1 < text.size() && std::isdigit((unsigned char)text[pos + 1]))) {
+            char* end = nullptr;
+            number = std::strtof(text.c_str() + pos, &end);
+            pos = end - text.c_str();
+            token = TokenNumber;
+        } else if (std::isalpha((unsigned char)c) || c == '_') {
+            size_t start = pos;
+            while (pos < text.size() && (std::isalnum((unsigned char)text[pos]) || text[pos] == '_' || text[pos] == '.')) ++pos;
+            name = text.substr(start, pos - start);
+            token = TokenName;
+        } else {
+            symbol = c;
+            ++pos;
+            token = TokenSymbol;
+        }
+    }
+
+    bool isSymbol(char c) const { return token == TokenSymbol && symbol == c; }
+
+    bool fail(const std::string& what) {
+        if (message.empty()) message = what;
+        return false;
+    }
+
+    std::string describe(const std::string& prefix) const {
+        if (token == TokenEnd) return prefix + " end of expression";
+        return prefix + " '" + text.substr(tokenPos, pos - tokenPos) + "' at column " + std::to_string(tokenPos + 1);
+    }
+
+    bool expect(char c) {
+        if (!isSymbol(c)) return fail(describe(std::string("Expected '") + c + "' but found"));
+        next();
+        return true;
+    }
+
+    bool expression() {
+        if (!term()) return false;
+        while (isSymbol('+') || isSymbol('-')) {
+            Op op = isSymbol('+') ? OpAdd : OpSub;
+            next();
+            if (!term()) return false;
+            emitBinary(op);
+        }
+        return true;
+    }
+
+    bool term() {
+        if (!unary()) return false;
+        while (isSymbol('*') || isSymbol('/')) {
+            Op op = isSymbol('*') ? OpMul : OpDiv;
+            next();
+            if (!unary()) return false;
+            emitBinary(op);
+        }
+        return true;
+    }
+
+    bool unary() {
+        if (isSymbol('-')) {
+            next();
+            if (!unary()) return false;
+            emitUnary(OpNeg);
+            return true;
+        }
+        if (isSymbol('+')) next();
+        return power();
+    }
+
+    bool power() {
+        if (!primary()) return false;
+        if (isSymbol('^')) {
+            next();
+            if (!unary()) return false; // Right associative: a^b^c = a^(b^c)
+            emitBinary(OpPow);
+        }
+        return true;
+    }
+
+    bool primary() {
+        if (token == TokenNumber) {
+            emitConst(number);
+            next();
+            return true;
+        }
+        if (isSymbol('(')) {
+            next();
+            return expression() && expect(')');
+        }
+        if (token != TokenName) return fail(describe("Unexpected"));
+        std::string identifier = name;
+        next();
+        if (!isSymbol('(')) {
+            int index = fieldIndex(identifier);
+            if (index < 0) return false;
+            emit(OpField, 0.0f, index);
+            return true;
+        }
+        next();
+        return call(identifier);
+    }
+
+    // Function call; the opening parenthesis has been consumed
+    bool call(const std::string& function) {
+        // Functions of a whole field take its name, not an expression
+        if (function == "mean" || function == "gradmag") {
+            if (token != TokenName) return fail(describe(function + "() takes a field name, found"));
+            int index = fieldIndex(name);
+            if (index < 0) return false;
+            next();
+            if (!expect(')')) return false;
+            if (function == "gradmag") {
+                emit(OpGradMag, 0.0f, index);
+            } else {
+                emitConst((float)out.fields[index]->getMean());
+            }
+            return true;
+        }
+
+        size_t first = out.program.size();
+        int arguments = 0;
+        if (!isSymbol(')')) {
+            for (;;) {
+                if (!expression()) return false;
+                ++arguments;
+                if (function == "mag") emitUnary(OpSquare);
+                if (!isSymbol(',')) break;
+                next();
+            }
+        }
+        if (!expect(')')) return false;
+
+        struct Function { const char* name; int arguments; Op op; };
+        static const Function functions[] = {
+            { "sqrt", 1, OpSqrt }, { "abs", 1, OpAbs }, { "exp", 1, OpExp }, { "log", 1, OpLog },
+            { "sin", 1, OpSin }, { "cos", 1, OpCos },
+            { "pow", 2, OpPow }, { "min", 2, OpMin }, { "max", 2, OpMax }
+        };
+        if (function == "mag") {
+            if (arguments < 2 || arguments > 3) return fail("mag() takes 2 or 3 arguments");
+            for (int i = 1; i < arguments; ++i) emitBinary(OpAdd);
+            emitUnary(OpSqrt);
+            return true;
+        }
+        // min(F) and max(F) of a single field are its range
+        if ((function == "min" || function == "max") && arguments == 1 &&
+            out.program.size() == first + 1 && out.program[first].op == OpField) {
+            float lo, hi;
+            out.fields[out.program[first].field]->getRange(lo, hi);
+            out.program.pop_back();
+            --depth;
+            emitConst(function == "min" ? lo : hi);
+            return true;
+        }
+        for (size_t i = 0; i < sizeof(functions) / sizeof(functions[0]); ++i) {
+            if (function != functions[i].name) continue;
+            if (arguments != functions[i].arguments) {
+                return fail(function + "() takes " + std::to_string(functions[i].arguments) + " argument(s)");
+            }
+            if (arguments == 1) emitUnary(functions[i].op);
+            else emitBinary(functions[i].op);
+            return true;
+        }
+        return fail("Unknown function '" + function + "'");
+    }
+
+    int fieldIndex(const std::string& fieldName) {
+        const ScalarField* field = vtk.getScalarField(fieldName);
+        if (!field) {
+            fail("Unknown field '" + fieldName + "'");
+            return -1;
+        }
+        for (size_t i = 0; i < out.fields.size(); ++i) {
+            if (out.fields[i] == field) return (int)i;
+        }
+        out.fields.push_back(field);
+        return (int)out.fields.size() - 1;
+    }
+
+    void emit(Op op, float value = 0.0f, int field = -1) {
+        Instruction instruction = { op, value, field };
+        out.program.push_back(instruction);
+        if (op == OpConst || op == OpField || op == OpGradMag) {
+            out.stackDepth = std::max(out.stackDepth, ++depth);
+        }
+    }
+
+    void emitConst(float value) { emit(OpConst, value); }
+
+    // Constant operands are folded instead of emitted
+    void emitUnary(Op op) {
+        Instruction& top = out.program.back();
+        if (top.op == OpConst) top.value = applyUnary(op, top.value);
+        else emit(op);
+    }
+
+    void emitBinary(Op op) {
+        size_t n = out.program.size();
+        --depth;
+        if (out.program[n - 1].op == OpConst && out.program[n - 2].op == OpConst) {
+            out.program[n - 2].value = applyBinary(op, out.program[n - 2].value, out.program[n - 1].value);
+            out.program.pop_back();
+        } else {
+            emit(op);
+        }
+    }
+
+    const std::string& text;
+    const VtkParser& vtk;
+    FieldExpression& out;
+    size_t pos, tokenPos;
+    TokenType token;
+    float number;
+    std::string name;
+    char symbol;
+    int depth;
+    std::string message;
+
+public:
+    static float applyUnary(Op op, float a) {
+        switch (op) {
+            case OpNeg: return -a;
+            case OpSquare: return a * a;
+            case OpSqrt: return std::sqrt(a);
+            case OpAbs: return std::fabs(a);
+            case OpExp: return std::exp(a);
+            case OpLog: return std::log(a);
+            case OpSin: return std::sin(a);
+            case OpCos: return std::cos(a);
+            default: return a;
+        }
+    }
+
+    static float applyBinary(Op op, float a, float b) {
+        switch (op) {
+            case OpAdd: return a + b;
+            case OpSub: return a - b;
+            case OpMul: return a * b;
+            case OpDiv: return a / b;
+            case OpPow: return std::pow(a, b);
+            case OpMin: return std::min(a, b);
+            case OpMax: return std::max(a, b);
+            default: return a;
+        }
+    }
+};
+
+FieldExpression::FieldExpression() : dimensions(0), spacing(1.0f), stackDepth(0) {}
+
+bool FieldExpression::compile(const std::string& source, const VtkParser& parser, std::string& error) {
+    this->source = source;
+    dimensions = parser.getDimensions();
+    spacing = parser.getSpacing();
+    fields.clear();
+    program.clear();
+    stackDepth = 0;
+    Parser compiler(source, parser, *this);
+    if (!compiler.parse(error)) {
+        program.clear();
+        return false;
+    }
+    return true;
+}
+
+void FieldExpression::evaluate(int x0, int y, int z, int count, float* out, Scratch& scratch) const {
+    if (scratch.buffers.size() < (size_t)stackDepth * BLOCK) {
+        scratch.buffers.resize((size_t)stackDepth * BLOCK);
+        scratch.uniform.resize(stackDepth);
+        scratch.values.resize(stackDepth);
+    }
+    for (int done = 0; done < count; done += BLOCK) {
+        evaluateBlock(x0 + done, y, z, std::min(BLOCK, count - done), out + done, scratch);
+    }
+}
+
+void FieldExpression::evaluateBlock(int x0, int y, int z, int count, float* out, Scratch& scratch) const {
+    // Stack slot s is buffer s; a uniform slot holds one value instead
+    float* buffers = scratch.buffers.data();
+    char* uniform = scratch.uniform.data();
+    float* values = scratch.values.data();
+    size_t begin = ((size_t)z * dimensions.y + y) * dimensions.x + x0;
+    int top = -1;
+    for (size_t p = 0; p < program.size(); ++p) {
+        const Instruction& in = program[p];
+        switch (in.op) {
+            case OpConst:
+                ++top;
+                uniform[top] = 1;
+                values[top] = in.value;
+                break;
+            case OpField: {
+                ++top;
+                uniform[top] = 0;
+                LoadKernel kernel = { begin, count, buffers + top * BLOCK };
+                fields[in.field]->visit(kernel);
+                break;
+            }
+            case OpGradMag: {
+                ++top;
+                uniform[top] = 0;
+                GradientMagnitudeKernel kernel = { dimensions, spacing, x0, y, z, count, buffers + top * BLOCK };
+                fields[in.field]->visit(kernel);
+                break;
+            }
+            case OpNeg: case OpSquare: case OpSqrt: case OpAbs: case OpExp: case OpLog: case OpSin: case OpCos: {
+                if (uniform[top]) {
+                    values[top] = Parser::applyUnary(in.op, values[top]);
+                    break;
+                }
+                float* a = buffers + top * BLOCK;
+                switch (in.op) {
+                    case OpNeg: unaryLoop(a, count, [](float v) { return -v; }); break;
+                    case OpSquare: unaryLoop(a, count, [](float v) { return v * v; }); break;
+                    case OpSqrt: unaryLoop(a, count, [](float v) { return std::sqrt(v); }); break;
+                    case OpAbs: unaryLoop(a, count, [](float v) { return std::fabs(v); }); break;
+                    case OpExp: unaryLoop(a, count, [](float v) { return std::exp(v); }); break;
+                    case OpLog: unaryLoop(a, count, [](float v) { return std::log(v); }); break;
+                    case OpSin: unaryLoop(a, count, [](float v) { return std::sin(v); }); break;
+                    default: unaryLoop(a, count, [](float v) { return std::cos(v); }); break;
+                }
+                break;
+            }
+            default: {
+                --top;
+                bool ua = uniform[top] != 0, ub = uniform[top + 1] != 0;
+                if (ua && ub) {
+                    values[top] = Parser::applyBinary(in.op, values[top], values[top + 1]);
+                    break;
+                }
+                float* a = buffers + top * BLOCK;
+                const float* b = buffers + (top + 1) * BLOCK;
+                float va = values[top], vb = values[top + 1];
+                if (ua) {
+                    // The result is a full block; it lands in a's buffer
+                    uniform[top] = 0;
+                }
+                switch (in.op) {
+                    case OpAdd: binaryLoop(a, ua, va, b, ub, vb, count, [](float u, float v) { return u + v; }); break;
+                    case OpSub: binaryLoop(a, ua, va, b, ub, vb, count, [](float u, float v) { return u - v; }); break;
+                    case OpMul: binaryLoop(a, ua, va, b, ub, vb, count, [](float u, float v) { return u * v; }); break;
+                    case OpDiv: binaryLoop(a, ua, va, b, ub, vb, count, [](float u, float v) { return u / v; }); break;
+                    case OpPow: binaryLoop(a, ua, va, b, ub, vb, count, [](float u, float v) { return std::pow(u, v); }); break;
+                    case OpMin: binaryLoop(a, ua, va, b, ub, vb, count, [](float u, float v) { return std::min(u, v); }); break;
+                    default: binaryLoop(a, ua, va, b, ub, vb, count, [](float u, float v) { return std::max(u, v); }); break;
+                }
+                break;
+            }
+        }
+    }
+    if (top < 0) return;
+    if (uniform[0]) std::fill(out, out + count, values[0]);
+    else std::memcpy(out, buffers, count * sizeof(float));
+}
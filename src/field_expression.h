@@ -0,0 +1,73 @@
+#ifndef FIELD_EXPRESSION_H
+#define FIELD_EXPRESSION_H
+
+#include "scalar_field.h"
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+class VtkParser;
+
+// An arithmetic expression over the fields of a VTK file, e.g.
+//   TEMP - mean(TEMP)              anomaly
+//   gradmag(TEMP)                  gradient magnitude (world units)
+//   SALT / TEMP                    ratio of two fields
+//   mag(U, V, W)                   magnitude of a vector field
+// Operators: + - * / ^ and unary minus. Functions: sqrt abs exp log sin cos,
+// pow(a, b), min(a, b), max(a, b), mag(a, b[, c]), gradmag(F), and the field
+// statistics mean(F), min(F), max(F), which become constants.
+//
+// The expression compiles to a postfix program with constants folded. It is
+// run over a row segment of up to BLOCK points at a time, one operator per
+// pass over small per-thread buffers, so nothing the size of the grid is
+// allocated per operator and every pass is a plain loop the compiler can
+// vectorize.
+class FieldExpression {
+public:
+    static const int BLOCK = 256; // Points evaluated per pass
+
+    FieldExpression();
+
+    // Parses `source` against the fields of `parser`; on failure returns false
+    // and describes the problem in `error`
+    bool compile(const std::string& source, const VtkParser& parser, std::string& error);
+
+    const std::string& getSource() const { return source; }
+    const glm::ivec3& getDimensions() const { return dimensions; }
+    bool empty() const { return program.empty(); }
+
+    // Working memory for evaluate(); one per thread
+    struct Scratch {
+        std::vector<float> buffers; // One BLOCK per stack slot
+        std::vector<char> uniform;  // Slot holds a single value (a constant operand)
+        std::vector<float> values;
+    };
+
+    // Values at the `count` points (x0 .. x0 + count - 1, y, z) into out.
+    // Safe to call from several threads with separate scratch buffers.
+    void evaluate(int x0, int y, int z, int count, float* out, Scratch& scratch) const;
+
+private:
+    enum Op {
+        OpConst, OpField, OpGradMag,
+        OpNeg, OpSquare, OpSqrt, OpAbs, OpExp, OpLog, OpSin, OpCos,
+        OpAdd, OpSub, OpMul, OpDiv, OpPow, OpMin, OpMax
+    };
+    struct Instruction {
+        Op op;
+        float value;  // OpConst
+        int field;    // OpField, OpGradMag: index into fields
+    };
+    class Parser;
+
+    void evaluateBlock(int x0, int y, int z, int count, float* out, Scratch& scratch) const;
+
+    std::string source;
+    glm::ivec3 dimensions;
+    glm::vec3 spacing;
+    std::vector<const ScalarField*> fields; // Owned by the parser
+    std::vector<Instruction> program;
+    int stackDepth;
+};
+
+#endif // FIELD_EXPRESSION_H
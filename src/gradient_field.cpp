@@ -0,0 +1,279 @@
+#include "gradient_field.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    int32_t exponent = (int32_t)((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffffu;
+    if (exponent <= 0) {
+        if (exponent < -10) return (uint16_t)sign; // Too small: signed zero
+        mantissa |= 0x800000u;                     // Subnormal half
+        uint32_t shift = (uint32_t)(14 - exponent);
+        uint32_t half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1u) half++; // Round half up
+        return (uint16_t)(sign | half);
+    }
+    if (exponent >= 31) return (uint16_t)(sign | 0x7c00u); // Overflow: infinity
+    uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000u) half++; // Round to nearest
+    return (uint16_t)half;
+}
+
+float halfToFloat(uint16_t half) {
+    uint32_t sign = (uint32_t)(half & 0x8000u) << 16;
+    uint32_t exponent = (half >> 10) & 0x1fu;
+    uint32_t mantissa = half & 0x3ffu;
+    uint32_t bits;
+    if (exponent == 0) {
+        if (mantissa == 0) {
+            bits = sign;
+        } else {
+            // Renormalize the subnormal
+            exponent = 127 - 15 + 1;
+            while ((mantissa & 0x400u) == 0) { mantissa <<= 1; exponent--; }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3ffu) << 13);
+        }
+    } else if (exponent == 31) {
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Pointer to `count` values of a row as float; other element types are
+// converted into `scratch` first so the SIMD differencing below is shared
+inline const float* rowAsFloat(const float* src, size_t count, float* scratch) {
+    (void)count; (void)scratch;
+    return src;
+}
+
+template <typename T>
+inline const float* rowAsFloat(const T* src, size_t count, float* scratch) {
+    for (size_t i = 0; i < count; ++i) scratch[i] = (float)src[i];
+    return scratch;
+}
+
+// Gradient of one x-row into SoA buffers gx/gy/gz. `scratch` holds 5 rows.
+// `scalars` starts at z-slice `zBase` of the grid.
+template <typename T>
+void computeRow(const T* scalars, glm::ivec3 dims, glm::vec3 spacing, int y, int z, int zBase,
+                float* gx, float* gy, float* gz, float* scratch) {
+    long long sliceSize = (long long)dims.x * dims.y;
+
+    // Neighbouring rows; at the border they collapse to one-sided differences
+    int ym = std::max(y - 1, 0), yp = std::min(y + 1, dims.y - 1);
+    int zm = std::max(z - 1, 0), zp = std::min(z + 1, dims.z - 1);
+    float fz = (zp > zm) ? 1.0f / ((zp - zm) * spacing.z) : 0.0f;
+    z -= zBase; zm -= zBase; zp -= zBase;
+    const float* row = rowAsFloat(scalars + z * sliceSize + (long long)y * dims.x, dims.x, scratch);
+    const float* rowYm = rowAsFloat(scalars + z * sliceSize + (long long)ym * dims.x, dims.x, scratch + dims.x);
+    const float* rowYp = rowAsFloat(scalars + z * sliceSize + (long long)yp * dims.x, dims.x, scratch + 2 * dims.x);
+    const float* rowZm = rowAsFloat(scalars + zm * sliceSize + (long long)y * dims.x, dims.x, scratch + 3 * dims.x);
+    const float* rowZp = rowAsFloat(scalars + zp * sliceSize + (long long)y * dims.x, dims.x, scratch + 4 * dims.x);
+    float fy = (yp > ym) ? 1.0f / ((yp - ym) * spacing.y) : 0.0f;
+    float fx = 0.5f / spacing.x;
+
+    int x = 0;
+#ifdef __SSE2__
+    __m128 vfy = _mm_set1_ps(fy), vfz = _mm_set1_ps(fz);
+    for (; x + 4 <= dims.x; x += 4) {
+        _mm_storeu_ps(gy + x, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(rowYp + x), _mm_loadu_ps(rowYm + x)), vfy));
+        _mm_storeu_ps(gz + x, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(rowZp + x), _mm_loadu_ps(rowZm + x)), vfz));
+    }
+#endif
+    for (; x < dims.x; ++x) {
+        gy[x] = (rowYp[x] - rowYm[x]) * fy;
+        gz[x] = (rowZp[x] - rowZm[x]) * fz;
+    }
+
+    if (dims.x < 2) { gx[0] = 0.0f; return; }
+    x = 1;
+#ifdef __SSE2__
+    __m128 vfx = _mm_set1_ps(fx);
+    for (; x + 4 <= dims.x - 1; x += 4) {
+        _mm_storeu_ps(gx + x, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(row + x + 1), _mm_loadu_ps(row + x - 1)), vfx));
+    }
+#endif
+    for (; x < dims.x - 1; ++x) gx[x] = (row[x + 1] - row[x - 1]) * fx;
+    gx[0] = (row[1] - row[0]) / spacing.x;
+    gx[dims.x - 1] = (row[dims.x - 1] - row[dims.x - 2]) / spacing.x;
+}
+
+typedef std::function<void(const float*, const float*, const float*, int, int)> RowFn;
+
+// Runs fn(gx, gy, gz, y, z) for every row of the slabs, in parallel over z
+struct RowKernel {
+    glm::ivec3 dims;
+    glm::vec3 spacing;
+    RowFn fn;
+
+    template <typename T> void operator()(const T* scalars) {
+        ThreadPool::instance().parallelFor(dims.z, 1, [&](size_t zBegin, size_t zEnd) {
+            std::vector<float> gx(dims.x), gy(dims.x), gz(dims.x), scratch(5 * (size_t)dims.x);
+            for (size_t z = zBegin; z < zEnd; ++z) {
+                for (int y = 0; y < dims.y; ++y) {
+                    computeRow(scalars, dims, spacing, y, (int)z, 0, gx.data(), gy.data(), gz.data(), scratch.data());
+                    fn(gx.data(), gy.data(), gz.data(), y, (int)z);
+                }
+            }
+        });
+    }
+};
+
+// The same over a tiled field: each task copies out the slices its slabs
+// and their z neighbours need, one chunk of slabs at a time
+struct SparseRowKernel {
+    const SparseField& field;
+    glm::ivec3 dims;
+    glm::vec3 spacing;
+    RowFn fn;
+
+    void operator()() {
+        ThreadPool::instance().parallelFor(dims.z, 1, [&](size_t zBegin, size_t zEnd) {
+            std::vector<float> gx(dims.x), gy(dims.x), gz(dims.x), scratch(5 * (size_t)dims.x);
+            int zFirst = std::max((int)zBegin - 1, 0), zLast = std::min((int)zEnd, dims.z - 1);
+            std::vector<float> slices((size_t)dims.x * dims.y * (zLast - zFirst + 1));
+            field.readBlock(GridExtent(glm::ivec3(0, 0, zFirst), glm::ivec3(dims.x - 1, dims.y - 1, zLast)), slices.data());
+            for (size_t z = zBegin; z < zEnd; ++z) {
+                for (int y = 0; y < dims.y; ++y) {
+                    computeRow(slices.data(), dims, spacing, y, (int)z, zFirst, gx.data(), gy.data(), gz.data(), scratch.data());
+                    fn(gx.data(), gy.data(), gz.data(), y, (int)z);
+                }
+            }
+        });
+    }
+};
+
+} // namespace
+
+GradientField::GradientField() : dimensions(0), precision(Float32), scale(1.0f) {}
+
+void GradientField::compute(const ScalarField& field, glm::vec3 spacing, Precision prec) {
+    RowKernel kernel;
+    kernel.dims = field.getDimensions();
+    kernel.spacing = spacing;
+    store(field.getDimensions(), prec, field.empty(), [&](const RowFn& fn) {
+        kernel.fn = fn;
+        field.visit(kernel);
+    });
+}
+
+void GradientField::compute(const SparseField& field, glm::vec3 spacing, Precision prec) {
+    SparseRowKernel kernel = { field, field.getDimensions(), spacing, RowFn() };
+    store(field.getDimensions(), prec, field.empty(), [&](const RowFn& fn) {
+        kernel.fn = fn;
+        kernel();
+    });
+}
+
+void GradientField::store(const glm::ivec3& dims, Precision prec, bool noValues,
+                          const std::function<void(const RowFn&)>& forEachRow) {
+    dimensions = dims;
+    precision = prec;
+    scale = 1.0f;
+    long long numVoxels = (long long)dims.x * dims.y * dims.z;
+    if (numVoxels <= 0 || noValues) { storage.clear(); return; }
+
+    // Quantized formats store gradient / scale, so first find the largest magnitude
+    if (precision != Float32) {
+        std::vector<float> slabMax(dims.z, 0.0f);
+        forEachRow([&](const float* gx, const float* gy, const float* gz, int, int z) {
+            float maxSq = slabMax[z];
+            for (int x = 0; x < dims.x; ++x) {
+                maxSq = std::max(maxSq, gx[x] * gx[x] + gy[x] * gy[x] + gz[x] * gz[x]);
+            }
+            slabMax[z] = maxSq;
+        });
+        float maxSq = 0.0f;
+        for (int z = 0; z < dims.z; ++z) maxSq = std::max(maxSq, slabMax[z]);
+        scale = maxSq > 0.0f ? std::sqrt(maxSq) : 1.0f;
+    }
+
+    size_t bytesPerComponent = (precision == Float32) ? 4 : (precision == Float16) ? 2 : 1;
+    storage.resize((size_t)numVoxels * 3 * bytesPerComponent);
+    float invScale = 1.0f / scale;
+
+    forEachRow([&](const float* gx, const float* gy, const float* gz, int y, int z) {
+        long long base = ((long long)z * dims.y + y) * dims.x * 3;
+        if (precision == Float32) {
+            float* out = reinterpret_cast<float*>(storage.data()) + base;
+            for (int x = 0; x < dims.x; ++x) {
+                out[3 * x] = gx[x]; out[3 * x + 1] = gy[x]; out[3 * x + 2] = gz[x];
+            }
+        } else if (precision == Float16) {
+            uint16_t* out = reinterpret_cast<uint16_t*>(storage.data()) + base;
+            for (int x = 0; x < dims.x; ++x) {
+                out[3 * x] = floatToHalf(gx[x] * invScale);
+                out[3 * x + 1] = floatToHalf(gy[x] * invScale);
+                out[3 * x + 2] = floatToHalf(gz[x] * invScale);
+            }
+        } else {
+            int8_t* out = reinterpret_cast<int8_t*>(storage.data()) + base;
+            for (int x = 0; x < dims.x; ++x) {
+                out[3 * x] = (int8_t)std::floor(gx[x] * invScale * 127.0f + 0.5f);
+                out[3 * x + 1] = (int8_t)std::floor(gy[x] * invScale * 127.0f + 0.5f);
+                out[3 * x + 2] = (int8_t)std::floor(gz[x] * invScale * 127.0f + 0.5f);
+            }
+        }
+    });
+}
+
+glm::vec3 GradientField::fetch(long long index) const {
+    if (precision == Float32) {
+        const float* g = reinterpret_cast<const float*>(storage.data()) + index * 3;
+        return glm::vec3(g[0], g[1], g[2]);
+    }
+    if (precision == Float16) {
+        const uint16_t* g = reinterpret_cast<const uint16_t*>(storage.data()) + index * 3;
+        return glm::vec3(halfToFloat(g[0]), halfToFloat(g[1]), halfToFloat(g[2])) * scale;
+    }
+    const int8_t* g = reinterpret_cast<const int8_t*>(storage.data()) + index * 3;
+    return glm::vec3(g[0], g[1], g[2]) * (scale / 127.0f);
+}
+
+glm::vec3 GradientField::sample(const glm::vec3& coord) const {
+    if (storage.empty()) return glm::vec3(0.0f);
+    float x = glm::clamp(coord.x, 0.0f, (float)dimensions.x - 1.001f);
+    float y = glm::clamp(coord.y, 0.0f, (float)dimensions.y - 1.001f);
+    float z = glm::clamp(coord.z, 0.0f, (float)dimensions.z - 1.001f);
+
+    int x0 = (int)x, y0 = (int)y, z0 = (int)z;
+    int x1 = x0 + 1, y1 = y0 + 1, z1 = z0 + 1;
+    float xd = x - x0, yd = y - y0, zd = z - z0;
+
+    auto get_val = [&](int i, int j, int k) {
+        return fetch(((long long)k * dimensions.y + j) * dimensions.x + i);
+    };
+
+    glm::vec3 c00 = get_val(x0, y0, z0) * (1 - xd) + get_val(x1, y0, z0) * xd;
+    glm::vec3 c01 = get_val(x0, y0, z1) * (1 - xd) + get_val(x1, y0, z1) * xd;
+    glm::vec3 c10 = get_val(x0, y1, z0) * (1 - xd) + get_val(x1, y1, z0) * xd;
+    glm::vec3 c11 = get_val(x0, y1, z1) * (1 - xd) + get_val(x1, y1, z1) * xd;
+
+    glm::vec3 c0 = c00 * (1 - yd) + c10 * yd;
+    glm::vec3 c1 = c01 * (1 - yd) + c11 * yd;
+
+    return c0 * (1 - zd) + c1 * zd;
+}
+
+glm::vec3 GradientField::normalAt(const glm::vec3& coord) const {
+    glm::vec3 g = sample(coord);
+    float len = glm::length(g);
+    if (len < 1e-12f) return glm::vec3(0.0f, 0.0f, 1.0f);
+    return -g / len;
+}
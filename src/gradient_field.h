@@ -0,0 +1,57 @@
+#ifndef GRADIENT_FIELD_H
+#define GRADIENT_FIELD_H
+
+#include "scalar_field.h"
+#include "sparse_field.h"
+#include <functional>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Central-difference gradient of a scalar field, computed once and shared by
+// every feature that needs gradients (isosurface normals, derived fields, ...).
+class GradientField {
+public:
+    // Storage format of the interleaved xyz components
+    enum Precision {
+        Float32, // Exact, 12 bytes per voxel
+        Float16, // Half floats, 6 bytes per voxel
+        Snorm8   // Signed normalized bytes, 3 bytes per voxel
+    };
+
+    GradientField();
+
+    // Computes the gradient in data units per world unit. Borders use one-sided
+    // differences. Rows are processed with SIMD and slabs run in parallel.
+    void compute(const ScalarField& field, glm::vec3 spacing, Precision precision = Float16);
+    // The same from a tiled field, read a few slices at a time
+    void compute(const SparseField& field, glm::vec3 spacing, Precision precision = Float16);
+
+    bool empty() const { return storage.empty(); }
+
+    // Gradient at a grid-space coordinate using trilinear interpolation
+    glm::vec3 sample(const glm::vec3& coord) const;
+
+    // Unit surface normal at a grid-space coordinate (points towards lower values)
+    glm::vec3 normalAt(const glm::vec3& coord) const;
+
+    // Raw interleaved storage for GPU upload. Stored values are gradient / getScale().
+    const void* data() const { return storage.data(); }
+    Precision getPrecision() const { return precision; }
+    float getScale() const { return scale; }
+    const glm::ivec3& getDimensions() const { return dimensions; }
+
+private:
+    typedef std::function<void(const float*, const float*, const float*, int, int)> RowFn;
+
+    glm::vec3 fetch(long long index) const;
+    // Quantizes and stores the rows that forEachRow passes as fn(gx, gy, gz, y, z)
+    void store(const glm::ivec3& dims, Precision precision, bool noValues,
+               const std::function<void(const RowFn&)>& forEachRow);
+
+    glm::ivec3 dimensions;
+    Precision precision;
+    float scale; // Multiplier from stored values back to gradient units
+    std::vector<unsigned char> storage;
+};
+
+#endif // GRADIENT_FIELD_H
@@ -0,0 +1,149 @@
+#ifndef LRU_CACHE_H
+#define LRU_CACHE_H
+
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+// Thread-safe least-recently-used cache of immutable values, bounded by the
+// total byte size the caller reports for each value. Values are shared, so
+// an evicted value stays alive for whoever still holds it.
+template <typename Key, typename Value>
+class LruCache {
+public:
+    typedef std::shared_ptr<const Value> Pointer;
+
+    struct Stats {
+        size_t hits, misses, evictions;
+        size_t bytes, budget;
+    };
+
+    explicit LruCache(size_t budgetBytes) : bytes(0), budget(budgetBytes), hits(0), misses(0), evictions(0) {}
+
+    // Cached value or null; counts a hit or a miss
+    Pointer find(const Key& key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return findLocked(key);
+    }
+
+    // Adds a value of `size` bytes unless the key is present, evicting the
+    // least recently used values to stay within the budget. Values larger
+    // than the whole budget are not kept.
+    void insert(const Key& key, const Pointer& value, size_t size) {
+        std::lock_guard<std::mutex> lock(mutex);
+        insertLocked(key, value, size);
+    }
+
+    // Cached value, or the result of compute() which is then cached.
+    // Concurrent calls for the same key wait for the first one instead of
+    // computing it again. compute() returns the value and sets its size; a
+    // null value is returned to every waiter but not cached.
+    Pointer getOrCompute(const Key& key, const std::function<Pointer(size_t&)>& compute) {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            Pointer value = findLocked(key);
+            if (value) return value;
+            typename std::map<Key, Pending>::iterator it = pending.find(key);
+            if (it == pending.end()) break;
+            std::shared_ptr<Flight> flight = it->second;
+            --misses; // Only the computing call counts as a miss
+            ++hits;
+            done.wait(lock, [&flight]() { return flight->finished; });
+            return flight->value;
+        }
+        std::shared_ptr<Flight> flight = std::make_shared<Flight>();
+        pending[key] = flight;
+        lock.unlock();
+
+        size_t size = 0;
+        Pointer value;
+        try {
+            value = compute(size);
+        } catch (...) {
+            finish(key, flight, Pointer(), 0);
+            throw;
+        }
+        finish(key, flight, value, size);
+        return value;
+    }
+
+    Stats getStats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        Stats stats = { hits, misses, evictions, bytes, budget };
+        return stats;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.clear();
+        order.clear();
+        bytes = 0;
+    }
+
+private:
+    LruCache(const LruCache&);
+    LruCache& operator=(const LruCache&);
+
+    struct Entry {
+        Pointer value;
+        size_t size;
+        typename std::list<Key>::iterator use; // Position in order
+    };
+    struct Flight {
+        bool finished;
+        Pointer value;
+        Flight() : finished(false) {}
+    };
+    typedef std::shared_ptr<Flight> Pending;
+
+    Pointer findLocked(const Key& key) {
+        typename std::map<Key, Entry>::iterator it = entries.find(key);
+        if (it == entries.end()) {
+            ++misses;
+            return Pointer();
+        }
+        ++hits;
+        order.splice(order.begin(), order, it->second.use);
+        return it->second.value;
+    }
+
+    void insertLocked(const Key& key, const Pointer& value, size_t size) {
+        if (!value || size > budget || entries.count(key)) return;
+        while (bytes + size > budget && !order.empty()) {
+            typename std::map<Key, Entry>::iterator victim = entries.find(order.back());
+            bytes -= victim->second.size;
+            entries.erase(victim);
+            order.pop_back();
+            ++evictions;
+        }
+        order.push_front(key);
+        Entry entry = { value, size, order.begin() };
+        entries[key] = entry;
+        bytes += size;
+    }
+
+    void finish(const Key& key, const std::shared_ptr<Flight>& flight, const Pointer& value, size_t size) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            insertLocked(key, value, size);
+            flight->value = value;
+            flight->finished = true;
+            pending.erase(key);
+        }
+        done.notify_all();
+    }
+
+    mutable std::mutex mutex;
+    std::condition_variable done;
+    std::map<Key, Entry> entries;
+    std::list<Key> order; // Most recently used first
+    std::map<Key, Pending> pending;
+    size_t bytes, budget;
+    size_t hits, misses, evictions;
+};
+
+#endif // LRU_CACHE_H
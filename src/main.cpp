@@ -2,6 +2,14 @@
 #include <vector>
 #include <algorithm>
 #include <string>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <memory>
+#include <atomic>
+#include <chrono>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -11,16 +19,160 @@
 
 #include "camera.h"
 #include "vtk_parser.h"
-#include "shader_utils.h"
+#include "shader_manager.h"
 #include "marching_cubes.h"
+#include "mesh_lod.h"
+#include "mesh_components.h"
+#include "slice_engine.h"
+#include "derived_field.h"
+#include "compute_worker.h"
+#include "gradient_field.h"
+#include "thread_pool.h"
+#include "vis_server.h"
+#include "software_renderer.h"
+#include "session_script.h"
 
 // --- Globals & Callbacks ---
 Camera camera(800, 600);
 int slicingAxis = 0; // 0=Z, 1=Y, 2=X
 bool showIsosurface = false;
 bool useGpuSlicing = true; // Start with the GPU version by default
-GLuint sliceTexture; 
+GLuint sliceTextures[3]; // CPU slice images, one per plane on screen
+int sliceMode = 0;       // 0 = one axis-aligned plane, 1 = one oblique plane, 2 = three orthogonal planes
+const char* sliceModeNames[3] = { "Axis-Aligned Slice", "Oblique Slice", "Orthogonal Planes" };
+float obliqueAzimuth = 30.0f;   // Normal of the oblique plane, in degrees
+float obliqueElevation = 35.0f;
+bool animate = true;       // Sweep the slice plane and isovalue; when paused, frames are only drawn on demand
+double animationTime = 0.0; // Seconds of animation so far
 bool useGpuMarchingCubes = false;
+bool showNestedSurfaces = false; // Several fixed isovalues extracted in one pass
+const int numNestedLevels = 5;   // Must not exceed MAX_LEVELS (8) in mc_gpu_multi_geo.glsl
+bool hasColorField = false;      // Set when --color-field names a loaded field
+bool colorBySecondField = false; // Isosurfaces coloured by that field instead of visit order
+ComponentFilter componentFilter = { 0, 0 }; // --keep-largest / --min-component; all zero = no filtering
+std::vector<ComponentStats> lastComponentStats; // Of the most recent CPU extraction, one per surface
+bool haveComponentStats = false;
+bool printMetricsRequested = false; // Print the metrics of the isosurface(s) on screen
+glm::ivec3 gridDims;     // Grid points of the loaded field
+GridExtent roi;          // Region of interest, inclusive grid points; all work is limited to it
+GridExtent roiLimit;     // Bounds of ROI edits: the grid, or the --roi box when derived fields cover only that
+int roiVersion = 0;      // Bumped on every ROI change so the render loop re-applies it
+int roiEditFace = 0;     // Face moved by +/-: 0=-X 1=+X 2=-Y 3=+Y 4=-Z 5=+Z
+const char* roiFaceNames[6] = { "-X", "+X", "-Y", "+Y", "-Z", "+Z" };
+SessionScript* sessionRecording = nullptr; // --record: key presses are added here
+long sessionFrame = 0;                     // Frame the next input applies to
+
+// Per-worker utilization of the shared thread pool since the last reset
+void printPoolUtilization() {
+    ThreadPool& pool = ThreadPool::instance();
+    std::vector<WorkerStats> stats = pool.getStats();
+    double window = pool.getStatsWindowSeconds();
+    std::cout << "Thread pool: " << pool.concurrency() << " threads, " << window << " s window" << std::endl;
+    for (size_t i = 0; i < stats.size(); ++i) {
+        std::cout << "  worker " << i << ": " << std::fixed << std::setprecision(1)
+                  << 100.0 * stats[i].busySeconds / window << "% busy, "
+                  << stats[i].tasksExecuted << " tasks (" << stats[i].tasksStolen << " stolen)" << std::endl;
+    }
+    std::cout.unsetf(std::ios::fixed);
+}
+
+bool componentFilterEnabled() {
+    return componentFilter.keepLargest > 0 || componentFilter.minTriangles > 0;
+}
+
+// Component count, sizes and bounds of the last filtered CPU isosurface(s)
+void printComponentStats() {
+    if (!haveComponentStats) {
+        std::cout << "No component statistics yet (needs a CPU isosurface with --keep-largest or --min-component)" << std::endl;
+        return;
+    }
+    const size_t maxListed = 10;
+    for (size_t level = 0; level < lastComponentStats.size(); ++level) {
+        const ComponentStats& stats = lastComponentStats[level];
+        if (lastComponentStats.size() > 1) std::cout << "Level " << level << ": ";
+        std::cout << "Components: " << stats.components.size() << " found, " << stats.keptComponents << " kept, "
+                  << stats.keptTriangles << " triangles kept, " << stats.removedTriangles << " removed" << std::endl;
+        for (size_t i = 0; i < stats.components.size() && i < maxListed; ++i) {
+            const MeshComponent& c = stats.components[i];
+            std::cout << "  #" << i << ": " << c.triangleCount << " triangles, bounds ("
+                      << c.boundsMin.x << ", " << c.boundsMin.y << ", " << c.boundsMin.z << ") - ("
+                      << c.boundsMax.x << ", " << c.boundsMax.y << ", " << c.boundsMax.z << ")" << std::endl;
+        }
+        if (stats.components.size() > maxListed) std::cout << "  ..." << std::endl;
+    }
+}
+
+// One CSV row per isovalue, in world units
+void printSurfaceMetrics(const std::vector<float>& isovalues, const std::vector<SurfaceMetrics>& metrics) {
+    std::cout << "isovalue,triangles,area,volume,centroid_x,centroid_y,centroid_z" << std::endl;
+    for (size_t i = 0; i < metrics.size(); ++i) {
+        const SurfaceMetrics& m = metrics[i];
+        std::cout << isovalues[i] << "," << m.triangleCount << "," << m.area << "," << m.volume << ","
+                  << m.centroid.x << "," << m.centroid.y << "," << m.centroid.z << std::endl;
+    }
+}
+
+void printRoi() {
+    std::cout << "ROI: (" << roi.first.x << ", " << roi.first.y << ", " << roi.first.z << ") - ("
+              << roi.last.x << ", " << roi.last.y << ", " << roi.last.z << "), editing face "
+              << roiFaceNames[roiEditFace] << std::endl;
+}
+
+// Viewer mode a replayed frame's time is reported under
+std::string viewModeName() {
+    if (showIsosurface) {
+        return std::string(useGpuMarchingCubes ? "GPU MC" : "CPU MC") + (showNestedSurfaces ? " nested" : "");
+    }
+    const char* planes[3] = { "", " oblique", " planes" };
+    return std::string(useGpuSlicing ? "GPU slicer" : "CPU slicer") + planes[sliceMode];
+}
+
+glm::vec3 obliqueNormal() {
+    float azimuth = glm::radians(obliqueAzimuth), elevation = glm::radians(obliqueElevation);
+    return glm::vec3(cos(elevation) * cos(azimuth), cos(elevation) * sin(azimuth), sin(elevation));
+}
+
+void tiltObliquePlane(float dAzimuth, float dElevation) {
+    obliqueAzimuth = std::fmod(obliqueAzimuth + dAzimuth + 360.0f, 360.0f);
+    obliqueElevation = glm::clamp(obliqueElevation + dElevation, -90.0f, 90.0f);
+    std::cout << "Oblique plane normal: azimuth " << obliqueAzimuth << ", elevation " << obliqueElevation << std::endl;
+}
+
+// Grows (+1) or shrinks (-1) the ROI at the selected face by 1/32 of the grid,
+// keeping at least one cell along every axis
+void moveRoiFace(int direction) {
+    int axis = roiEditFace / 2;
+    int step = std::max(1, gridDims[axis] / 32);
+    if (roiEditFace % 2 == 0) {
+        roi.first[axis] = glm::clamp(roi.first[axis] - direction * step, roiLimit.first[axis], roi.last[axis] - 1);
+    } else {
+        roi.last[axis] = glm::clamp(roi.last[axis] + direction * step, roi.first[axis] + 1, roiLimit.last[axis]);
+    }
+    ++roiVersion;
+    printRoi();
+}
+
+// Evaluates a --derive NAME=EXPRESSION option over `extent` into a new field of the parser
+bool deriveField(VtkParser& parser, const std::string& spec, const GridExtent& extent) {
+    size_t equals = spec.find('=');
+    if (equals == std::string::npos || equals == 0) {
+        std::cerr << "Error: --derive expects NAME=EXPRESSION, got '" << spec << "'." << std::endl;
+        return false;
+    }
+    std::string name = spec.substr(0, equals), source = spec.substr(equals + 1);
+    FieldExpression expression;
+    std::string error;
+    if (!expression.compile(source, parser, error)) {
+        std::cerr << "Error in derived field " << name << ": " << error << std::endl;
+        return false;
+    }
+    ScalarField* target = parser.createScalarField(name, VoxelFloat32);
+    if (!target) return false;
+    DerivedField derived(expression);
+    derived.materialize(extent, *target);
+    std::cout << "Derived field: " << name << " = " << source << std::endl;
+    return true;
+}
 
 void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
     Camera* cam = static_cast<Camera*>(glfwGetWindowUserPointer(window));
@@ -37,6 +189,7 @@ void scrollCallback(GLFWwindow* window, double xoffset, double yoffset) {
     cam->scrollCallback(window, xoffset, yoffset);
 }
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    if (action == GLFW_PRESS && sessionRecording) sessionRecording->addKeyPress(sessionFrame, key);
     if (action == GLFW_PRESS) {
         if(key == GLFW_KEY_C)
         {
@@ -53,6 +206,20 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
                 std::cout << "Switched to CPU Slicing" << std::endl;
             }
         }
+        if (key == GLFW_KEY_O) {
+            sliceMode = (sliceMode + 1) % 3;
+            std::cout << "Switched to " << sliceModeNames[sliceMode] << std::endl;
+        }
+        if (sliceMode == 1) {
+            if (key == GLFW_KEY_LEFT) tiltObliquePlane(-5.0f, 0.0f);
+            if (key == GLFW_KEY_RIGHT) tiltObliquePlane(5.0f, 0.0f);
+            if (key == GLFW_KEY_DOWN) tiltObliquePlane(0.0f, -5.0f);
+            if (key == GLFW_KEY_UP) tiltObliquePlane(0.0f, 5.0f);
+        }
+        if (key == GLFW_KEY_SPACE) {
+            animate = !animate;
+            std::cout << (animate ? "Animation resumed" : "Animation paused") << std::endl;
+        }
         if (key == GLFW_KEY_M) {
             showIsosurface = !showIsosurface;
             std::cout << "Switched to " << (showIsosurface ? "Isosurface View" : "Slicer View") << std::endl;
@@ -61,11 +228,46 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
             useGpuMarchingCubes = !useGpuMarchingCubes;
             std::cout << "Switched to " << (useGpuMarchingCubes ? "useGpuMarchingCubes " : "useCpuMarchingCubes") << std::endl;
         }
+        if (key == GLFW_KEY_P) {
+            printPoolUtilization();
+        }
+        if (key == GLFW_KEY_N) {
+            showNestedSurfaces = !showNestedSurfaces;
+            std::cout << "Switched to " << (showNestedSurfaces ? "Nested Isosurfaces" : "Animated Isosurface") << std::endl;
+        }
+        if (key == GLFW_KEY_I && showIsosurface) {
+            printMetricsRequested = true;
+        }
+        if (key == GLFW_KEY_K) {
+            printComponentStats();
+        }
+        if (key == GLFW_KEY_B) {
+            roiEditFace = (roiEditFace + 1) % 6;
+            printRoi();
+        }
+        if (key == GLFW_KEY_EQUAL) moveRoiFace(1);
+        if (key == GLFW_KEY_MINUS) moveRoiFace(-1);
+        if (key == GLFW_KEY_R) {
+            roi = roiLimit;
+            ++roiVersion;
+            printRoi();
+        }
+        if (key == GLFW_KEY_F && hasColorField) {
+            colorBySecondField = !colorBySecondField;
+            std::cout << "Isosurface colour: " << (colorBySecondField ? "colour field" : "cell order") << std::endl;
+        }
     }
 }
 
 
 
+// Attribute layout of the compact Vertex (see marching_cubes.h) for the bound VAO/VBO
+void setupIsoVertexAttributes() {
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, pos)); glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 1, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, scalar)); glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 2, GL_SHORT, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, normal)); glEnableVertexAttribArray(2);
+}
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     glViewport(0, 0, width, height);
 }
@@ -96,63 +298,620 @@ glm::vec3 getColor(float value, float min_val, float max_val) {
     }
 }
 
+// Uniforms shared by the single- and multi-level GPU Marching Cubes programs;
+// the samplers get fixed texture units
+struct McGpuUniforms {
+    Uniform<glm::mat4> model;
+    Uniform<float> valueScale, colorValueScale, colorMin, colorMax;
+    Uniform<bool> useColorField;
+    Uniform<glm::ivec3> dataDimensions, roiOrigin;
+    Uniform<GLuint> totalCubes;
+
+    explicit McGpuUniforms(ShaderProgram& program)
+        : model(program.uniform<glm::mat4>("model")), valueScale(program.uniform<float>("valueScale")),
+          colorValueScale(program.uniform<float>("colorValueScale")), colorMin(program.uniform<float>("colorMin")),
+          colorMax(program.uniform<float>("colorMax")), useColorField(program.uniform<bool>("useColorField")),
+          dataDimensions(program.uniform<glm::ivec3>("dataDimensions")), roiOrigin(program.uniform<glm::ivec3>("roiOrigin")),
+          totalCubes(program.uniform<GLuint>("totalCubes")) {
+        program.setSampler("volumeTexture", 0);
+        program.setSampler("edgeTable", 1);
+        program.setSampler("triTable", 2);
+        program.setSampler("gradientTexture", 3);
+        program.setSampler("colormapTexture", 4);
+        program.setSampler("colorTexture", 5);
+    }
+};
+
+// --- Background compute ---
+// Heavy CPU work runs on ComputeWorkers so the render loop keeps drawing the
+// newest finished result while the next one is computed.
+
+// The animated isosurface or the nested set, as extracted on the surface worker
+struct SurfaceRequest {
+    bool nested;
+    std::vector<float> isovalues;
+    GridExtent roi;
+    bool colored; // Colour by `coloring` instead of cell order
+    SurfaceColoring coloring;
+    bool measure; // Also accumulate the metrics (animated surface only)
+
+    bool operator==(const SurfaceRequest& o) const {
+        return nested == o.nested && isovalues == o.isovalues && roi == o.roi && colored == o.colored &&
+               (!colored || (coloring.field == o.coloring.field && coloring.minValue == o.coloring.minValue &&
+                             coloring.maxValue == o.coloring.maxValue)) &&
+               measure == o.measure;
+    }
+};
+
+struct SurfaceResult {
+    std::vector<Vertex> vertices;        // Animated surface
+    std::vector<LodLevel> lods;          // Nested surfaces as levels of detail
+    std::vector<SurfaceMetrics> metrics; // When measured
+    bool filtered;                       // componentStats is valid
+    std::vector<ComponentStats> componentStats; // Per filtered surface, in isovalue order
+};
+
+struct SurfaceJob {
+    const ScalarField* field;
+    const SparseField* sparse; // Tiled field (--sparse); `field` is null then
+    const GradientField* gradients;
+    glm::vec3 spacing;
+    glm::ivec3 dims;
+    int numLodLevels;
+
+    void operator()(const SurfaceRequest& request, SurfaceResult& result) const {
+        MarchingCubes mc;
+        mc.setSpacing(spacing);
+        mc.setExtent(request.roi);
+        const SurfaceColoring* coloring = request.colored ? &request.coloring : nullptr;
+        result.filtered = componentFilterEnabled();
+        result.lods.clear();
+        result.metrics.clear();
+        result.componentStats.clear();
+        if (!request.nested) {
+            if (request.measure) {
+                // Measured in the same pass as the extraction
+                result.metrics.resize(1);
+                if (sparse) {
+                    result.vertices = mc.generateSurface(*sparse, request.isovalues[0], gradients, coloring, result.metrics[0]);
+                } else {
+                    result.vertices = mc.generateSurface(*field, request.isovalues[0], gradients, coloring, result.metrics[0]);
+                }
+            } else if (sparse) {
+                result.vertices = mc.generateSurface(*sparse, request.isovalues[0], gradients, coloring);
+            } else {
+                result.vertices = mc.generateSurface(*field, request.isovalues[0], gradients, coloring);
+            }
+            // Drop small fragments before they cost upload and draw time
+            if (result.filtered) result.componentStats.assign(1, MeshComponents::filter(result.vertices, componentFilter));
+            return;
+        }
+        result.vertices.clear();
+        std::vector<std::vector<Vertex>> surfaces = sparse ? mc.generateSurfaces(*sparse, request.isovalues, gradients, coloring)
+                                                           : mc.generateSurfaces(*field, request.isovalues, gradients, coloring);
+        // Each surface is simplified on its own, so shells crossing the same
+        // clustering cell are never welded together; the levels are then merged
+        MeshSimplifier simplifier;
+        for (size_t i = 0; i < surfaces.size(); ++i) {
+            if (result.filtered) result.componentStats.push_back(MeshComponents::filter(surfaces[i], componentFilter));
+            std::vector<LodLevel> lods = simplifier.buildLods(surfaces[i], dims, numLodLevels);
+            std::vector<Vertex>().swap(surfaces[i]);
+            if (result.lods.size() < lods.size()) result.lods.resize(lods.size());
+            for (size_t level = 0; level < lods.size(); ++level) {
+                LodLevel& merged = result.lods[level];
+                merged.cellVoxels = lods[level].cellVoxels;
+                merged.vertices.insert(merged.vertices.end(), lods[level].vertices.begin(), lods[level].vertices.end());
+            }
+        }
+    }
+};
+
+// Metrics printed on request ('I') for the GPU and nested views
+struct MetricsRequest {
+    std::vector<float> isovalues;
+    GridExtent roi;
+    int serial; // Every key press is a new request, even for the same surfaces
+
+    bool operator==(const MetricsRequest& o) const {
+        return isovalues == o.isovalues && roi == o.roi && serial == o.serial;
+    }
+};
+
+struct MetricsResult {
+    std::vector<SurfaceMetrics> metrics;
+};
+
+struct MetricsJob {
+    const ScalarField* field;
+    const SparseField* sparse; // Used instead of `field` when set
+    glm::vec3 spacing;
+
+    void operator()(const MetricsRequest& request, MetricsResult& result) const {
+        MarchingCubes mc;
+        mc.setSpacing(spacing);
+        mc.setExtent(request.roi);
+        result.metrics = sparse ? mc.measureSurfaces(*sparse, request.isovalues) : mc.measureSurfaces(*field, request.isovalues);
+    }
+};
+
+// CPU slices of the planes on screen
+struct SliceRequest {
+    std::vector<SlicePlane> planes;
+    GridExtent roi;
+    float minValue, maxValue; // Colormap range
+
+    bool operator==(const SliceRequest& o) const {
+        return planes == o.planes && roi == o.roi && minValue == o.minValue && maxValue == o.maxValue;
+    }
+};
+
+// A coloured slice, shared by the slice job's cache and the results it publishes
+struct SliceTexture {
+    SliceImage layout; // Lattice only; the samples stay in the slice engine
+    std::vector<unsigned char> rgba;
+};
+
+struct SliceResult {
+    std::vector<std::shared_ptr<const SliceTexture>> slices; // One per plane
+};
+
+// Keeps the slice engine and the coloured images between requests, so only
+// planes that moved are resampled and recoloured
+struct SliceJob {
+    const ScalarField* field;
+    const SparseField* sparse; // Used instead of `field` when set
+    glm::vec3 spacing;
+    SliceEngine engine;
+    GridExtent roi;
+    float minValue, maxValue;
+    bool configured;
+    std::vector<std::shared_ptr<const SliceTexture>> textures;
+
+    SliceJob(const ScalarField* field, const SparseField* sparse, const glm::vec3& spacing)
+        : field(field), sparse(sparse), spacing(spacing), minValue(0.0f), maxValue(0.0f), configured(false) {}
+
+    void operator()(const SliceRequest& request, SliceResult& result) {
+        if (!configured || request.roi != roi || request.minValue != minValue || request.maxValue != maxValue) {
+            if (sparse) engine.setField(sparse, spacing, request.roi);
+            else engine.setField(field, spacing, request.roi);
+            textures.clear();
+            roi = request.roi;
+            minValue = request.minValue;
+            maxValue = request.maxValue;
+            configured = true;
+        }
+        if (textures.size() < request.planes.size()) textures.resize(request.planes.size());
+        for (size_t p = 0; p < request.planes.size(); ++p) {
+            bool resampled = false;
+            const SliceImage& image = engine.slice(p, request.planes[p], &resampled);
+            if (!resampled && textures[p]) continue;
+            std::shared_ptr<SliceTexture> texture(new SliceTexture);
+            engine.layout(request.planes[p], texture->layout);
+            int texWidth = image.width;
+            std::vector<unsigned char>& rgba = texture->rgba;
+            rgba.resize((size_t)image.width * image.height * 4);
+            // Rows are independent, so they are coloured in parallel on the shared pool
+            ThreadPool::instance().parallelFor(image.height, 8, [&](size_t rowBegin, size_t rowEnd) {
+                for (int row = (int)rowBegin; row < (int)rowEnd; ++row) {
+                    for (int col = 0; col < texWidth; ++col) {
+                        int i = row * texWidth + col;
+                        float value = image.values[i];
+                        glm::vec3 c = getColor(value, minValue, maxValue);
+                        rgba[i * 4] = c.r * 255; rgba[i * 4 + 1] = c.g * 255; rgba[i * 4 + 2] = c.b * 255;
+                        rgba[i * 4 + 3] = (value == value) ? 255 : 0; // NaN = outside the volume
+                    }
+                }
+            });
+            textures[p] = texture;
+        }
+        result.slices.assign(textures.begin(), textures.begin() + request.planes.size());
+    }
+};
+
+// Position in [0, 1] of the animated slice plane and isovalue at animation
+// time `time`; one sweep up and down takes SWEEP_PERIOD seconds
+const double SWEEP_PERIOD = 4.0 * 3.14159265358979323846;
+float sweepPosition(double time) {
+    return (float)(sin(time * 0.5) * 0.5 + 0.5);
+}
+
+// Headless rendering of the animated sweep (--render) into an image sequence
+struct SweepRender {
+    std::string mode;          // "slice", "oblique" or "iso"
+    int frames;
+    int width, height;
+    std::string outputPattern; // printf pattern with one integer conversion
+};
+
+// True if `pattern` holds exactly one conversion of the form %d / %04d
+bool isFramePattern(const std::string& pattern) {
+    size_t percent = pattern.find('%');
+    if (percent == std::string::npos || pattern.find('%', percent + 1) != std::string::npos) return false;
+    size_t end = pattern.find_first_not_of("0123456789", percent + 1);
+    return end != std::string::npos && pattern[end] == 'd';
+}
+
+// Renders the sweep the viewer animates: frame i shows animation time
+// SWEEP_PERIOD * i / frames, so one sequence covers a full back-and-forth
+// and never depends on wall-clock timing. Slices come from the CPU slicer and
+// isosurfaces from the CPU extractor, drawn by the software renderer with the
+// viewer's camera and colours. Frames are independent and run in parallel.
+// `field` is a ScalarField or a SparseField.
+template <typename Field>
+bool renderSweep(const SweepRender& render, const Field& field, const ScalarField* colorField,
+                 const glm::vec3& spacing, float minScalar, float maxScalar) {
+    glm::vec3 size = glm::vec3(gridDims - glm::ivec3(1)) * spacing;
+    glm::mat4 view = camera.getViewMatrix();
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)render.width / (float)render.height, 0.1f, 2000.0f);
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), -size / 2.0f) * glm::scale(glm::mat4(1.0f), size);
+    glm::mat4 sliceModel = glm::translate(glm::mat4(1.0f), -size / 2.0f);
+    glm::mat4 roiModel = glm::translate(glm::mat4(1.0f), -size / 2.0f + glm::vec3(roi.first) * spacing) *
+                         glm::scale(glm::mat4(1.0f), glm::vec3(roi.last - roi.first) * spacing);
+    std::vector<glm::vec3> colormap;
+    for (int i = 0; i < 256; ++i) colormap.push_back(getColor((float)i, 0.0f, 255.0f));
+
+    const float box[] = {0,0,0, 1,0,0, 1,0,0, 1,1,0, 1,1,0, 0,1,0, 0,1,0, 0,0,0, 0,0,1, 1,0,1, 1,0,1, 1,1,1, 1,1,1, 0,1,1, 0,1,1, 0,0,1, 0,0,0, 0,0,1, 1,0,0, 1,0,1, 1,1,0, 1,1,1, 0,1,0, 0,1,1};
+    std::vector<glm::vec3> boxLines;
+    for (int i = 0; i < 24; ++i) boxLines.push_back(glm::vec3(box[i * 3], box[i * 3 + 1], box[i * 3 + 2]));
+    glm::vec3 axisColors[3] = { glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f) };
+
+    // Isosurfaces use the same gradient normals and colouring as the viewer
+    GradientField gradients;
+    SurfaceColoring coloring = { colorField, 0.0f, 1.0f };
+    if (render.mode == "iso") {
+        gradients.compute(field, spacing, GradientField::Float16);
+        if (colorField) colorField->getRange(roi, coloring.minValue, coloring.maxValue);
+    }
+    SliceEngine layoutEngine;
+    layoutEngine.setField(&field, spacing, roi);
+    float minOffset, maxOffset;
+    layoutEngine.offsetRange(obliqueNormal(), minOffset, maxOffset);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::atomic<int> failures(0);
+    ThreadPool::instance().parallelFor(render.frames, 1, [&](size_t begin, size_t end) {
+        std::vector<char> path(render.outputPattern.size() + 32);
+        for (size_t frame = begin; frame < end; ++frame) {
+            float position = sweepPosition(SWEEP_PERIOD * frame / render.frames);
+            SoftwareRenderer renderer(render.width, render.height);
+            renderer.clear(glm::vec3(0.1f, 0.1f, 0.1f));
+            renderer.setCamera(projection * view, view);
+            renderer.setColormap(colormap);
+            renderer.drawLines(boxLines, model, glm::vec3(1.0f, 1.0f, 1.0f));
+            if (roi != GridExtent::whole(gridDims)) renderer.drawLines(boxLines, roiModel, glm::vec3(1.0f, 1.0f, 0.0f));
+            for (int axis = 0; axis < 3; ++axis) {
+                std::vector<glm::vec3> line(2, glm::vec3(0.0f));
+                line[1][axis] = 1.0f;
+                renderer.drawLines(line, glm::scale(model, glm::vec3(1.1f)), axisColors[axis]);
+            }
+
+            if (render.mode == "iso") {
+                MarchingCubes mc;
+                mc.setSpacing(spacing);
+                mc.setExtent(roi);
+                float isovalue = minScalar + position * (maxScalar - minScalar);
+                std::vector<Vertex> vertices = mc.generateSurface(field, isovalue, &gradients, colorField ? &coloring : nullptr);
+                if (componentFilterEnabled()) MeshComponents::filter(vertices, componentFilter);
+                renderer.drawSurface(vertices, model);
+            } else {
+                SlicePlane plane;
+                if (render.mode == "oblique") {
+                    plane = SlicePlane(obliqueNormal(), minOffset + position * (maxOffset - minOffset));
+                } else {
+                    int axis = 2 - slicingAxis;
+                    glm::vec3 normal(0.0f);
+                    normal[axis] = 1.0f;
+                    plane = SlicePlane(normal, (roi.first[axis] + position * (roi.last[axis] - roi.first[axis])) * spacing[axis]);
+                }
+                SliceEngine engine;
+                engine.setField(&field, spacing, roi);
+                renderer.drawSlice(engine.slice(0, plane), minScalar, maxScalar, sliceModel);
+            }
+
+            snprintf(path.data(), path.size(), render.outputPattern.c_str(), (int)frame);
+            if (!writeImage(path.data(), render.width, render.height, renderer.getPixels())) {
+                std::cerr << "Error: Could not write frame " << path.data() << std::endl;
+                ++failures;
+            }
+        }
+    });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Rendered " << render.frames - failures << " of " << render.frames << " frames ("
+              << render.width << "x" << render.height << ") in " << seconds << " s" << std::endl;
+    return failures == 0;
+}
+
+// Makes glTexImage3D read only `extent` out of a full grid of `dims` points
+void setUnpackExtent(const glm::ivec3& dims, const GridExtent& extent) {
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, dims.x);
+    glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, dims.y);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, extent.first.x);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, extent.first.y);
+    glPixelStorei(GL_UNPACK_SKIP_IMAGES, extent.first.z);
+}
+
+void resetUnpackExtent() {
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, 0);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+    glPixelStorei(GL_UNPACK_SKIP_IMAGES, 0);
+}
+
+// Uploads `extent` of the field to the bound 3D texture in its own precision
+// and returns the factor that maps sampled texel values back to data units
+float uploadVolumeTexture(const ScalarField& field, const GridExtent& extent) {
+    glm::ivec3 d = extent.dimensions();
+    setUnpackExtent(field.getDimensions(), extent);
+    float valueScale = 1.0f;
+    switch (field.getType()) {
+        case VoxelUInt8:   glTexImage3D(GL_TEXTURE_3D, 0, GL_R8, d.x, d.y, d.z, 0, GL_RED, GL_UNSIGNED_BYTE, field.data()); valueScale = 255.0f; break;
+        case VoxelUInt16:  glTexImage3D(GL_TEXTURE_3D, 0, GL_R16, d.x, d.y, d.z, 0, GL_RED, GL_UNSIGNED_SHORT, field.data()); valueScale = 65535.0f; break;
+        case VoxelFloat32: glTexImage3D(GL_TEXTURE_3D, 0, GL_R32F, d.x, d.y, d.z, 0, GL_RED, GL_FLOAT, field.data()); break;
+        default: {
+            // 32-bit integers and doubles have no matching filterable format.
+            // Signed integers go through float too: snorm formats map both the
+            // lowest and the next value (-128 and -127) to -1.0, so the minimum
+            // would come back one unit too high and the GPU would disagree with the CPU.
+            std::vector<float> converted;
+            field.toFloat(converted);
+            glTexImage3D(GL_TEXTURE_3D, 0, GL_R32F, d.x, d.y, d.z, 0, GL_RED, GL_FLOAT, converted.data());
+            break;
+        }
+    }
+    resetUnpackExtent();
+    return valueScale;
+}
+
+// The same from a tiled field: the extent is copied out as float
+float uploadVolumeTexture(const SparseField& field, const GridExtent& extent) {
+    glm::ivec3 d = extent.dimensions();
+    std::vector<float> values((size_t)d.x * d.y * d.z);
+    field.readBlock(extent, values.data());
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_R32F, d.x, d.y, d.z, 0, GL_RED, GL_FLOAT, values.data());
+    return 1.0f;
+}
+
+// Uploads `extent` of the gradients to the bound 3D texture
+void uploadGradientTexture(const GradientField& gradients, const glm::ivec3& dims, const GridExtent& extent) {
+    glm::ivec3 d = extent.dimensions();
+    setUnpackExtent(dims, extent);
+    switch (gradients.getPrecision()) {
+        case GradientField::Float32: glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB32F, d.x, d.y, d.z, 0, GL_RGB, GL_FLOAT, gradients.data()); break;
+        case GradientField::Float16: glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB16F, d.x, d.y, d.z, 0, GL_RGB, GL_HALF_FLOAT, gradients.data()); break;
+        case GradientField::Snorm8: glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB8_SNORM, d.x, d.y, d.z, 0, GL_RGB, GL_BYTE, gradients.data()); break;
+    }
+    resetUnpackExtent();
+}
+
 int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <path_to_vtk_file> [optional_field_name]" << std::endl;
+    // Options may appear anywhere; everything else is positional
+    std::vector<std::string> args;
+    ThreadPool::Options poolOptions;
+    std::string colorFieldName;
+    std::vector<std::string> derivedFields; // NAME=EXPRESSION
+    int metricsSweepLevels = 0;
+    std::string serveSocket;
+    bool useSparse = false;
+    std::string recordPath, replayPath;
+    long replayFrames = 0;
+    SweepRender sweepRender = { "", 0, 800, 600, "frame_%04d.ppm" };
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) poolOptions.numThreads = std::atoi(argv[++i]);
+        else if (arg == "--pin-threads") poolOptions.pinThreads = true;
+        else if (arg == "--color-field" && i + 1 < argc) colorFieldName = argv[++i];
+        else if (arg == "--derive" && i + 1 < argc) derivedFields.push_back(argv[++i]);
+        else if (arg == "--metrics-sweep" && i + 1 < argc) metricsSweepLevels = std::atoi(argv[++i]);
+        else if (arg == "--serve" && i + 1 < argc) serveSocket = argv[++i];
+        else if (arg == "--sparse") useSparse = true;
+        else if (arg == "--record" && i + 1 < argc) recordPath = argv[++i];
+        else if (arg == "--replay" && i + 1 < argc) replayPath = argv[++i];
+        else if (arg == "--replay-frames" && i + 1 < argc) replayFrames = std::atol(argv[++i]);
+        else if (arg == "--render" && i + 2 < argc) {
+            sweepRender.mode = argv[++i];
+            sweepRender.frames = std::atoi(argv[++i]);
+        }
+        else if (arg == "--render-size" && i + 2 < argc) {
+            sweepRender.width = std::atoi(argv[++i]);
+            sweepRender.height = std::atoi(argv[++i]);
+        }
+        else if (arg == "--render-output" && i + 1 < argc) sweepRender.outputPattern = argv[++i];
+        else if (arg == "--keep-largest" && i + 1 < argc) componentFilter.keepLargest = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--min-component" && i + 1 < argc) componentFilter.minTriangles = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--roi" && i + 6 < argc) {
+            for (int k = 0; k < 3; ++k) roi.first[k] = std::atoi(argv[++i]);
+            for (int k = 0; k < 3; ++k) roi.last[k] = std::atoi(argv[++i]);
+        }
+        else args.push_back(arg);
+    }
+    if (args.empty()) {
+        std::cerr << "Usage: " << argv[0] << " <path_to_vtk_file> [optional_field_name] [--color-field NAME] [--derive NAME=EXPRESSION] [--keep-largest N] [--min-component TRIANGLES] [--metrics-sweep LEVELS] [--roi X0 Y0 Z0 X1 Y1 Z1] [--render slice|oblique|iso FRAMES] [--render-size W H] [--render-output PATTERN] [--serve SOCKET] [--sparse] [--record SCRIPT | --replay SCRIPT [--replay-frames N]] [--threads N] [--pin-threads]" << std::endl;
         std::cerr << "Example: " << argv[0] << " resources/redseaT.vtk TEMP" << std::endl;
         return 1;
     }
-    std::string vtk_filepath = argv[1];
-
-    if (!glfwInit()) return -1;
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    GLFWwindow* window = glfwCreateWindow(800, 600, "Visualizer", NULL, NULL);
-    if (!window) { glfwTerminate(); return -1; }
-    glfwMakeContextCurrent(window);
-    if (glewInit() != GLEW_OK) return -1;
-
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetWindowUserPointer(window, &camera);
-    glfwSetMouseButtonCallback(window, mouseButtonCallback);
-    glfwSetCursorPosCallback(window, cursorPosCallback);
-    glfwSetScrollCallback(window, scrollCallback);
-    glfwSetKeyCallback(window, keyCallback);
+    if (sweepRender.frames > 0 && (sweepRender.mode != "slice" && sweepRender.mode != "oblique" && sweepRender.mode != "iso")) {
+        std::cerr << "Error: --render expects slice, oblique or iso, got '" << sweepRender.mode << "'." << std::endl;
+        return 1;
+    }
+    if (sweepRender.frames > 0 && (sweepRender.width < 1 || sweepRender.height < 1 || !isFramePattern(sweepRender.outputPattern))) {
+        std::cerr << "Error: --render needs a positive --render-size and a --render-output pattern with one %d, e.g. frames/sweep_%04d.png." << std::endl;
+        return 1;
+    }
+    if (!recordPath.empty() && !replayPath.empty()) {
+        std::cerr << "Error: --record and --replay cannot be combined." << std::endl;
+        return 1;
+    }
+    // A replay runs the recorded input for a fixed number of frames
+    SessionScript session;
+    bool replaying = !replayPath.empty();
+    if (replaying) {
+        if (!session.load(replayPath)) return 1;
+        if (replayFrames <= 0) replayFrames = session.getFrameCount();
+        if (replayFrames <= 0) {
+            std::cerr << "Error: The session script holds no frames; give --replay-frames N." << std::endl;
+            return 1;
+        }
+    }
+    if (!recordPath.empty()) sessionRecording = &session;
+    std::string vtk_filepath = args[0];
+    ThreadPool::configure(poolOptions);
 
     VtkParser parser(vtk_filepath);
     if (!parser.read()) return -1;
-    std::vector<float> scalars;
-    std::string fieldName = (argc > 2) ? argv[2] : parser.getFirstFieldName();
-    if (fieldName.empty() || !parser.getScalarField(fieldName, scalars)) {
+    // Derived fields are evaluated only inside the --roi box, grown by one
+    // voxel for the gradient stencil; ROI edits then stay inside that box
+    GridExtent derivedExtent = roi.resolve(parser.getDimensions());
+    derivedExtent = GridExtent(derivedExtent.first - glm::ivec3(1), derivedExtent.last + glm::ivec3(1)).resolve(parser.getDimensions());
+    for (size_t i = 0; i < derivedFields.size(); ++i) {
+        if (!deriveField(parser, derivedFields[i], derivedExtent)) return -1;
+    }
+
+    // Server mode: no window; clients share this one loaded copy of the dataset
+    if (!serveSocket.empty()) {
+        if (useSparse) std::cerr << "Warning: --sparse applies to the viewer; the server keeps its fields dense." << std::endl;
+        VisServer server(parser);
+        return server.run(serveSocket) ? 0 : -1;
+    }
+    std::string fieldName = (args.size() > 1) ? args[1] : parser.getFirstFieldName();
+    const ScalarField* field = fieldName.empty() ? nullptr : parser.getScalarField(fieldName);
+    if (!field) {
         std::cerr << "Error: Could not find or load scalar field '" << fieldName << "'." << std::endl;
         return -1;
     }
-    std::cout << "Visualizing field: " << fieldName << std::endl;
+    std::cout << "Visualizing field: " << fieldName << " (" << voxelTypeName(field->getType()) << ")" << std::endl;
+    // Optional second field that colours the isosurfaces
+    const ScalarField* colorField = nullptr;
+    if (!colorFieldName.empty()) {
+        colorField = parser.getScalarField(colorFieldName);
+        if (!colorField) return -1;
+        std::cout << "Colouring isosurfaces by: " << colorFieldName << std::endl;
+        hasColorField = colorBySecondField = true;
+    }
 
     glm::ivec3 dims = parser.getDimensions();
     glm::vec3 spacing = parser.getSpacing();
     glm::vec3 size = glm::vec3(dims - glm::ivec3(1)) * spacing;
-    float min_scalar = *std::min_element(scalars.begin(), scalars.end());
-    float max_scalar = *std::max_element(scalars.begin(), scalars.end());
-     // --- Auto-fit Camera (now using the true size) ---
+    gridDims = dims;
+    roi = roi.resolve(dims);
+    roiLimit = derivedFields.empty() ? GridExtent::whole(dims) : roi;
+    if (glm::any(glm::lessThan(roi.dimensions(), glm::ivec3(2)))) {
+        std::cerr << "Error: The region of interest must span at least two grid points along every axis." << std::endl;
+        return -1;
+    }
 
-    float radius = glm::length(size) * 0.5f;
+    // With --sparse the tiled field replaces the dense one: every CPU path reads
+    // the tiles and the GPU textures are filled from them. `field` is null then.
+    SparseField sparseField;
+    const SparseField* sparse = nullptr;
+    if (useSparse) {
+        sparseField = SparseField(*field);
+        sparse = &sparseField;
+        glm::ivec3 tiles = sparseField.getTileCount();
+        std::cout << "Sparse field: " << sparseField.getConstantTileCount() << " of " << (size_t)tiles.x * tiles.y * tiles.z
+                  << " tiles constant, " << std::fixed << std::setprecision(1)
+                  << sparseField.byteSize() / (1024.0 * 1024.0) << " MiB instead of "
+                  << field->byteSize() / (1024.0 * 1024.0) << " MiB" << std::endl;
+        std::cout.unsetf(std::ios::fixed);
+        if (field == colorField) {
+            std::cout << "The dense field stays loaded as the colour field." << std::endl;
+        } else {
+            parser.releaseScalarField(fieldName);
+        }
+        field = nullptr;
+    }
+    float min_scalar, max_scalar;
+    if (sparse) sparse->getRange(roi, min_scalar, max_scalar);
+    else field->getRange(roi, min_scalar, max_scalar);
 
+    // --- Auto-fit Camera (now using the true size) ---
+    float radius = glm::length(size) * 0.5f;
     float fov_radians = glm::radians(45.0f);
-
     float distance = radius / tan(fov_radians / 2.0f);
+    camera.setZoom(distance * 1.5f); // Use new distance
+
+    // Headless metrics sweep: no window, no geometry
+    if (metricsSweepLevels > 0) {
+        std::vector<float> isovalues(metricsSweepLevels);
+        for (int i = 0; i < metricsSweepLevels; ++i) {
+            isovalues[i] = min_scalar + (i + 1) * (max_scalar - min_scalar) / (metricsSweepLevels + 1);
+        }
+        MarchingCubes sweeper;
+        sweeper.setSpacing(spacing);
+        sweeper.setExtent(roi);
+        printSurfaceMetrics(isovalues, sparse ? sweeper.measureSurfaces(*sparse, isovalues) : sweeper.measureSurfaces(*field, isovalues));
+        return 0;
+    }
+
+    // Headless sweep rendering: no window, no GL
+    if (sweepRender.frames > 0) {
+        bool rendered = sparse ? renderSweep(sweepRender, *sparse, colorField, spacing, min_scalar, max_scalar)
+                               : renderSweep(sweepRender, *field, colorField, spacing, min_scalar, max_scalar);
+        return rendered ? 0 : -1;
+    }
+
+    if (!glfwInit()) return -1;
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    GLFWwindow* window = glfwCreateWindow(800, 600, "Visualizer", NULL, NULL);
+    if (!window) { glfwTerminate(); return -1; }
+    glfwMakeContextCurrent(window);
+    if (glewInit() != GLEW_OK) return -1;
 
-    camera.setZoom(distance * 1.5f); // Use new distance 
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetWindowUserPointer(window, &camera);
+    if (replaying) {
+        // The script is the only input, and frames are not held back by vsync
+        glfwSwapInterval(0);
+    } else {
+        glfwSetMouseButtonCallback(window, mouseButtonCallback);
+        glfwSetCursorPosCallback(window, cursorPosCallback);
+        glfwSetScrollCallback(window, scrollCallback);
+        glfwSetKeyCallback(window, keyCallback);
+    }
 
 
 
 
-    GLuint textureShader = createShaderProgram("shaders/texture_vertex.glsl", "shaders/texture_fragment.glsl");
-    GLuint flatColorShader = createShaderProgram("shaders/flat_color_vertex.glsl", "shaders/flat_color_fragment.glsl");
-    GLuint gpuSlicerShader = createShaderProgram("shaders/gpu_slicer_vertex.glsl", "shaders/gpu_slicer_fragment.glsl");
-    GLuint vertexColorShader = createShaderProgram("shaders/mc_cpu_vert.glsl", "shaders/mc_cpu_frag.glsl");
-    GLuint mcGpuShader = createShaderProgram("shaders/mc_gpu_vert.glsl", "shaders/mc_gpu_geo.glsl", "shaders/mc_gpu_frag.glsl");
+    // Linked programs come from the binary cache unless a shader or the driver changed
+    std::unique_ptr<ShaderManager> shaders(new ShaderManager());
+    ShaderProgram* textureShader = shaders->load("texture", "shaders/texture_vertex.glsl", "shaders/texture_fragment.glsl");
+    ShaderProgram* flatColorShader = shaders->load("flat_color", "shaders/flat_color_vertex.glsl", "shaders/flat_color_fragment.glsl");
+    ShaderProgram* gpuSlicerShader = shaders->load("gpu_slicer", "shaders/gpu_slicer_vertex.glsl", "shaders/gpu_slicer_fragment.glsl");
+    ShaderProgram* vertexColorShader = shaders->load("mc_cpu", "shaders/mc_cpu_vert.glsl", "shaders/mc_cpu_frag.glsl");
+    ShaderProgram* mcGpuShader = shaders->load("mc_gpu", "shaders/mc_gpu_vert.glsl", "shaders/mc_gpu_geo.glsl", "shaders/mc_gpu_frag.glsl");
+    ShaderProgram* mcGpuMultiShader = shaders->load("mc_gpu_multi", "shaders/mc_gpu_vert.glsl", "shaders/mc_gpu_multi_geo.glsl", "shaders/mc_gpu_frag.glsl");
+    if (!textureShader || !flatColorShader || !gpuSlicerShader || !vertexColorShader || !mcGpuShader || !mcGpuMultiShader) {
+        glfwTerminate();
+        return -1;
+    }
+    const ShaderManager::Stats& shaderStats = shaders->getStats();
+    std::cout << "Shaders: " << shaderStats.fromCache << " from cache, " << shaderStats.compiled << " compiled in "
+              << shaderStats.seconds * 1000.0 << " ms" << std::endl;
+
+    // Uniform handles, resolved once per link
+    Uniform<glm::mat4> flatModel = flatColorShader->uniform<glm::mat4>("model");
+    Uniform<glm::vec3> flatColor = flatColorShader->uniform<glm::vec3>("ourColor");
+    Uniform<glm::mat4> textureModel = textureShader->uniform<glm::mat4>("model");
+    textureShader->setSampler("ourTexture", 0);
+    Uniform<glm::mat4> slicerModel = gpuSlicerShader->uniform<glm::mat4>("model");
+    Uniform<float> slicerValueScale = gpuSlicerShader->uniform<float>("valueScale");
+    Uniform<float> slicerMinScalar = gpuSlicerShader->uniform<float>("minScalar");
+    Uniform<float> slicerMaxScalar = gpuSlicerShader->uniform<float>("maxScalar");
+    Uniform<glm::vec3> slicerPlaneOrigin = gpuSlicerShader->uniform<glm::vec3>("planeOrigin");
+    Uniform<glm::vec3> slicerPlaneAxisU = gpuSlicerShader->uniform<glm::vec3>("planeAxisU");
+    Uniform<glm::vec3> slicerPlaneAxisV = gpuSlicerShader->uniform<glm::vec3>("planeAxisV");
+    gpuSlicerShader->setSampler("volumeTexture", 0);
+    gpuSlicerShader->setSampler("colormapTexture", 1);
+    Uniform<glm::mat4> vertexColorModel = vertexColorShader->uniform<glm::mat4>("model");
+    vertexColorShader->setSampler("colormapTexture", 0);
+    McGpuUniforms mcGpu(*mcGpuShader);
+    Uniform<float> mcGpuIsovalue = mcGpuShader->uniform<float>("isovalue");
+    McGpuUniforms mcGpuMulti(*mcGpuMultiShader);
+    Uniform<float> mcGpuMultiIsovalues = mcGpuMultiShader->uniform<float>("isovalues");
+    Uniform<int> mcGpuMultiNumIsovalues = mcGpuMultiShader->uniform<int>("numIsovalues");
 
     float box_vertices[] = {0,0,0, 1,0,0, 1,0,0, 1,1,0, 1,1,0, 0,1,0, 0,1,0, 0,0,0, 0,0,1, 1,0,1, 1,0,1, 1,1,1, 1,1,1, 0,1,1, 0,1,1, 0,0,1, 0,0,0, 0,0,1, 1,0,0, 1,0,1, 1,1,0, 1,1,1, 0,1,0, 0,1,1};
     GLuint boxVAO, boxVBO;
@@ -168,25 +927,13 @@ int main(int argc, char* argv[]) {
     glBufferData(GL_ARRAY_BUFFER, sizeof(axis_vertices), axis_vertices, GL_STATIC_DRAW);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0); glEnableVertexAttribArray(0);
 
-    // *** MODIFICATION 1: Replace single quad with three distinct quads ***
-    float quad_vertices_xy[] = {0,0,0, 0,0,  1,0,0, 1,0,  1,1,0, 1,1,  0,1,0, 0,1};
-    float quad_vertices_xz[] = {0,0,0, 0,0,  1,0,0, 1,0,  1,0,1, 1,1,  0,0,1, 0,1};
-    float quad_vertices_yz[] = {0,0,0, 0,0,  0,1,0, 1,0,  0,1,1, 1,1,  0,0,1, 0,1};
+    // Unit quad; each slice plane stretches it over its own sample lattice
+    float quad_vertices[] = {0,0,0, 0,0,  1,0,0, 1,0,  1,1,0, 1,1,  0,1,0, 0,1};
     unsigned int quad_indices[] = {0, 1, 2, 2, 3, 0};
-    GLuint quadVAO_xy, quadVBO_xy, quadVAO_xz, quadVBO_xz, quadVAO_yz, quadVBO_yz, quadEBO;
-    glGenVertexArrays(1, &quadVAO_xy); glGenBuffers(1, &quadVBO_xy);
-    glBindVertexArray(quadVAO_xy); glBindBuffer(GL_ARRAY_BUFFER, quadVBO_xy);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(quad_vertices_xy), quad_vertices_xy, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0); glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float))); glEnableVertexAttribArray(1);
-    glGenVertexArrays(1, &quadVAO_xz); glGenBuffers(1, &quadVBO_xz);
-    glBindVertexArray(quadVAO_xz); glBindBuffer(GL_ARRAY_BUFFER, quadVBO_xz);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(quad_vertices_xz), quad_vertices_xz, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0); glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float))); glEnableVertexAttribArray(1);
-    glGenVertexArrays(1, &quadVAO_yz); glGenBuffers(1, &quadVBO_yz);
-    glBindVertexArray(quadVAO_yz); glBindBuffer(GL_ARRAY_BUFFER, quadVBO_yz);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(quad_vertices_yz), quad_vertices_yz, GL_STATIC_DRAW);
+    GLuint quadVAO, quadVBO, quadEBO;
+    glGenVertexArrays(1, &quadVAO); glGenBuffers(1, &quadVBO);
+    glBindVertexArray(quadVAO); glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quad_vertices), quad_vertices, GL_STATIC_DRAW);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0); glEnableVertexAttribArray(0);
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float))); glEnableVertexAttribArray(1);
     glGenBuffers(1, &quadEBO);
@@ -195,10 +942,17 @@ int main(int argc, char* argv[]) {
     
     
     // --- CPU Slicing Resources ---
-    glGenTextures(1, &sliceTexture);
-    glBindTexture(GL_TEXTURE_2D, sliceTexture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    std::vector<unsigned char> textureData;
+    glGenTextures(3, sliceTextures);
+    for (int i = 0; i < 3; ++i) {
+        glBindTexture(GL_TEXTURE_2D, sliceTextures[i]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+    // Lattices of the planes on screen; the CPU images come from the slice worker
+    SliceEngine sliceEngine;
+    if (sparse) sliceEngine.setField(sparse, spacing, roi);
+    else sliceEngine.setField(field, spacing, roi);
+    std::shared_ptr<const SliceTexture> uploadedSlices[3]; // Content of sliceTextures
 
     // --- GPU Slicing Resources ---
     GLuint volumeTexture;
@@ -206,7 +960,19 @@ int main(int argc, char* argv[]) {
     glBindTexture(GL_TEXTURE_3D, volumeTexture);
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE); glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage3D(GL_TEXTURE_3D, 0, GL_R32F, dims.x, dims.y, dims.z, 0, GL_RED, GL_FLOAT, scalars.data());
+    float volumeValueScale = sparse ? uploadVolumeTexture(*sparse, roi) : uploadVolumeTexture(*field, roi);
+
+    // Colour field texture and its colormap range; texel fetches only, so no filtering
+    GLuint colorFieldTexture = 0;
+    float colorValueScale = 1.0f;
+    SurfaceColoring coloring = { colorField, 0.0f, 1.0f };
+    if (colorField) {
+        colorField->getRange(roi, coloring.minValue, coloring.maxValue);
+        glGenTextures(1, &colorFieldTexture);
+        glBindTexture(GL_TEXTURE_3D, colorFieldTexture);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST); glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        colorValueScale = uploadVolumeTexture(*colorField, roi);
+    }
     
     GLuint colormapTexture;
     glGenTextures(1, &colormapTexture);
@@ -217,13 +983,23 @@ int main(int argc, char* argv[]) {
     for(int i = 0; i < 256; ++i) colormap_data.push_back(getColor((float)i, 0.0f, 255.0f));
     glTexImage1D(GL_TEXTURE_1D, 0, GL_RGB, colormap_data.size(), 0, GL_RGB, GL_FLOAT, colormap_data.data());
 
+    // --- Gradient field (computed once, shared by CPU normals and the GPU extractor) ---
+    const GradientField::Precision gradientPrecision = GradientField::Float16;
+    GradientField gradients;
+    if (sparse) gradients.compute(*sparse, spacing, gradientPrecision);
+    else gradients.compute(*field, spacing, gradientPrecision);
+    GLuint gradientTexture;
+    glGenTextures(1, &gradientTexture);
+    glBindTexture(GL_TEXTURE_3D, gradientTexture);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE); glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    uploadGradientTexture(gradients, dims, roi);
+
     // --- Marching Cubes Setup ---
-    MarchingCubes mc;
     GLuint isoVAO, isoVBO;
     glGenVertexArrays(1, &isoVAO); glGenBuffers(1, &isoVBO);
     glBindVertexArray(isoVAO); glBindBuffer(GL_ARRAY_BUFFER, isoVBO);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, pos)); glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, color)); glEnableVertexAttribArray(1);
+    setupIsoVertexAttributes();
 
     // --- GPU MC setup ---
     GLuint edgeTableTexture, triTableTexture;
@@ -233,7 +1009,10 @@ int main(int argc, char* argv[]) {
     glGenTextures(1, &triTableTexture); glBindTexture(GL_TEXTURE_2D, triTableTexture);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST); glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_R32I, 16, 256, 0, GL_RED_INTEGER, GL_INT, &MarchingCubes::triTable[0][0]);
+    // IDs cover the whole grid; a draw uses the first roiCubes of them
     GLuint numCubes = (dims.x - 1) * (dims.y - 1) * (dims.z - 1);
+    glm::ivec3 roiCells = roi.dimensions() - glm::ivec3(1);
+    GLuint roiCubes = roiCells.x * roiCells.y * roiCells.z;
     std::vector<unsigned int> cubeIDs(numCubes);
     for (unsigned int i = 0; i < numCubes; ++i) cubeIDs[i] = i;
     GLuint mcGpuVAO, mcGpuVBO;
@@ -243,13 +1022,150 @@ int main(int argc, char* argv[]) {
     glEnableVertexAttribArray(0);
     glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, 0, (void*)0);
 
+    // --- Nested isosurface levels (evenly spaced, fixed) ---
+    std::vector<float> nestedIsovalues(numNestedLevels);
+    for (int i = 0; i < numNestedLevels; ++i) {
+        nestedIsovalues[i] = min_scalar + (i + 1) * (max_scalar - min_scalar) / (numNestedLevels + 1);
+    }
+    // CPU result, kept as a chain of LOD levels
+    const int numLodLevels = 4;
+    const float maxPixelError = 1.0f;
+    std::vector<LodLevel> nestedLods;
+    std::vector<GLint> lodFirst; // Offset of each level inside lodVBO
+    int activeLod = 0;
+    GLuint lodVAO, lodVBO;
+    glGenVertexArrays(1, &lodVAO); glGenBuffers(1, &lodVBO);
+    glBindVertexArray(lodVAO); glBindBuffer(GL_ARRAY_BUFFER, lodVBO);
+    setupIsoVertexAttributes();
+    GLsizei isoVertexCount = 0; // Animated CPU surface in isoVBO
+
+    // --- Background workers; each finished job wakes the render loop ---
+    std::function<void()> wakeRenderLoop = []() { glfwPostEmptyEvent(); };
+    SurfaceJob surfaceJob = { field, sparse, &gradients, spacing, dims, numLodLevels };
+    std::unique_ptr<ComputeWorker<SurfaceRequest, SurfaceResult>> surfaceWorker(
+        new ComputeWorker<SurfaceRequest, SurfaceResult>(surfaceJob, wakeRenderLoop));
+    MetricsJob metricsJob = { field, sparse, spacing };
+    std::unique_ptr<ComputeWorker<MetricsRequest, MetricsResult>> metricsWorker(
+        new ComputeWorker<MetricsRequest, MetricsResult>(metricsJob, wakeRenderLoop));
+    std::unique_ptr<ComputeWorker<SliceRequest, SliceResult>> sliceWorker(
+        new ComputeWorker<SliceRequest, SliceResult>(SliceJob(field, sparse, spacing), wakeRenderLoop));
+    int metricsSerial = 0;
+
+    // Takes over the newest finished surface: uploads it and records its statistics
+    auto acquireSurface = [&]() {
+        if (!surfaceWorker->acquire()) return;
+        SurfaceResult& result = surfaceWorker->front();
+        const SurfaceRequest& request = surfaceWorker->frontRequest();
+        if (result.filtered) {
+            lastComponentStats = result.componentStats;
+            haveComponentStats = true;
+            if (request.nested) {
+                // Reported here rather than on the worker, so it never interleaves with other output
+                for (size_t i = 0; i < lastComponentStats.size(); ++i) {
+                    std::cout << "Level " << i << ": kept " << lastComponentStats[i].keptComponents << " of "
+                              << lastComponentStats[i].components.size() << " components" << std::endl;
+                }
+            }
+        }
+        if (!request.nested) {
+            if (request.measure && printMetricsRequested) {
+                printSurfaceMetrics(request.isovalues, result.metrics);
+                printMetricsRequested = false;
+            }
+            glBindBuffer(GL_ARRAY_BUFFER, isoVBO);
+            glBufferData(GL_ARRAY_BUFFER, result.vertices.size() * sizeof(Vertex), result.vertices.data(), GL_DYNAMIC_DRAW);
+            isoVertexCount = (GLsizei)result.vertices.size();
+            return;
+        }
+        nestedLods.swap(result.lods);
+        // Upload every level once; the draw call picks a range per frame
+        std::vector<Vertex> allLevels;
+        lodFirst.clear();
+        for (size_t i = 0; i < nestedLods.size(); ++i) {
+            lodFirst.push_back((GLint)allLevels.size());
+            allLevels.insert(allLevels.end(), nestedLods[i].vertices.begin(), nestedLods[i].vertices.end());
+            std::cout << "LOD " << i << ": " << nestedLods[i].vertices.size() / 3 << " triangles" << std::endl;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, lodVBO);
+        glBufferData(GL_ARRAY_BUFFER, allLevels.size() * sizeof(Vertex), allLevels.data(), GL_STATIC_DRAW);
+    };
+
     // --- Main Loop ---
     glEnable(GL_DEPTH_TEST);
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
     double lastTime = glfwGetTime();
     int frameCount = 0;
+    int appliedRoiVersion = roiVersion;
+    double lastFrameTime = glfwGetTime();
+    // Recording and replay run the animation on a simulated clock of one step per frame
+    bool simulatedClock = replaying || sessionRecording;
+    size_t nextEvent = 0;
+    FrameTimeStats replayTimes;
+    glm::vec3 recordedPose(camera.getYaw(), camera.getPitch(), camera.getZoom());
+    if (sessionRecording) session.addCameraPose(0, recordedPose.x, recordedPose.y, recordedPose.z);
 
     while (!glfwWindowShouldClose(window)) {
+        if (replaying) {
+            if (sessionFrame >= replayFrames) break;
+            const std::vector<SessionEvent>& events = session.getEvents();
+            for (; nextEvent < events.size() && events[nextEvent].frame == sessionFrame; ++nextEvent) {
+                const SessionEvent& event = events[nextEvent];
+                if (event.kind == SessionEvent::CameraPose) {
+                    camera.setOrientation(event.yaw, event.pitch);
+                    camera.setZoom(event.zoom);
+                } else {
+                    keyCallback(window, event.key, 0, GLFW_PRESS, 0);
+                }
+            }
+        } else if (!animate && !surfaceWorker->busy() && !sliceWorker->busy() && !metricsWorker->busy()) {
+            // Render on demand: while paused with no job in flight, sleep until
+            // input arrives or a worker finishes
+#ifdef SHADER_HOT_RELOAD
+            glfwWaitEventsTimeout(1.0); // Wake now and then to look for edited shaders
+#else
+            glfwWaitEvents();
+#endif
+        }
+        if (sessionRecording) {
+            glm::vec3 pose(camera.getYaw(), camera.getPitch(), camera.getZoom());
+            if (pose != recordedPose) session.addCameraPose(sessionFrame, pose.x, pose.y, pose.z);
+            recordedPose = pose;
+        }
+        std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+        std::string frameMode = viewModeName();
+        double frameTime = glfwGetTime();
+        if (animate) animationTime += simulatedClock ? session.getFrameStep() : frameTime - lastFrameTime;
+        lastFrameTime = frameTime;
+        // Take over whatever the workers finished, whichever view is active
+        acquireSurface();
+        sliceWorker->acquire();
+        if (metricsWorker->acquire()) {
+            printSurfaceMetrics(metricsWorker->frontRequest().isovalues, metricsWorker->front().metrics);
+        }
+
+        if (appliedRoiVersion != roiVersion) {
+            // Only the ROI lives on the GPU, so every texture is re-uploaded
+            glBindTexture(GL_TEXTURE_3D, volumeTexture);
+            volumeValueScale = sparse ? uploadVolumeTexture(*sparse, roi) : uploadVolumeTexture(*field, roi);
+            glBindTexture(GL_TEXTURE_3D, gradientTexture);
+            uploadGradientTexture(gradients, dims, roi);
+            if (colorField) {
+                colorField->getRange(roi, coloring.minValue, coloring.maxValue);
+                glBindTexture(GL_TEXTURE_3D, colorFieldTexture);
+                colorValueScale = uploadVolumeTexture(*colorField, roi);
+            }
+            if (sparse) sparse->getRange(roi, min_scalar, max_scalar);
+            else field->getRange(roi, min_scalar, max_scalar);
+            for (int i = 0; i < numNestedLevels; ++i) {
+                nestedIsovalues[i] = min_scalar + (i + 1) * (max_scalar - min_scalar) / (numNestedLevels + 1);
+            }
+            if (sparse) sliceEngine.setField(sparse, spacing, roi);
+            else sliceEngine.setField(field, spacing, roi);
+            roiCells = roi.dimensions() - glm::ivec3(1);
+            roiCubes = roiCells.x * roiCells.y * roiCells.z;
+            appliedRoiVersion = roiVersion;
+        }
+
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -259,93 +1175,213 @@ int main(int argc, char* argv[]) {
         glm::mat4 view = camera.getViewMatrix();
         glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)width / (float)height, 0.1f, 2000.0f);
         glm::mat4 model = glm::translate(glm::mat4(1.0f), -size / 2.0f) * glm::scale(glm::mat4(1.0f), size);
-        
-        glUseProgram(flatColorShader);
-        glm::mat4 box_mvp = projection * view * model;
-        glUniformMatrix4fv(glGetUniformLocation(flatColorShader, "mvp"), 1, GL_FALSE, glm::value_ptr(box_mvp));
-        glUniform3f(glGetUniformLocation(flatColorShader, "ourColor"), 1.0f, 1.0f, 1.0f);
+        // Camera matrices go to every program through the frame uniform buffer; draws set only their model
+        FrameUniforms frame = { projection * view, view };
+        shaders->updateFrame(frame);
+
+        flatColorShader->use();
+        flatModel.set(model);
+        flatColor.set(glm::vec3(1.0f, 1.0f, 1.0f));
         glBindVertexArray(boxVAO);
         glDrawArrays(GL_LINES, 0, 24);
+        if (roi != GridExtent::whole(dims)) {
+            glm::mat4 roi_model = glm::translate(glm::mat4(1.0f), -size / 2.0f + glm::vec3(roi.first) * spacing) *
+                                  glm::scale(glm::mat4(1.0f), glm::vec3(roi.last - roi.first) * spacing);
+            flatModel.set(roi_model);
+            flatColor.set(glm::vec3(1.0f, 1.0f, 0.0f));
+            glDrawArrays(GL_LINES, 0, 24);
+        }
         glBindVertexArray(axisVAO_g);
-        glm::mat4 axis_model = glm::scale(model, glm::vec3(1.1f));
-        glUniformMatrix4fv(glGetUniformLocation(flatColorShader, "mvp"), 1, GL_FALSE, glm::value_ptr(projection * view * axis_model));
-        glUniform3f(glGetUniformLocation(flatColorShader, "ourColor"), 1.0f, 0.0f, 0.0f); glDrawArrays(GL_LINES, 0, 2);
-        glUniform3f(glGetUniformLocation(flatColorShader, "ourColor"), 0.0f, 1.0f, 0.0f); glDrawArrays(GL_LINES, 2, 2);
-        glUniform3f(glGetUniformLocation(flatColorShader, "ourColor"), 0.0f, 0.0f, 1.0f); glDrawArrays(GL_LINES, 4, 2);
-
-	    if (showIsosurface) {
-            float isovalue_norm = (sin(glfwGetTime() * 0.5f) * 0.5f + 0.5f);
+        flatModel.set(glm::scale(model, glm::vec3(1.1f)));
+        flatColor.set(glm::vec3(1.0f, 0.0f, 0.0f)); glDrawArrays(GL_LINES, 0, 2);
+        flatColor.set(glm::vec3(0.0f, 1.0f, 0.0f)); glDrawArrays(GL_LINES, 2, 2);
+        flatColor.set(glm::vec3(0.0f, 0.0f, 1.0f)); glDrawArrays(GL_LINES, 4, 2);
+
+	    if (showIsosurface && showNestedSurfaces) {
+            if (printMetricsRequested) {
+                MetricsRequest request = { nestedIsovalues, roi, ++metricsSerial };
+                metricsWorker->post(request);
+                if (replaying) metricsWorker->wait(); // Printed at the top of the next frame
+                printMetricsRequested = false;
+            }
+            if (useGpuMarchingCubes) {
+                mcGpuMultiShader->use();
+                glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_3D, volumeTexture);
+                glActiveTexture(GL_TEXTURE1); glBindTexture(GL_TEXTURE_1D, edgeTableTexture);
+                glActiveTexture(GL_TEXTURE2); glBindTexture(GL_TEXTURE_2D, triTableTexture);
+                glActiveTexture(GL_TEXTURE3); glBindTexture(GL_TEXTURE_3D, gradientTexture);
+                glActiveTexture(GL_TEXTURE4); glBindTexture(GL_TEXTURE_1D, colormapTexture);
+                glActiveTexture(GL_TEXTURE5); glBindTexture(GL_TEXTURE_3D, colorFieldTexture);
+                mcGpuMulti.model.set(model);
+                mcGpuMulti.valueScale.set(volumeValueScale);
+                mcGpuMulti.useColorField.set(colorBySecondField);
+                mcGpuMulti.colorValueScale.set(colorValueScale);
+                mcGpuMulti.colorMin.set(coloring.minValue);
+                mcGpuMulti.colorMax.set(coloring.maxValue);
+                mcGpuMultiIsovalues.set(nestedIsovalues.data(), numNestedLevels);
+                mcGpuMultiNumIsovalues.set(numNestedLevels);
+                mcGpuMulti.dataDimensions.set(dims);
+                mcGpuMulti.roiOrigin.set(roi.first);
+                mcGpuMulti.totalCubes.set(roiCubes);
+                glBindVertexArray(mcGpuVAO);
+                glDrawArrays(GL_POINTS, 0, roiCubes);
+            } else {
+                // Extracted once per set of levels on the surface worker
+                SurfaceRequest request = { true, nestedIsovalues, roi, colorBySecondField, coloring, false };
+                surfaceWorker->post(request);
+                if (replaying) {
+                    // Replays draw this frame's levels, so the extraction counts in the frame time
+                    surfaceWorker->wait();
+                    acquireSurface();
+                }
+                float voxelSize = std::max(spacing.x, std::max(spacing.y, spacing.z));
+                int level = MeshSimplifier::selectLevel(nestedLods, voxelSize, camera.getZoom(), glm::radians(45.0f), height, maxPixelError);
+                if (level >= 0 && !nestedLods[level].vertices.empty()) {
+                    if (level != activeLod) {
+                        std::cout << "Switched to LOD " << level << std::endl;
+                        activeLod = level;
+                    }
+                    glBindVertexArray(lodVAO);
+                    vertexColorShader->use();
+                    vertexColorModel.set(model);
+                    glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_1D, colormapTexture);
+                    glDrawArrays(GL_TRIANGLES, lodFirst[level], nestedLods[level].vertices.size());
+                }
+            }
+	    } else if (showIsosurface) {
+            float isovalue_norm = sweepPosition(animationTime);
             float isovalue = min_scalar + isovalue_norm * (max_scalar - min_scalar);
+            if (printMetricsRequested && useGpuMarchingCubes) {
+                MetricsRequest request = { std::vector<float>(1, isovalue), roi, ++metricsSerial };
+                metricsWorker->post(request);
+                if (replaying) metricsWorker->wait(); // Printed at the top of the next frame
+                printMetricsRequested = false;
+            }
             if (useGpuMarchingCubes) {
-                glUseProgram(mcGpuShader);
+                mcGpuShader->use();
                 glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_3D, volumeTexture);
                 glActiveTexture(GL_TEXTURE1); glBindTexture(GL_TEXTURE_1D, edgeTableTexture);
                 glActiveTexture(GL_TEXTURE2); glBindTexture(GL_TEXTURE_2D, triTableTexture);
-                glUniformMatrix4fv(glGetUniformLocation(mcGpuShader, "mvp"), 1, GL_FALSE, glm::value_ptr(box_mvp));
-                glUniform1i(glGetUniformLocation(mcGpuShader, "volumeTexture"), 0);
-                glUniform1i(glGetUniformLocation(mcGpuShader, "edgeTable"), 1);
-                glUniform1i(glGetUniformLocation(mcGpuShader, "triTable"), 2);
-                glUniform1f(glGetUniformLocation(mcGpuShader, "isovalue"), isovalue);
-                glUniform3iv(glGetUniformLocation(mcGpuShader, "dataDimensions"), 1, glm::value_ptr(dims));
-                glUniform1ui(glGetUniformLocation(mcGpuShader, "totalCubes"), numCubes);
+                glActiveTexture(GL_TEXTURE3); glBindTexture(GL_TEXTURE_3D, gradientTexture);
+                glActiveTexture(GL_TEXTURE4); glBindTexture(GL_TEXTURE_1D, colormapTexture);
+                glActiveTexture(GL_TEXTURE5); glBindTexture(GL_TEXTURE_3D, colorFieldTexture);
+                mcGpu.model.set(model);
+                mcGpu.valueScale.set(volumeValueScale);
+                mcGpu.useColorField.set(colorBySecondField);
+                mcGpu.colorValueScale.set(colorValueScale);
+                mcGpu.colorMin.set(coloring.minValue);
+                mcGpu.colorMax.set(coloring.maxValue);
+                mcGpuIsovalue.set(isovalue);
+                mcGpu.dataDimensions.set(dims);
+                mcGpu.roiOrigin.set(roi.first);
+                mcGpu.totalCubes.set(roiCubes);
                 glBindVertexArray(mcGpuVAO);
-                glDrawArrays(GL_POINTS, 0, numCubes);
+                glDrawArrays(GL_POINTS, 0, roiCubes);
             } else {
-                std::vector<Vertex> iso_vertices = mc.generateSurface(scalars, dims, isovalue);
-                if (!iso_vertices.empty()) {
+                // Extraction runs on the surface worker; draw its newest finished mesh
+                SurfaceRequest request = { false, std::vector<float>(1, isovalue), roi, colorBySecondField, coloring, printMetricsRequested };
+                surfaceWorker->post(request);
+                if (replaying) {
+                    surfaceWorker->wait();
+                    acquireSurface();
+                }
+                if (isoVertexCount > 0) {
                     glBindVertexArray(isoVAO);
-                    glBindBuffer(GL_ARRAY_BUFFER, isoVBO);
-                    glBufferData(GL_ARRAY_BUFFER, iso_vertices.size() * sizeof(Vertex), iso_vertices.data(), GL_DYNAMIC_DRAW);
-                    glUseProgram(vertexColorShader);
-                    glUniformMatrix4fv(glGetUniformLocation(vertexColorShader, "mvp"), 1, GL_FALSE, glm::value_ptr(box_mvp));
-                    glDrawArrays(GL_TRIANGLES, 0, iso_vertices.size());
+                    vertexColorShader->use();
+                    vertexColorModel.set(model);
+                    glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_1D, colormapTexture);
+                    glDrawArrays(GL_TRIANGLES, 0, isoVertexCount);
                 }
             }
     	} else {
-                       float slice_norm = (sin(glfwGetTime() * 0.5f) * 0.5f + 0.5f);
-            glm::mat4 slice_mvp;
-            
-            glm::mat4 slice_translation_model = glm::mat4(1.0f);
-            switch(slicingAxis){
-                case 0: slice_translation_model = glm::translate(slice_translation_model, glm::vec3(-size.x/2.0f, -size.y/2.0f, -size.z/2.0f + slice_norm * size.z)); break;
-                case 1: slice_translation_model = glm::translate(slice_translation_model, glm::vec3(-size.x/2.0f, -size.y/2.0f + slice_norm * size.y, -size.z/2.0f)); break;
-                case 2: slice_translation_model = glm::translate(slice_translation_model, glm::vec3(-size.x/2.0f + slice_norm * size.x, -size.y/2.0f, -size.z/2.0f)); break;
+            float slice_norm = sweepPosition(animationTime);
+
+            // Planes drawn this frame, in world units relative to grid point 0; all stay inside the ROI
+            std::vector<SlicePlane> planes;
+            if (sliceMode == 0) {
+                int axis = 2 - slicingAxis; // slicingAxis counts Z, Y, X
+                glm::vec3 normal(0.0f);
+                normal[axis] = 1.0f;
+                planes.push_back(SlicePlane(normal, (roi.first[axis] + slice_norm * (roi.last[axis] - roi.first[axis])) * spacing[axis]));
+            } else if (sliceMode == 1) {
+                glm::vec3 normal = obliqueNormal();
+                float minOffset, maxOffset;
+                sliceEngine.offsetRange(normal, minOffset, maxOffset);
+                planes.push_back(SlicePlane(normal, minOffset + slice_norm * (maxOffset - minOffset)));
+            } else {
+                // Fixed planes through the ROI centre, so the CPU slicer samples them only once
+                glm::vec3 centre = 0.5f * glm::vec3(roi.first + roi.last) * spacing;
+                for (int axis = 0; axis < 3; ++axis) {
+                    glm::vec3 normal(0.0f);
+                    normal[axis] = 1.0f;
+                    planes.push_back(SlicePlane(normal, centre[axis]));
+                }
             }
-            glm::mat4 slice_scale = glm::scale(glm::mat4(1.0f), size);
-            slice_mvp = projection * view * slice_translation_model * slice_scale;
 
+            // Lattice of every plane to draw; the CPU path draws the newest finished slices
+            std::vector<SliceImage> gpuLayouts;
+            std::vector<const SliceImage*> layouts;
             if (useGpuSlicing) {
-                glUseProgram(gpuSlicerShader);
-                glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_3D, volumeTexture);
-                glActiveTexture(GL_TEXTURE1); glBindTexture(GL_TEXTURE_1D, colormapTexture);
-                glUniform1i(glGetUniformLocation(gpuSlicerShader, "volumeTexture"), 0);
-                glUniform1i(glGetUniformLocation(gpuSlicerShader, "colormapTexture"), 1);
-                glUniform1f(glGetUniformLocation(gpuSlicerShader, "minScalar"), min_scalar);
-                glUniform1f(glGetUniformLocation(gpuSlicerShader, "maxScalar"), max_scalar);
-                glUniform1f(glGetUniformLocation(gpuSlicerShader, "sliceNorm"), slice_norm);
-                glUniform1i(glGetUniformLocation(gpuSlicerShader, "slicingAxis"), slicingAxis);
-                glUniformMatrix4fv(glGetUniformLocation(gpuSlicerShader, "mvp"), 1, GL_FALSE, glm::value_ptr(slice_mvp));
+                gpuLayouts.resize(planes.size());
+                for (size_t p = 0; p < planes.size(); ++p) {
+                    sliceEngine.layout(planes[p], gpuLayouts[p]);
+                    layouts.push_back(&gpuLayouts[p]);
+                }
             } else {
-                int texWidth, texHeight;
-                               switch(slicingAxis){
-                    case 0: texWidth = dims.x; texHeight = dims.y; textureData.resize(texWidth * texHeight * 3); for(int y=0;y<texHeight;++y)for(int x=0;x<texWidth;++x){ float v = parser.getValue(scalars,glm::vec3(x,y,slice_norm*(dims.z-1.f))); glm::vec3 c=getColor(v,min_scalar,max_scalar); int i=(y*texWidth+x)*3; textureData[i]=c.r*255; textureData[i+1]=c.g*255; textureData[i+2]=c.b*255; } break;
-                    case 1: texWidth = dims.x; texHeight = dims.z; textureData.resize(texWidth * texHeight * 3); for(int z=0;z<texHeight;++z)for(int x=0;x<texWidth;++x){ float v = parser.getValue(scalars,glm::vec3(x,slice_norm*(dims.y-1.f),z)); glm::vec3 c=getColor(v,min_scalar,max_scalar); int i=(z*texWidth+x)*3; textureData[i]=c.r*255; textureData[i+1]=c.g*255; textureData[i+2]=c.b*255; } break;
-                    case 2: texWidth = dims.y; texHeight = dims.z; textureData.resize(texWidth * texHeight * 3); for(int z=0;z<texHeight;++z)for(int y=0;y<texWidth;++y){ float v = parser.getValue(scalars,glm::vec3(slice_norm*(dims.x-1.f),y,z)); glm::vec3 c=getColor(v,min_scalar,max_scalar); int i=(z*texWidth+y)*3; textureData[i]=c.r*255; textureData[i+1]=c.g*255; textureData[i+2]=c.b*255; } break;
+                SliceRequest request = { planes, roi, min_scalar, max_scalar };
+                sliceWorker->post(request);
+                if (replaying) {
+                    sliceWorker->wait();
+                    sliceWorker->acquire();
+                }
+                if (sliceWorker->hasResult()) {
+                    const std::vector<std::shared_ptr<const SliceTexture>>& slices = sliceWorker->front().slices;
+                    for (size_t p = 0; p < slices.size() && p < 3; ++p) {
+                        if (uploadedSlices[p] != slices[p]) {
+                            const SliceTexture& slice = *slices[p];
+                            glBindTexture(GL_TEXTURE_2D, sliceTextures[p]);
+                            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, slice.layout.width, slice.layout.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, slice.rgba.data());
+                            uploadedSlices[p] = slices[p];
+                        }
+                        layouts.push_back(&slices[p]->layout);
+                    }
                 }
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, sliceTexture);
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, texWidth, texHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, textureData.data());
-                glUseProgram(textureShader);
-                glUniform1i(glGetUniformLocation(textureShader, "ourTexture"), 0);
-                glUniformMatrix4fv(glGetUniformLocation(textureShader, "mvp"), 1, GL_FALSE, glm::value_ptr(slice_mvp));
             }
-                        switch(slicingAxis) {
-                case 0: glBindVertexArray(quadVAO_xy); break;
-                case 1: glBindVertexArray(quadVAO_xz); break;
-                case 2: glBindVertexArray(quadVAO_yz); break;
+
+            for (size_t p = 0; p < layouts.size(); ++p) {
+                const SliceImage* image = layouts[p];
+
+                // The unit quad stretched over the plane's sample lattice
+                glm::vec3 edgeU = image->axisU * (image->stepU * (image->width - 1));
+                glm::vec3 edgeV = image->axisV * (image->stepV * (image->height - 1));
+                glm::mat4 plane_model(1.0f);
+                plane_model[0] = glm::vec4(edgeU, 0.0f);
+                plane_model[1] = glm::vec4(edgeV, 0.0f);
+                plane_model[2] = glm::vec4(glm::cross(image->axisU, image->axisV), 0.0f);
+                plane_model[3] = glm::vec4(image->corner, 1.0f);
+                glm::mat4 slice_model = glm::translate(glm::mat4(1.0f), -size / 2.0f) * plane_model;
+
+                if (useGpuSlicing) {
+                    gpuSlicerShader->use();
+                    glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_3D, volumeTexture);
+                    glActiveTexture(GL_TEXTURE1); glBindTexture(GL_TEXTURE_1D, colormapTexture);
+                    slicerValueScale.set(volumeValueScale);
+                    slicerMinScalar.set(min_scalar);
+                    slicerMaxScalar.set(max_scalar);
+                    // Grid coordinates relative to the ROI, which is what the texture holds
+                    slicerPlaneOrigin.set(image->corner / spacing - glm::vec3(roi.first));
+                    slicerPlaneAxisU.set(edgeU / spacing);
+                    slicerPlaneAxisV.set(edgeV / spacing);
+                    slicerModel.set(slice_model);
+                } else {
+                    glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_2D, sliceTextures[p]);
+                    textureShader->use();
+                    textureModel.set(slice_model);
+                }
+                glBindVertexArray(quadVAO);
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadEBO);
+                glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
             }
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadEBO);
-            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
     	}
 
         double currentTime = glfwGetTime();
@@ -357,28 +1393,55 @@ int main(int argc, char* argv[]) {
             } else {
                 ss << "Field Visualizer | " << (useGpuSlicing ? "GPU" : "CPU") << " | FPS: " << frameCount;
             }
+            // Average worker utilization over the last second
+            ThreadPool& pool = ThreadPool::instance();
+            std::vector<WorkerStats> poolStats = pool.getStats();
+            if (!poolStats.empty()) {
+                double busy = 0.0;
+                for (size_t i = 0; i < poolStats.size(); ++i) busy += poolStats[i].busySeconds;
+                ss << " | Pool: " << (int)(100.0 * busy / (poolStats.size() * pool.getStatsWindowSeconds())) << "%";
+                pool.resetStats();
+            }
             glfwSetWindowTitle(window, ss.str().c_str());
+#ifdef SHADER_HOT_RELOAD
+            shaders->reloadChanged();
+#endif
             frameCount = 0;								
             lastTime = currentTime;
         }
 
         glfwSwapBuffers(window);
+        if (replaying) {
+            // Include the GL work of this frame, which the driver may still be queueing
+            glFinish();
+            replayTimes.add(frameMode, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
+        }
+        ++sessionFrame; // Input polled now applies to the next frame
         glfwPollEvents();
     }
+    if (replaying) {
+        std::cout << "Replayed " << sessionFrame << " frames of " << replayPath << std::endl;
+        replayTimes.print(std::cout);
+    }
+    if (sessionRecording) {
+        session.setFrameCount(sessionFrame);
+        if (session.save(recordPath)) std::cout << "Recorded " << sessionFrame << " frames to " << recordPath << std::endl;
+    }
     
     // --- Cleanup ---
+    // Workers first: a finishing job still posts an event to GLFW
+    surfaceWorker.reset(); metricsWorker.reset(); sliceWorker.reset();
        glDeleteVertexArrays(1, &boxVAO); glDeleteBuffers(1, &boxVBO);
     glDeleteVertexArrays(1, &axisVAO_g); glDeleteBuffers(1, &axisVBO_g);
-    glDeleteVertexArrays(1, &quadVAO_xy); glDeleteBuffers(1, &quadVBO_xy);
-    glDeleteVertexArrays(1, &quadVAO_xz); glDeleteBuffers(1, &quadVBO_xz);
-    glDeleteVertexArrays(1, &quadVAO_yz); glDeleteBuffers(1, &quadVBO_yz);
+    glDeleteVertexArrays(1, &quadVAO); glDeleteBuffers(1, &quadVBO);
     glDeleteBuffers(1, &quadEBO);
     glDeleteVertexArrays(1, &isoVAO); glDeleteBuffers(1, &isoVBO);
     glDeleteVertexArrays(1, &mcGpuVAO); glDeleteBuffers(1, &mcGpuVBO);
-    glDeleteProgram(textureShader); glDeleteProgram(flatColorShader); glDeleteProgram(gpuSlicerShader);
-    glDeleteProgram(vertexColorShader); glDeleteProgram(mcGpuShader);
-    glDeleteTextures(1, &sliceTexture); glDeleteTextures(1, &volumeTexture); glDeleteTextures(1, &colormapTexture);
-    glDeleteTextures(1, &edgeTableTexture); glDeleteTextures(1, &triTableTexture);
+    glDeleteVertexArrays(1, &lodVAO); glDeleteBuffers(1, &lodVBO);
+    shaders.reset();
+    glDeleteTextures(3, sliceTextures); glDeleteTextures(1, &volumeTexture); glDeleteTextures(1, &colormapTexture);
+    glDeleteTextures(1, &edgeTableTexture); glDeleteTextures(1, &triTableTexture); glDeleteTextures(1, &gradientTexture);
+    glDeleteTextures(1, &colorFieldTexture); // 0 without a colour field, which GL ignores
     
     glfwTerminate();
     return 0;
@@ -1,4 +1,8 @@
 #include "marching_cubes.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
 const int MarchingCubes::edgeTable[256] = {
     0x0, 0x109, 0x203, 0x30a, 0x406, 0x50f, 0x605, 0x70c, 0x80c, 0x905, 0xa0f, 0xb06, 0xc0a, 0xd03, 0xe09, 0xf00, 
     0x190, 0x99, 0x393, 0x29a, 0x596, 0x49f, 0x795, 0x69c, 0x99c, 0x895, 0xb9f, 0xa96, 0xd9a, 0xc93, 0xf99, 0xe90, 
@@ -281,87 +285,641 @@ const int MarchingCubes::triTable[256][16] =
 // This is a standard, well-documented part of the algorithm.
 
 
-glm::vec3 MarchingCubes::vertexInterp(float isovalue, glm::vec3 p1, glm::vec3 p2, float val1, float val2) {
-    if (std::abs(isovalue - val1) < 0.00001f) return p1;
-    if (std::abs(isovalue - val2) < 0.00001f) return p2;
-    if (std::abs(val1 - val2) < 0.00001f) return p1;
+glm::vec3 MarchingCubes::vertexInterp(float isovalue, glm::vec3 p1, glm::vec3 p2, float val1, float val2, float& mu) {
+    if (std::abs(isovalue - val1) < 0.00001f) { mu = 0.0f; return p1; }
+    if (std::abs(isovalue - val2) < 0.00001f) { mu = 1.0f; return p2; }
+    if (std::abs(val1 - val2) < 0.00001f) { mu = 0.0f; return p1; }
     
-    float mu = (isovalue - val1) / (val2 - val1);
+    mu = (isovalue - val1) / (val2 - val1);
     return p1 + mu * (p2 - p1);
 }
 
-std::vector<Vertex> MarchingCubes::generateSurface(const std::vector<float>& scalars, glm::ivec3 dims, float isovalue) {
-    std::vector<Vertex> vertices;
-    long long totalCubes = (long long)(dims.x - 1) * (dims.y - 1) * (dims.z - 1);
-    long long currentCube = 0;
-
-    // Iterate through each conceptual cube in the volume
-    for (int z = 0; z < dims.z - 1; ++z) {
-        for (int y = 0; y < dims.y - 1; ++y) {
-            for (int x = 0; x < dims.x - 1; ++x) {
-                currentCube++;
-
-                // Get the 8 corner positions and scalar values
-                glm::vec3 cornerPos[8];
-                float cornerVal[8];
-                int cubeindex = 0;
-
-                for (int i = 0; i < 8; ++i) {		
-                    int dx = (i == 1 || i == 2 || i == 5 || i == 6);
-                    int dy = (i == 2 || i == 3 || i == 6 || i == 7);
-                    int dz = (i == 4 || i == 5 || i == 6 || i == 7);
-                    
-                    cornerPos[i] = glm::vec3(x + dx, y + dy, z + dz);
-                    long long index = (z + dz) * dims.x * dims.y + (y + dy) * dims.x + (x + dx);
-                    cornerVal[i] = scalars[index];
-
-                    if (cornerVal[i] < isovalue) {
-                        cubeindex |= (1 << i);
+namespace {
+
+// The two corners joined by each of the 12 cube edges, lower corner first, so
+// neighbouring cells interpolate a shared edge identically (bit-exact vertices)
+const int edgeCorners[12][2] = {
+    {0, 1}, {1, 2}, {3, 2}, {0, 3}, {4, 5}, {5, 6}, {7, 6}, {4, 7}, {0, 4}, {1, 5}, {2, 6}, {3, 7}
+};
+
+} // namespace
+
+MarchingCubes::MarchingCubes() : spacing(1.0f), extent() {}
+
+struct MarchingCubes::MetricsSums {
+    size_t triangles;
+    double area;
+    double xFlux;          // Surface integral of x * n.x, the divergence-theorem volume term
+    glm::dvec3 weightedSum; // Sum of triangle centroid * area
+
+    MetricsSums() : triangles(0), area(0.0), xFlux(0.0), weightedSum(0.0) {}
+
+    void addTriangle(const glm::dvec3& a, const glm::dvec3& b, const glm::dvec3& c) {
+        glm::dvec3 n = glm::cross(b - a, c - a) * 0.5; // Area-weighted normal
+        double triangleArea = glm::length(n);
+        glm::dvec3 centroid = (a + b + c) / 3.0;
+        ++triangles;
+        area += triangleArea;
+        xFlux += centroid.x * n.x;
+        weightedSum += centroid * triangleArea;
+    }
+
+    void merge(const MetricsSums& other) {
+        triangles += other.triangles;
+        area += other.area;
+        xFlux += other.xFlux;
+        weightedSum += other.weightedSum;
+    }
+};
+
+void MarchingCubes::polygoniseCell(const glm::vec3 cornerPos[8], const float cornerVal[8], int cubeindex, float isovalue,
+                                   const float* cornerColor, float colorScalar, const glm::vec3& dims_f,
+                                   const GradientField* gradients, std::vector<Vertex>* vertices, MetricsSums* metrics) {
+    // Find the vertices where the surface intersects the cube's edges
+    glm::vec3 vertlist[12];
+    float mulist[12];
+    for (int e = 0; e < 12; ++e) {
+        if (edgeTable[cubeindex] & (1 << e)) {
+            int a = edgeCorners[e][0], b = edgeCorners[e][1];
+            vertlist[e] = vertexInterp(isovalue, cornerPos[a], cornerPos[b], cornerVal[a], cornerVal[b], mulist[e]);
+        }
+    }
+
+    if (metrics) {
+        // Measured on the unquantized grid positions, scaled to world units
+        glm::dvec3 scale(spacing);
+        for (int i = 0; triTable[cubeindex][i] != -1; i += 3) {
+            metrics->addTriangle(glm::dvec3(vertlist[triTable[cubeindex][i]]) * scale,
+                                 glm::dvec3(vertlist[triTable[cubeindex][i+1]]) * scale,
+                                 glm::dvec3(vertlist[triTable[cubeindex][i+2]]) * scale);
+        }
+    }
+    if (!vertices) return;
+
+    // Create the triangles
+    for (int i = 0; triTable[cubeindex][i] != -1; i += 3) {
+        Vertex v1, v2, v3;
+
+        // Normalize the grid-space positions to [0,1] unit space
+        glm::vec3 p1 = vertlist[triTable[cubeindex][i]] / dims_f;
+        glm::vec3 p2 = vertlist[triTable[cubeindex][i+1]] / dims_f;
+        glm::vec3 p3 = vertlist[triTable[cubeindex][i+2]] / dims_f;
+        v1.setPosition(p1);
+        v2.setPosition(p2);
+        v3.setPosition(p3);
+
+        if (cornerColor) {
+            // The colour field follows the position along each edge
+            Vertex* v[3] = { &v1, &v2, &v3 };
+            for (int k = 0; k < 3; ++k) {
+                int e = triTable[cubeindex][i + k];
+                float c1 = cornerColor[edgeCorners[e][0]], c2 = cornerColor[edgeCorners[e][1]];
+                v[k]->setScalar(c1 + mulist[e] * (c2 - c1));
+            }
+        } else {
+            v1.setScalar(colorScalar);
+            v2.scalar = v3.scalar = v1.scalar;
+        }
+
+        if (gradients) {
+            v1.setNormal(gradients->normalAt(vertlist[triTable[cubeindex][i]]));
+            v2.setNormal(gradients->normalAt(vertlist[triTable[cubeindex][i+1]]));
+            v3.setNormal(gradients->normalAt(vertlist[triTable[cubeindex][i+2]]));
+        } else {
+            v1.setNormal(glm::cross(p2 - p1, p3 - p1));
+            v2.normal[0] = v3.normal[0] = v1.normal[0];
+            v2.normal[1] = v3.normal[1] = v1.normal[1];
+        }
+
+        vertices->push_back(v1);
+        vertices->push_back(v2);
+        vertices->push_back(v3);
+    }
+}
+
+namespace {
+
+// Concatenates per-slab results in slab order, so output matches a serial sweep
+std::vector<Vertex> concatenate(std::vector<std::vector<Vertex>>& parts) {
+    size_t total = 0;
+    for (size_t i = 0; i < parts.size(); ++i) total += parts[i].size();
+    std::vector<Vertex> out;
+    out.reserve(total);
+    for (size_t i = 0; i < parts.size(); ++i) {
+        out.insert(out.end(), parts[i].begin(), parts[i].end());
+        std::vector<Vertex>().swap(parts[i]);
+    }
+    return out;
+}
+
+// Reads the colour field at a cell's corners as colormap coordinates
+struct CornerColors {
+    ScalarField::Reader read;
+    const void* values;
+    float minValue;
+    float invRange;
+
+    explicit CornerColors(const SurfaceColoring* coloring)
+        : read(coloring ? coloring->field->reader() : nullptr),
+          values(coloring ? coloring->field->data() : nullptr),
+          minValue(coloring ? coloring->minValue : 0.0f), invRange(1.0f) {
+        if (coloring && coloring->maxValue > coloring->minValue) invRange = 1.0f / (coloring->maxValue - coloring->minValue);
+    }
+
+    // Returns `out`, or nullptr when there is no colour field
+    const float* load(const long long cornerIndex[8], float out[8]) const {
+        if (!read) return nullptr;
+        for (int i = 0; i < 8; ++i) out[i] = (read(values, (size_t)cornerIndex[i]) - minValue) * invRange;
+        return out;
+    }
+};
+
+// A colouring is only usable if its field lies on the same grid
+const SurfaceColoring* checkColoring(const glm::ivec3& dims, const SurfaceColoring* coloring) {
+    if (!coloring) return nullptr;
+    if (!coloring->field || coloring->field->empty() || coloring->field->getDimensions() != dims) {
+        std::cerr << "Warning: colour field does not match the extracted field's grid; ignoring it." << std::endl;
+        return nullptr;
+    }
+    return coloring;
+}
+
+} // namespace
+
+struct MarchingCubes::SurfaceKernel {
+    MarchingCubes& mc;
+    glm::ivec3 dims;
+    GridExtent ext; // Region of interest, at least two points per axis
+    float isovalue;
+    const GradientField* gradients;
+    const CornerColors& colors;
+    std::vector<std::vector<Vertex>>* slabVertices; // Per z-slab; null when only measuring
+    std::vector<MetricsSums>* slabMetrics;          // Per z-slab; null when not measuring
+
+    template <typename T> void operator()(const T* scalars) {
+        glm::ivec3 cells = ext.dimensions() - glm::ivec3(1);
+        long long totalCubes = (long long)cells.x * cells.y * cells.z;
+        glm::vec3 dims_f = glm::vec3(dims.x - 1, dims.y - 1, dims.z - 1);
+
+        // Each z-slab of cubes is an independent task on the shared pool
+        ThreadPool::instance().parallelFor(cells.z, 1, [&](size_t zBegin, size_t zEnd) {
+            for (int slab = (int)zBegin; slab < (int)zEnd; ++slab) {
+                int z = ext.first.z + slab;
+                std::vector<Vertex>* vertices = slabVertices ? &(*slabVertices)[slab] : nullptr;
+                MetricsSums* metrics = slabMetrics ? &(*slabMetrics)[slab] : nullptr;
+                for (int y = ext.first.y; y < ext.last.y; ++y) {
+                    for (int x = ext.first.x; x < ext.last.x; ++x) {
+                        long long currentCube = ((long long)slab * cells.y + (y - ext.first.y)) * cells.x + (x - ext.first.x) + 1;
+
+                        // Get the 8 corner positions and scalar values
+                        glm::vec3 cornerPos[8];
+                        float cornerVal[8];
+                        long long cornerIndex[8];
+                        int cubeindex = 0;
+
+                        for (int i = 0; i < 8; ++i) {
+                            int dx = (i == 1 || i == 2 || i == 5 || i == 6);
+                            int dy = (i == 2 || i == 3 || i == 6 || i == 7);
+                            int dz = (i == 4 || i == 5 || i == 6 || i == 7);
+
+                            cornerPos[i] = glm::vec3(x + dx, y + dy, z + dz);
+                            long long index = (long long)(z + dz) * dims.x * dims.y + (y + dy) * dims.x + (x + dx);
+                            cornerIndex[i] = index;
+                            cornerVal[i] = (float)scalars[index];
+
+                            if (cornerVal[i] < isovalue) {
+                                cubeindex |= (1 << i);
+                            }
+                        }
+
+                        // If the cube is entirely inside or outside, there's no surface to generate
+                        if (edgeTable[cubeindex] == 0) continue;
+
+                        float progress = (float)currentCube / (float)totalCubes;
+                        float colorBuffer[8];
+                        const float* cornerColor = vertices ? colors.load(cornerIndex, colorBuffer) : nullptr;
+                        mc.polygoniseCell(cornerPos, cornerVal, cubeindex, isovalue, cornerColor, progress, dims_f, gradients, vertices, metrics);
+                    }
+                }
+            }
+        });
+    }
+};
+
+struct MarchingCubes::MultiSurfaceKernel {
+    MarchingCubes& mc;
+    glm::ivec3 dims;
+    GridExtent ext;
+    const std::vector<float>& isovalues;
+    const GradientField* gradients;
+    const CornerColors& colors;
+    // [level][z]; either may be null
+    std::vector<std::vector<std::vector<Vertex>>>* slabSurfaces;
+    std::vector<std::vector<MetricsSums>>* slabMetrics;
+
+    template <typename T> void operator()(const T* scalars) {
+        glm::ivec3 cells = ext.dimensions() - glm::ivec3(1);
+        long long totalCubes = (long long)cells.x * cells.y * cells.z;
+        glm::vec3 dims_f = glm::vec3(dims.x - 1, dims.y - 1, dims.z - 1);
+
+        ThreadPool::instance().parallelFor(cells.z, 1, [&](size_t zBegin, size_t zEnd) {
+            for (int slab = (int)zBegin; slab < (int)zEnd; ++slab) {
+                int z = ext.first.z + slab;
+                for (int y = ext.first.y; y < ext.last.y; ++y) {
+                    for (int x = ext.first.x; x < ext.last.x; ++x) {
+                        long long currentCube = ((long long)slab * cells.y + (y - ext.first.y)) * cells.x + (x - ext.first.x) + 1;
+
+                        // Read the 8 corners once; every level is classified against these
+                        glm::vec3 cornerPos[8];
+                        float cornerVal[8];
+                        long long cornerIndex[8];
+                        float cellMin = 0.0f, cellMax = 0.0f;
+
+                        for (int i = 0; i < 8; ++i) {
+                            int dx = (i == 1 || i == 2 || i == 5 || i == 6);
+                            int dy = (i == 2 || i == 3 || i == 6 || i == 7);
+                            int dz = (i == 4 || i == 5 || i == 6 || i == 7);
+
+                            cornerPos[i] = glm::vec3(x + dx, y + dy, z + dz);
+                            long long index = (long long)(z + dz) * dims.x * dims.y + (y + dy) * dims.x + (x + dx);
+                            cornerIndex[i] = index;
+                            cornerVal[i] = (float)scalars[index];
+
+                            if (i == 0 || cornerVal[i] < cellMin) cellMin = cornerVal[i];
+                            if (i == 0 || cornerVal[i] > cellMax) cellMax = cornerVal[i];
+                        }
+
+                        // A level crosses this cell only if cellMin < isovalue <= cellMax, so
+                        // with sorted isovalues the candidate levels are one contiguous run.
+                        size_t first = std::upper_bound(isovalues.begin(), isovalues.end(), cellMin) - isovalues.begin();
+                        size_t last = std::upper_bound(isovalues.begin(), isovalues.end(), cellMax) - isovalues.begin();
+                        if (first >= last) continue;
+
+                        float progress = (float)currentCube / (float)totalCubes;
+                        float colorBuffer[8];
+                        const float* cornerColor = slabSurfaces ? colors.load(cornerIndex, colorBuffer) : nullptr;
+
+                        for (size_t level = first; level < last; ++level) {
+                            float isovalue = isovalues[level];
+                            int cubeindex = 0;
+                            for (int i = 0; i < 8; ++i) {
+                                if (cornerVal[i] < isovalue) cubeindex |= (1 << i);
+                            }
+                            if (edgeTable[cubeindex] == 0) continue;
+                            mc.polygoniseCell(cornerPos, cornerVal, cubeindex, isovalue, cornerColor, progress, dims_f, gradients,
+                                              slabSurfaces ? &(*slabSurfaces)[level][slab] : nullptr,
+                                              slabMetrics ? &(*slabMetrics)[level][slab] : nullptr);
+                        }
+                    }
+                }
+            }
+        });
+    }
+};
+
+// Closes the isosurface with the extraction box for the volume term. With the
+// divergence theorem on F = (x, 0, 0) only the two x faces of the box
+// contribute, weighted by the area of their part with values >= isovalue
+// (marching squares with the same linear edge crossings as the cells).
+struct MarchingCubes::BoundaryFaceKernel {
+    glm::ivec3 dims;
+    GridExtent ext;
+    int x; // The face measured
+    const std::vector<float>& isovalues;
+    std::vector<double>& insideArea; // Per level, in squares of the y/z grid
+
+    template <typename T> void operator()(const T* scalars) {
+        ThreadPool::instance().parallelFor(isovalues.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t level = begin; level < end; ++level) {
+                float isovalue = isovalues[level];
+                double area = 0.0;
+                for (int z = ext.first.z; z < ext.last.z; ++z) {
+                    for (int y = ext.first.y; y < ext.last.y; ++y) {
+                        // Square corners in perimeter order
+                        const int cy[4] = { y, y + 1, y + 1, y };
+                        const int cz[4] = { z, z, z + 1, z + 1 };
+                        float v[4];
+                        int inside = 0;
+                        for (int i = 0; i < 4; ++i) {
+                            v[i] = (float)scalars[((long long)cz[i] * dims.y + cy[i]) * dims.x + x];
+                            if (!(v[i] < isovalue)) ++inside;
+                        }
+                        if (inside == 0) continue;
+                        if (inside == 4) { area += 1.0; continue; }
+
+                        // Walk the perimeter keeping inside corners and edge crossings
+                        double py[8], pz[8];
+                        int n = 0;
+                        for (int i = 0; i < 4; ++i) {
+                            int j = (i + 1) % 4;
+                            bool inI = !(v[i] < isovalue), inJ = !(v[j] < isovalue);
+                            if (inI) { py[n] = cy[i]; pz[n] = cz[i]; ++n; }
+                            if (inI != inJ) {
+                                double t = (isovalue - v[i]) / (double)(v[j] - v[i]);
+                                py[n] = cy[i] + t * (cy[j] - cy[i]);
+                                pz[n] = cz[i] + t * (cz[j] - cz[i]);
+                                ++n;
+                            }
+                        }
+                        double twiceArea = 0.0;
+                        for (int i = 0; i < n; ++i) {
+                            int j = (i + 1) % n;
+                            twiceArea += py[i] * pz[j] - py[j] * pz[i];
+                        }
+                        area += std::abs(twiceArea) * 0.5;
                     }
                 }
+                insideArea[level] = area;
+            }
+        });
+    }
+};
+
+namespace {
+
+SurfaceMetrics emptyMetrics() {
+    SurfaceMetrics metrics = { 0, 0.0, 0.0, glm::dvec3(0.0) };
+    return metrics;
+}
+
+} // namespace
+
+void MarchingCubes::measureBoxFaces(const ScalarField& field, const std::vector<float>& isovalues,
+                                    std::vector<double>& farArea, std::vector<double>& nearArea) const {
+    glm::ivec3 dims = field.getDimensions();
+    GridExtent ext = extent.resolve(dims);
+    BoundaryFaceKernel farFace = { dims, ext, ext.last.x, isovalues, farArea };
+    field.visit(farFace);
+    if (ext.first.x > 0) {
+        BoundaryFaceKernel nearFace = { dims, ext, ext.first.x, isovalues, nearArea };
+        field.visit(nearFace);
+    }
+}
+
+void MarchingCubes::measureBoxFaces(const SparseField& field, const std::vector<float>& isovalues,
+                                    std::vector<double>& farArea, std::vector<double>& nearArea) const {
+    // Each face is copied out as a one-voxel-thick field and measured like a dense one
+    GridExtent ext = extent.resolve(field.getDimensions());
+    glm::ivec3 faceDims(1, ext.dimensions().y, ext.dimensions().z);
+    GridExtent faceExtent(glm::ivec3(0), faceDims - glm::ivec3(1));
+    ScalarField face(VoxelFloat32, faceDims);
+    for (int side = 0; side < 2; ++side) {
+        int x = side == 0 ? ext.last.x : ext.first.x;
+        if (side == 1 && x == 0) break;
+        field.readBlock(GridExtent(glm::ivec3(x, ext.first.y, ext.first.z), glm::ivec3(x, ext.last.y, ext.last.z)),
+                        face.values<float>());
+        BoundaryFaceKernel kernel = { faceDims, faceExtent, 0, isovalues, side == 0 ? farArea : nearArea };
+        face.visit(kernel);
+    }
+}
+
+template <typename Field>
+void MarchingCubes::finishMetrics(const Field& field, const std::vector<float>& isovalues,
+                                  const std::vector<std::vector<MetricsSums>>& slabMetrics,
+                                  std::vector<SurfaceMetrics>& metrics) const {
+    GridExtent ext = extent.resolve(field.getDimensions());
+    // Outward flux through the far face minus the inward flux through the near
+    // one; the near face adds nothing when it is the grid's x = 0 plane
+    std::vector<double> farArea(isovalues.size(), 0.0), nearArea(isovalues.size(), 0.0);
+    measureBoxFaces(field, isovalues, farArea, nearArea);
+
+    metrics.assign(isovalues.size(), emptyMetrics());
+    for (size_t level = 0; level < isovalues.size(); ++level) {
+        // Slabs are merged in order, so the sums do not depend on scheduling
+        MetricsSums sums;
+        for (size_t z = 0; z < slabMetrics[level].size(); ++z) sums.merge(slabMetrics[level][z]);
+        SurfaceMetrics& m = metrics[level];
+        m.triangleCount = sums.triangles;
+        m.area = sums.area;
+        // The triangle winding faces out of the region >= isovalue (towards
+        // lower values), so xFlux is already the region's outward flux
+        // through the surface and adds to the box faces' term
+        double faceArea = (double)spacing.y * spacing.z;
+        double boundary = (double)ext.last.x * farArea[level] - (double)ext.first.x * nearArea[level];
+        m.volume = boundary * spacing.x * faceArea + sums.xFlux;
+        m.centroid = sums.area > 0.0 ? sums.weightedSum / sums.area : glm::dvec3(0.0);
+    }
+}
+
+void MarchingCubes::extractSingle(const ScalarField& field, float isovalue, const GradientField* gradients,
+                                  const SurfaceColoring* coloring, std::vector<Vertex>* vertices,
+                                  SurfaceMetrics* metrics) {
+    glm::ivec3 dims = field.getDimensions();
+    GridExtent ext = extent.resolve(dims);
+    if (vertices) vertices->clear();
+    if (metrics) *metrics = emptyMetrics();
+    if (glm::any(glm::lessThan(ext.dimensions(), glm::ivec3(2)))) return;
+
+    int slabs = ext.dimensions().z - 1;
+    std::vector<std::vector<Vertex>> slabVertices(vertices ? slabs : 0);
+    std::vector<std::vector<MetricsSums>> slabMetrics(1, std::vector<MetricsSums>(metrics ? slabs : 0));
+    CornerColors colors(vertices ? checkColoring(dims, coloring) : nullptr);
+    SurfaceKernel kernel = { *this, dims, ext, isovalue, gradients, colors,
+                             vertices ? &slabVertices : nullptr, metrics ? &slabMetrics[0] : nullptr };
+    field.visit(kernel);
+
+    if (vertices) *vertices = concatenate(slabVertices);
+    if (metrics) {
+        std::vector<SurfaceMetrics> levels;
+        finishMetrics(field, std::vector<float>(1, isovalue), slabMetrics, levels);
+        *metrics = levels[0];
+    }
+}
+
+void MarchingCubes::extractMulti(const ScalarField& field, const std::vector<float>& isovalues,
+                                 const GradientField* gradients, const SurfaceColoring* coloring,
+                                 std::vector<std::vector<Vertex>>* surfaces, std::vector<SurfaceMetrics>* metrics) {
+    glm::ivec3 dims = field.getDimensions();
+    GridExtent ext = extent.resolve(dims);
+    if (surfaces) surfaces->assign(isovalues.size(), std::vector<Vertex>());
+    if (metrics) metrics->assign(isovalues.size(), emptyMetrics());
+    if (isovalues.empty() || glm::any(glm::lessThan(ext.dimensions(), glm::ivec3(2)))) return;
+
+    int slabs = ext.dimensions().z - 1;
+    std::vector<std::vector<std::vector<Vertex>>> slabSurfaces(surfaces ? isovalues.size() : 0,
+                                                               std::vector<std::vector<Vertex>>(slabs));
+    std::vector<std::vector<MetricsSums>> slabMetrics(metrics ? isovalues.size() : 0,
+                                                      std::vector<MetricsSums>(slabs));
+    CornerColors colors(surfaces ? checkColoring(dims, coloring) : nullptr);
+    MultiSurfaceKernel kernel = { *this, dims, ext, isovalues, gradients, colors,
+                                  surfaces ? &slabSurfaces : nullptr, metrics ? &slabMetrics : nullptr };
+    field.visit(kernel);
+
+    if (surfaces) {
+        for (size_t level = 0; level < isovalues.size(); ++level) {
+            (*surfaces)[level] = concatenate(slabSurfaces[level]);
+        }
+    }
+    if (metrics) finishMetrics(field, isovalues, slabMetrics, *metrics);
+}
 
-                // If the cube is entirely inside or outside, there's no surface to generate
-                if (edgeTable[cubeindex] == 0) continue;
-
-                // Find the vertices where the surface intersects the cube's edges
-                glm::vec3 vertlist[12];
-                if (edgeTable[cubeindex] & 1)    vertlist[0] = vertexInterp(isovalue, cornerPos[0], cornerPos[1], cornerVal[0], cornerVal[1]);
-                if (edgeTable[cubeindex] & 2)    vertlist[1] = vertexInterp(isovalue, cornerPos[1], cornerPos[2], cornerVal[1], cornerVal[2]);
-                if (edgeTable[cubeindex] & 4)    vertlist[2] = vertexInterp(isovalue, cornerPos[2], cornerPos[3], cornerVal[2], cornerVal[3]);
-                if (edgeTable[cubeindex] & 8)    vertlist[3] = vertexInterp(isovalue, cornerPos[3], cornerPos[0], cornerVal[3], cornerVal[0]);
-                if (edgeTable[cubeindex] & 16)   vertlist[4] = vertexInterp(isovalue, cornerPos[4], cornerPos[5], cornerVal[4], cornerVal[5]);
-                if (edgeTable[cubeindex] & 32)   vertlist[5] = vertexInterp(isovalue, cornerPos[5], cornerPos[6], cornerVal[5], cornerVal[6]);
-                if (edgeTable[cubeindex] & 64)   vertlist[6] = vertexInterp(isovalue, cornerPos[6], cornerPos[7], cornerVal[6], cornerVal[7]);
-                if (edgeTable[cubeindex] & 128)  vertlist[7] = vertexInterp(isovalue, cornerPos[7], cornerPos[4], cornerVal[7], cornerVal[4]);
-                if (edgeTable[cubeindex] & 256)  vertlist[8] = vertexInterp(isovalue, cornerPos[0], cornerPos[4], cornerVal[0], cornerVal[4]);
-                if (edgeTable[cubeindex] & 512)  vertlist[9] = vertexInterp(isovalue, cornerPos[1], cornerPos[5], cornerVal[1], cornerVal[5]);
-                if (edgeTable[cubeindex] & 1024) vertlist[10] = vertexInterp(isovalue, cornerPos[2], cornerPos[6], cornerVal[2], cornerVal[6]);
-                if (edgeTable[cubeindex] & 2048) vertlist[11] = vertexInterp(isovalue, cornerPos[3], cornerPos[7], cornerVal[3], cornerVal[7]);
-
-                // Create the triangles
-                 float progress = (float)currentCube / (float)totalCubes;
-                glm::vec3 color = glm::vec3(progress, 1.0f - progress, 0.0f);
-
-               
-                glm::vec3 dims_f = glm::vec3(dims.x - 1, dims.y - 1, dims.z - 1);
-
-                for (int i = 0; triTable[cubeindex][i] != -1; i += 3) {
-                    Vertex v1, v2, v3;
-
-                    
-                    // Normalize the grid-space positions to [0,1] unit space
-                    v1.pos = vertlist[triTable[cubeindex][i]] / dims_f;
-                    v2.pos = vertlist[triTable[cubeindex][i+1]] / dims_f;
-                    v3.pos = vertlist[triTable[cubeindex][i+2]] / dims_f;
-                    
-                    v1.color = v2.color = v3.color = color;
-                    
-                    vertices.push_back(v1);
-                    vertices.push_back(v2);
-                    vertices.push_back(v3);
+std::vector<Vertex> MarchingCubes::generateSurface(const ScalarField& field, float isovalue,
+                                                   const GradientField* gradients,
+                                                   const SurfaceColoring* coloring) {
+    std::vector<Vertex> vertices;
+    extractSingle(field, isovalue, gradients, coloring, &vertices, nullptr);
+    return vertices;
+}
+
+void MarchingCubes::extractSparse(const SparseField& field, const std::vector<float>& isovalues,
+                                  const GradientField* gradients, const SurfaceColoring* coloring,
+                                  std::vector<std::vector<Vertex>>* surfaces, std::vector<SurfaceMetrics>* metrics) {
+    glm::ivec3 dims = field.getDimensions();
+    GridExtent ext = extent.resolve(dims);
+    if (surfaces) surfaces->assign(isovalues.size(), std::vector<Vertex>());
+    if (metrics) metrics->assign(isovalues.size(), emptyMetrics());
+    if (isovalues.empty() || field.empty() || glm::any(glm::lessThan(ext.dimensions(), glm::ivec3(2)))) return;
+
+    glm::ivec3 cells = ext.dimensions() - glm::ivec3(1);
+    long long totalCubes = (long long)cells.x * cells.y * cells.z;
+    glm::vec3 dims_f = glm::vec3(dims.x - 1, dims.y - 1, dims.z - 1);
+    CornerColors colors(surfaces ? checkColoring(dims, coloring) : nullptr);
+
+    // One block per tile holding first corners of cells in the extent
+    const int S = SparseField::TILE_SIZE;
+    glm::ivec3 tileFirst = ext.first / S;
+    glm::ivec3 tiles = (ext.last - glm::ivec3(1)) / S - tileFirst + glm::ivec3(1);
+    size_t blockCount = (size_t)tiles.x * tiles.y * tiles.z;
+    // [level][block]; blocks stand in for slabs and are merged in block order
+    std::vector<std::vector<std::vector<Vertex>>> blockSurfaces(surfaces ? isovalues.size() : 0,
+                                                                std::vector<std::vector<Vertex>>(blockCount));
+    std::vector<std::vector<MetricsSums>> blockMetrics(metrics ? isovalues.size() : 0,
+                                                       std::vector<MetricsSums>(blockCount));
+
+    ThreadPool::instance().parallelFor(blockCount, 1, [&](size_t begin, size_t end) {
+        float values[(S + 1) * (S + 1) * (S + 1)];
+        for (size_t b = begin; b < end; ++b) {
+            glm::ivec3 tile = tileFirst + glm::ivec3((int)(b % tiles.x), (int)((b / tiles.x) % tiles.y),
+                                                     (int)(b / ((size_t)tiles.x * tiles.y)));
+            // Only levels with lo < isovalue <= hi can cross a cell of the block;
+            // with sorted isovalues they are one contiguous run
+            float lo, hi;
+            field.getCellBlockRange(tile, lo, hi);
+            size_t levelFirst = std::upper_bound(isovalues.begin(), isovalues.end(), lo) - isovalues.begin();
+            size_t levelLast = std::upper_bound(isovalues.begin(), isovalues.end(), hi) - isovalues.begin();
+            if (levelFirst >= levelLast) continue;
+
+            // Cells of the block, and the points at their corners
+            glm::ivec3 cellFirst = glm::max(tile * S, ext.first);
+            glm::ivec3 cellLast = glm::min(tile * S + glm::ivec3(S - 1), ext.last - glm::ivec3(1));
+            glm::ivec3 size = cellLast - cellFirst + glm::ivec3(2);
+            field.readBlock(GridExtent(cellFirst, cellLast + glm::ivec3(1)), values);
+
+            for (int z = cellFirst.z; z <= cellLast.z; ++z) {
+                for (int y = cellFirst.y; y <= cellLast.y; ++y) {
+                    for (int x = cellFirst.x; x <= cellLast.x; ++x) {
+                        long long currentCube = ((long long)(z - ext.first.z) * cells.y + (y - ext.first.y)) * cells.x + (x - ext.first.x) + 1;
+
+                        glm::vec3 cornerPos[8];
+                        float cornerVal[8];
+                        long long cornerIndex[8];
+
+                        for (int i = 0; i < 8; ++i) {
+                            int dx = (i == 1 || i == 2 || i == 5 || i == 6);
+                            int dy = (i == 2 || i == 3 || i == 6 || i == 7);
+                            int dz = (i == 4 || i == 5 || i == 6 || i == 7);
+
+                            cornerPos[i] = glm::vec3(x + dx, y + dy, z + dz);
+                            cornerIndex[i] = (long long)(z + dz) * dims.x * dims.y + (y + dy) * dims.x + (x + dx);
+                            cornerVal[i] = values[((z + dz - cellFirst.z) * size.y + (y + dy - cellFirst.y)) * size.x + (x + dx - cellFirst.x)];
+                        }
+
+                        float progress = (float)currentCube / (float)totalCubes;
+                        float colorBuffer[8];
+                        const float* cornerColor = nullptr;
+                        bool colorsLoaded = false;
+
+                        for (size_t level = levelFirst; level < levelLast; ++level) {
+                            float isovalue = isovalues[level];
+                            int cubeindex = 0;
+                            for (int i = 0; i < 8; ++i) {
+                                if (cornerVal[i] < isovalue) cubeindex |= (1 << i);
+                            }
+                            if (edgeTable[cubeindex] == 0) continue;
+                            if (surfaces && !colorsLoaded) {
+                                cornerColor = colors.load(cornerIndex, colorBuffer);
+                                colorsLoaded = true;
+                            }
+                            polygoniseCell(cornerPos, cornerVal, cubeindex, isovalue, cornerColor, progress, dims_f, gradients,
+                                           surfaces ? &blockSurfaces[level][b] : nullptr,
+                                           metrics ? &blockMetrics[level][b] : nullptr);
+                        }
+                    }
                 }
             }
         }
+    });
+
+    if (surfaces) {
+        for (size_t level = 0; level < isovalues.size(); ++level) {
+            (*surfaces)[level] = concatenate(blockSurfaces[level]);
+        }
     }
+    if (metrics) finishMetrics(field, isovalues, blockMetrics, *metrics);
+}
+
+std::vector<Vertex> MarchingCubes::generateSurface(const SparseField& field, float isovalue,
+                                                   const GradientField* gradients,
+                                                   const SurfaceColoring* coloring) {
+    std::vector<std::vector<Vertex>> surfaces;
+    extractSparse(field, std::vector<float>(1, isovalue), gradients, coloring, &surfaces, nullptr);
+    return surfaces[0];
+}
+
+std::vector<Vertex> MarchingCubes::generateSurface(const SparseField& field, float isovalue,
+                                                   const GradientField* gradients,
+                                                   const SurfaceColoring* coloring, SurfaceMetrics& metrics) {
+    std::vector<std::vector<Vertex>> surfaces;
+    std::vector<SurfaceMetrics> levels;
+    extractSparse(field, std::vector<float>(1, isovalue), gradients, coloring, &surfaces, &levels);
+    metrics = levels[0];
+    return surfaces[0];
+}
+
+std::vector<std::vector<Vertex>> MarchingCubes::generateSurfaces(const SparseField& field,
+                                                                 const std::vector<float>& isovalues,
+                                                                 const GradientField* gradients,
+                                                                 const SurfaceColoring* coloring) {
+    std::vector<std::vector<Vertex>> surfaces;
+    extractSparse(field, isovalues, gradients, coloring, &surfaces, nullptr);
+    return surfaces;
+}
+
+std::vector<Vertex> MarchingCubes::generateSurface(const ScalarField& field, float isovalue,
+                                                   const GradientField* gradients,
+                                                   const SurfaceColoring* coloring, SurfaceMetrics& metrics) {
+    std::vector<Vertex> vertices;
+    extractSingle(field, isovalue, gradients, coloring, &vertices, &metrics);
     return vertices;
 }
+
+std::vector<std::vector<Vertex>> MarchingCubes::generateSurfaces(const ScalarField& field,
+                                                                 const std::vector<float>& isovalues,
+                                                                 const GradientField* gradients,
+                                                                 const SurfaceColoring* coloring) {
+    std::vector<std::vector<Vertex>> surfaces;
+    extractMulti(field, isovalues, gradients, coloring, &surfaces, nullptr);
+    return surfaces;
+}
+
+std::vector<std::vector<Vertex>> MarchingCubes::generateSurfaces(const ScalarField& field,
+                                                                 const std::vector<float>& isovalues,
+                                                                 const GradientField* gradients,
+                                                                 const SurfaceColoring* coloring,
+                                                                 std::vector<SurfaceMetrics>& metrics) {
+    std::vector<std::vector<Vertex>> surfaces;
+    extractMulti(field, isovalues, gradients, coloring, &surfaces, &metrics);
+    return surfaces;
+}
+
+std::vector<SurfaceMetrics> MarchingCubes::measureSurfaces(const ScalarField& field, const std::vector<float>& isovalues) {
+    std::vector<SurfaceMetrics> metrics;
+    extractMulti(field, isovalues, nullptr, nullptr, nullptr, &metrics);
+    return metrics;
+}
+
+std::vector<SurfaceMetrics> MarchingCubes::measureSurfaces(const SparseField& field, const std::vector<float>& isovalues) {
+    std::vector<SurfaceMetrics> metrics;
+    extractSparse(field, isovalues, nullptr, nullptr, nullptr, &metrics);
+    return metrics;
+}
@@ -2,30 +2,197 @@
 #define MARCHING_CUBES_H
 
 #include <vector>
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
 #include <glm/glm.hpp>
+#include "gradient_field.h"
+#include "scalar_field.h"
+#include "sparse_field.h"
 
-// A struct to hold a single vertex's data (position and color)
+// A compact 12-byte isosurface vertex. The position is quantized to 16-bit
+// unsigned normalized [0,1] unit space, the colour is a single colormap
+// coordinate and the normal is octahedrally packed into two snorm16 values.
 struct Vertex {
-    glm::vec3 pos;
-    glm::vec3 color;
+    uint16_t pos[3];
+    uint16_t scalar;
+    int16_t normal[2];
+
+    void setPosition(const glm::vec3& p);
+    glm::vec3 getPosition() const;
+    void setScalar(float s);
+    float getScalar() const;
+    void setNormal(const glm::vec3& n);
+    glm::vec3 getNormal() const;
+};
+
+inline uint16_t packUnorm16(float v) {
+    return (uint16_t)std::floor(glm::clamp(v, 0.0f, 1.0f) * 65535.0f + 0.5f);
+}
+
+inline int16_t packSnorm16(float v) {
+    return (int16_t)std::floor(glm::clamp(v, -1.0f, 1.0f) * 32767.0f + 0.5f);
+}
+
+inline void Vertex::setPosition(const glm::vec3& p) {
+    pos[0] = packUnorm16(p.x); pos[1] = packUnorm16(p.y); pos[2] = packUnorm16(p.z);
+}
+
+inline glm::vec3 Vertex::getPosition() const {
+    return glm::vec3(pos[0], pos[1], pos[2]) / 65535.0f;
+}
+
+inline void Vertex::setScalar(float s) { scalar = packUnorm16(s); }
+inline float Vertex::getScalar() const { return scalar / 65535.0f; }
+
+// Octahedral encoding: project onto |x|+|y|+|z| = 1 and fold the lower half over
+inline void Vertex::setNormal(const glm::vec3& n) {
+    float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (l1 <= 0.0f) { normal[0] = 0; normal[1] = 0; return; }
+    float x = n.x / l1, y = n.y / l1;
+    if (n.z < 0.0f) {
+        float fx = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float fy = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = fx; y = fy;
+    }
+    normal[0] = packSnorm16(x);
+    normal[1] = packSnorm16(y);
+}
+
+inline glm::vec3 Vertex::getNormal() const {
+    float x = std::max(normal[0] / 32767.0f, -1.0f), y = std::max(normal[1] / 32767.0f, -1.0f);
+    glm::vec3 n(x, y, 1.0f - std::abs(x) - std::abs(y));
+    if (n.z < 0.0f) {
+        n.x = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        n.y = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return glm::normalize(n);
+}
+
+// Colours an isosurface by a second field on the same grid. The field is
+// interpolated at each edge crossing with the weight that places the vertex,
+// then mapped from [minValue, maxValue] to the colormap coordinate.
+struct SurfaceColoring {
+    const ScalarField* field;
+    float minValue;
+    float maxValue;
+};
+
+// Quantitative description of one isosurface, in world units (see setSpacing)
+struct SurfaceMetrics {
+    size_t triangleCount;
+    double area;
+    // Volume of the region with values >= isovalue inside the grid. The
+    // surface is closed with the grid boundary, so clipped surfaces work too.
+    double volume;
+    // Area-weighted centroid of the surface, relative to the grid origin
+    glm::dvec3 centroid;
 };
 
 class MarchingCubes {
 public:
+    MarchingCubes();
 
 	// The two essential lookup tables for the algorithm
     static const int edgeTable[256];
     static const int triTable[256][16];
-    	// Main function to generate the isosurface mesh
-    std::vector<Vertex> generateSurface(const std::vector<float>& scalars, 
-                                        glm::ivec3 dims, 
-                                        float isovalue);
+    	// Main function to generate the isosurface mesh. With `gradients` the
+    	// normals are sampled from the cached gradient field, otherwise they are
+    	// the flat face normals. Without `coloring` the colour follows the cell
+    	// visit order.
+    std::vector<Vertex> generateSurface(const ScalarField& field,
+                                        float isovalue,
+                                        const GradientField* gradients = nullptr,
+                                        const SurfaceColoring* coloring = nullptr);
+
+    // The same surface from a tiled field: each block of cells is first
+    // checked against the tile ranges, so runs of background are skipped
+    // without reading them. Triangles come out grouped by tile.
+    std::vector<Vertex> generateSurface(const SparseField& field,
+                                        float isovalue,
+                                        const GradientField* gradients = nullptr,
+                                        const SurfaceColoring* coloring = nullptr);
+    // ... with the fused metrics, and one mesh per isovalue (sorted ascending)
+    std::vector<Vertex> generateSurface(const SparseField& field, float isovalue, const GradientField* gradients,
+                                        const SurfaceColoring* coloring, SurfaceMetrics& metrics);
+    std::vector<std::vector<Vertex>> generateSurfaces(const SparseField& field,
+                                                      const std::vector<float>& isovalues,
+                                                      const GradientField* gradients = nullptr,
+                                                      const SurfaceColoring* coloring = nullptr);
+
+    // Extracts one mesh per isovalue in a single traversal of the volume.
+    // `isovalues` must be sorted ascending; each cell's corners are read once
+    // and classified against every level it straddles.
+    std::vector<std::vector<Vertex>> generateSurfaces(const ScalarField& field,
+                                                      const std::vector<float>& isovalues,
+                                                      const GradientField* gradients = nullptr,
+                                                      const SurfaceColoring* coloring = nullptr);
+
+    // Fused metrics: the overloads below also accumulate SurfaceMetrics while
+    // the triangles are emitted, from per-slab partial sums.
+    std::vector<Vertex> generateSurface(const ScalarField& field, float isovalue, const GradientField* gradients,
+                                        const SurfaceColoring* coloring, SurfaceMetrics& metrics);
+    std::vector<std::vector<Vertex>> generateSurfaces(const ScalarField& field, const std::vector<float>& isovalues,
+                                                      const GradientField* gradients, const SurfaceColoring* coloring,
+                                                      std::vector<SurfaceMetrics>& metrics);
+
+    // Metrics-only sweep: classifies the volume against every isovalue (sorted
+    // ascending) in one traversal without storing any geometry
+    std::vector<SurfaceMetrics> measureSurfaces(const ScalarField& field, const std::vector<float>& isovalues);
+    std::vector<SurfaceMetrics> measureSurfaces(const SparseField& field, const std::vector<float>& isovalues);
+
+    // Size of one voxel, used to report metrics in world units (default 1,1,1)
+    void setSpacing(const glm::vec3& spacing) { this->spacing = spacing; }
+
+    // Restricts every extraction to the cells inside `extent` (a region of
+    // interest); surfaces end at its faces. An empty extent means the whole grid.
+    void setExtent(const GridExtent& extent) { this->extent = extent; }
+    const GridExtent& getExtent() const { return extent; }
 
 private:
-    // Helper function to calculate a vertex's position along an edge
-    glm::vec3 vertexInterp(float isovalue, glm::vec3 p1, glm::vec3 p2, float val1, float val2);
+    glm::vec3 spacing;
+    GridExtent extent;
+
+    // Running sums behind SurfaceMetrics, one per z-slab of cells
+    struct MetricsSums;
+
+    // Helper function to calculate a vertex's position along an edge; `mu`
+    // receives the weight of p2 so other attributes can be interpolated alike
+    glm::vec3 vertexInterp(float isovalue, glm::vec3 p1, glm::vec3 p2, float val1, float val2, float& mu);
+
+    // Appends the triangles of one classified cell to `vertices` and adds
+    // them to `metrics`; either may be null. With `cornerColor` (colormap
+    // coordinates) the colour is interpolated along each edge, otherwise
+    // every vertex gets `colorScalar`.
+    void polygoniseCell(const glm::vec3 cornerPos[8], const float cornerVal[8], int cubeindex, float isovalue,
+                        const float* cornerColor, float colorScalar, const glm::vec3& dims_f,
+                        const GradientField* gradients, std::vector<Vertex>* vertices, MetricsSums* metrics);
+
+    // Shared drivers of the public entry points; null outputs are skipped
+    void extractSingle(const ScalarField& field, float isovalue, const GradientField* gradients,
+                       const SurfaceColoring* coloring, std::vector<Vertex>* vertices, SurfaceMetrics* metrics);
+    void extractMulti(const ScalarField& field, const std::vector<float>& isovalues, const GradientField* gradients,
+                      const SurfaceColoring* coloring, std::vector<std::vector<Vertex>>* surfaces,
+                      std::vector<SurfaceMetrics>* metrics);
+    void extractSparse(const SparseField& field, const std::vector<float>& isovalues, const GradientField* gradients,
+                       const SurfaceColoring* coloring, std::vector<std::vector<Vertex>>* surfaces,
+                       std::vector<SurfaceMetrics>* metrics);
+    // Per level, the area of the far and near x faces of the extraction box
+    // with values >= isovalue
+    void measureBoxFaces(const ScalarField& field, const std::vector<float>& isovalues,
+                         std::vector<double>& farArea, std::vector<double>& nearArea) const;
+    void measureBoxFaces(const SparseField& field, const std::vector<float>& isovalues,
+                         std::vector<double>& farArea, std::vector<double>& nearArea) const;
+    // Turns per-slab sums ([level][z]) into metrics, adding the boundary term of the volume
+    template <typename Field>
+    void finishMetrics(const Field& field, const std::vector<float>& isovalues,
+                       const std::vector<std::vector<MetricsSums>>& slabMetrics,
+                       std::vector<SurfaceMetrics>& metrics) const;
 
-    
+    // Extraction loops, instantiated per field element type (see ScalarField::visit)
+    struct SurfaceKernel;
+    struct MultiSurfaceKernel;
+    struct BoundaryFaceKernel;
 };
 
 #endif // MARCHING_CUBES_H
@@ -0,0 +1,184 @@
+#include "mesh_components.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+
+namespace {
+
+const uint64_t EMPTY_KEY = ~(uint64_t)0; // Quantized positions use only 48 bits
+const size_t GRAIN = 16384;
+
+uint64_t positionKey(const Vertex& v) {
+    return (uint64_t)v.pos[0] | ((uint64_t)v.pos[1] << 16) | ((uint64_t)v.pos[2] << 32);
+}
+
+// Open-addressing set of vertex positions; a slot index identifies a welded vertex
+class VertexTable {
+public:
+    // Sized to at most half full
+    explicit VertexTable(size_t numVertices) : mask(tableSize(numVertices) - 1), keys(mask + 1) {
+        for (size_t i = 0; i <= mask; ++i) keys[i].store(EMPTY_KEY, std::memory_order_relaxed);
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+    // Slot of `key`, claiming a free one with CAS on first sight
+    uint32_t insert(uint64_t key) {
+        size_t slot = (size_t)((key * 0x9E3779B97F4A7C15ull) >> 20) & mask;
+        for (;;) {
+            uint64_t current = keys[slot].load(std::memory_order_relaxed);
+            if (current == key) return (uint32_t)slot;
+            if (current == EMPTY_KEY) {
+                if (keys[slot].compare_exchange_strong(current, key, std::memory_order_relaxed)) return (uint32_t)slot;
+                if (current == key) return (uint32_t)slot; // Lost the race to the same key
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+
+private:
+    static size_t tableSize(size_t numVertices) {
+        size_t size = 1;
+        while (size < 2 * numVertices) size <<= 1;
+        return size;
+    }
+
+    size_t mask;
+    std::vector<std::atomic<uint64_t>> keys;
+};
+
+// Lock-free union-find. A root is only ever linked below a smaller index,
+// so every CAS on a root succeeds at most once and no cycles can form.
+class UnionFind {
+public:
+    explicit UnionFind(size_t n) : parent(n) {
+        for (size_t i = 0; i < n; ++i) parent[i].store((uint32_t)i, std::memory_order_relaxed);
+    }
+
+    uint32_t find(uint32_t x) {
+        for (;;) {
+            uint32_t p = parent[x].load(std::memory_order_relaxed);
+            if (p == x) return x;
+            uint32_t gp = parent[p].load(std::memory_order_relaxed);
+            // Path halving; losing this race only skips an optimization
+            if (p != gp) parent[x].compare_exchange_weak(p, gp, std::memory_order_relaxed);
+            x = gp;
+        }
+    }
+
+    void unite(uint32_t a, uint32_t b) {
+        for (;;) {
+            a = find(a);
+            b = find(b);
+            if (a == b) return;
+            if (a < b) std::swap(a, b);
+            uint32_t expected = a;
+            if (parent[a].compare_exchange_strong(expected, b, std::memory_order_relaxed)) return;
+        }
+    }
+
+private:
+    std::vector<std::atomic<uint32_t>> parent;
+};
+
+} // namespace
+
+std::vector<uint32_t> MeshComponents::label(const std::vector<Vertex>& mesh, std::vector<MeshComponent>& components) {
+    components.clear();
+    size_t numTriangles = mesh.size() / 3;
+    std::vector<uint32_t> labels(numTriangles);
+    if (numTriangles == 0) return labels;
+    if (mesh.size() > 0x7fffffffu) {
+        std::cerr << "Error: Mesh too large for component labeling (" << mesh.size() << " vertices)." << std::endl;
+        return std::vector<uint32_t>();
+    }
+
+    // 1. Weld vertices by position and join the three corners of every triangle
+    ThreadPool& pool = ThreadPool::instance();
+    VertexTable table(numTriangles * 3);
+    UnionFind sets(table.capacity());
+    std::vector<uint32_t> firstSlot(numTriangles);
+    pool.parallelFor(numTriangles, GRAIN, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; ++t) {
+            uint32_t a = table.insert(positionKey(mesh[3 * t]));
+            uint32_t b = table.insert(positionKey(mesh[3 * t + 1]));
+            uint32_t c = table.insert(positionKey(mesh[3 * t + 2]));
+            sets.unite(a, b);
+            sets.unite(a, c);
+            firstSlot[t] = a;
+        }
+    });
+
+    // 2. Resolve every triangle to its root once all unions are done
+    pool.parallelFor(numTriangles, GRAIN, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; ++t) labels[t] = sets.find(firstSlot[t]);
+    });
+
+    // 3. Number roots in order of first appearance and gather sizes and bounds
+    std::vector<uint32_t> rootIndex(table.capacity(), UINT32_MAX);
+    for (size_t t = 0; t < numTriangles; ++t) {
+        uint32_t& index = rootIndex[labels[t]];
+        if (index == UINT32_MAX) {
+            index = (uint32_t)components.size();
+            MeshComponent component = { 0, glm::vec3(1.0f), glm::vec3(0.0f) };
+            components.push_back(component);
+        }
+        labels[t] = index;
+        MeshComponent& component = components[index];
+        ++component.triangleCount;
+        for (int k = 0; k < 3; ++k) {
+            glm::vec3 p = mesh[3 * t + k].getPosition();
+            component.boundsMin = glm::min(component.boundsMin, p);
+            component.boundsMax = glm::max(component.boundsMax, p);
+        }
+    }
+
+    // 4. Sort largest first (stable, so ties keep mesh order) and remap the labels
+    std::vector<uint32_t> order(components.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = (uint32_t)i;
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return components[a].triangleCount > components[b].triangleCount;
+    });
+    std::vector<MeshComponent> sorted(components.size());
+    std::vector<uint32_t> remap(components.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        sorted[i] = components[order[i]];
+        remap[order[i]] = (uint32_t)i;
+    }
+    components.swap(sorted);
+    pool.parallelFor(numTriangles, GRAIN, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; ++t) labels[t] = remap[labels[t]];
+    });
+    return labels;
+}
+
+ComponentStats MeshComponents::filter(std::vector<Vertex>& mesh, const ComponentFilter& filter) {
+    ComponentStats stats;
+    std::vector<uint32_t> labels = label(mesh, stats.components);
+    size_t numTriangles = labels.size();
+    if (numTriangles != mesh.size() / 3) {
+        // Labeling failed; leave the mesh untouched
+        stats.keptComponents = 0;
+        stats.keptTriangles = mesh.size() / 3;
+        stats.removedTriangles = 0;
+        return stats;
+    }
+
+    // Components are sorted by size, so the survivors are a prefix
+    size_t kept = stats.components.size();
+    if (filter.keepLargest > 0) kept = std::min(kept, filter.keepLargest);
+    while (kept > 0 && stats.components[kept - 1].triangleCount < filter.minTriangles) --kept;
+    stats.keptComponents = kept;
+
+    size_t out = 0;
+    for (size_t t = 0; t < numTriangles; ++t) {
+        if (labels[t] >= kept) continue;
+        if (out != 3 * t) std::copy(mesh.begin() + 3 * t, mesh.begin() + 3 * t + 3, mesh.begin() + out);
+        out += 3;
+    }
+    stats.keptTriangles = out / 3;
+    stats.removedTriangles = numTriangles - stats.keptTriangles;
+    mesh.resize(out);
+    return stats;
+}
@@ -0,0 +1,45 @@
+#ifndef MESH_COMPONENTS_H
+#define MESH_COMPONENTS_H
+
+#include <vector>
+#include <stdint.h>
+#include <glm/glm.hpp>
+#include "marching_cubes.h"
+
+// One connected piece of an isosurface
+struct MeshComponent {
+    size_t triangleCount;
+    glm::vec3 boundsMin; // [0,1] unit space, like the vertex positions
+    glm::vec3 boundsMax;
+};
+
+// Which components survive filtering; zero disables a criterion
+struct ComponentFilter {
+    size_t keepLargest;  // Keep only the N components with the most triangles
+    size_t minTriangles; // Drop components with fewer triangles
+};
+
+struct ComponentStats {
+    std::vector<MeshComponent> components; // Largest first
+    size_t keptComponents;
+    size_t keptTriangles;
+    size_t removedTriangles;
+};
+
+// Connected-component labeling of a triangle soup. Triangles are connected
+// when they share a vertex position; the Marching Cubes extractor emits
+// bit-identical positions for a shared edge, so no tolerance is needed.
+class MeshComponents {
+public:
+    // Labels every triangle of `mesh` with its component index into
+    // `components` (sorted largest first). Vertices are welded through a
+    // lock-free hash table and joined with a lock-free union-find, both
+    // filled in parallel on the shared thread pool.
+    static std::vector<uint32_t> label(const std::vector<Vertex>& mesh, std::vector<MeshComponent>& components);
+
+    // Removes the components rejected by `filter` from `mesh`, keeping the
+    // order of the remaining triangles
+    static ComponentStats filter(std::vector<Vertex>& mesh, const ComponentFilter& filter);
+};
+
+#endif // MESH_COMPONENTS_H
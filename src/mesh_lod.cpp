@@ -0,0 +1,197 @@
+#include "mesh_lod.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Clustering cells are grouped into blocks of BLOCK^3 cells; each block is
+// simplified independently with a small dense accumulator.
+const int BLOCK = 16;
+
+// Symmetric 4x4 plane quadric (a b c d)^T (a b c d), stored as its upper triangle
+struct Quadric {
+    double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+    Quadric() : a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0) {}
+
+    void addPlane(const glm::vec3& n, double d, double w) {
+        a2 += w * n.x * n.x; ab += w * n.x * n.y; ac += w * n.x * n.z; ad += w * n.x * d;
+        b2 += w * n.y * n.y; bc += w * n.y * n.z; bd += w * n.y * d;
+        c2 += w * n.z * n.z; cd += w * n.z * d;
+        d2 += w * d * d;
+    }
+
+    // Position minimizing the quadric error; false if the system is singular
+    bool minimize(glm::vec3& out) const {
+        double det = a2 * (b2 * c2 - bc * bc) - ab * (ab * c2 - bc * ac) + ac * (ab * bc - b2 * ac);
+        double scale = a2 + b2 + c2;
+        if (std::abs(det) < 1e-6 * scale * scale * scale || scale <= 0.0) return false;
+        double rx = -ad, ry = -bd, rz = -cd;
+        double x = (rx * (b2 * c2 - bc * bc) - ab * (ry * c2 - bc * rz) + ac * (ry * bc - b2 * rz)) / det;
+        double y = (a2 * (ry * c2 - bc * rz) - rx * (ab * c2 - bc * ac) + ac * (ab * rz - ry * ac)) / det;
+        double z = (a2 * (b2 * rz - ry * bc) - ab * (ab * rz - ry * ac) + rx * (ab * bc - b2 * ac)) / det;
+        out = glm::vec3((float)x, (float)y, (float)z);
+        return true;
+    }
+};
+
+struct Cluster {
+    Quadric q;
+    glm::vec3 posSum;
+    float scalarSum;
+    glm::vec3 normalSum;
+    int count;
+    Cluster() : posSum(0.0f), scalarSum(0.0f), normalSum(0.0f), count(0) {}
+};
+
+} // namespace
+
+std::vector<Vertex> MeshSimplifier::simplify(const std::vector<Vertex>& mesh, glm::ivec3 gridRes) {
+    size_t numCorners = mesh.size() - mesh.size() % 3;
+    glm::ivec3 res = glm::max(gridRes, glm::ivec3(1));
+    glm::ivec3 blocks = (res + glm::ivec3(BLOCK - 1)) / BLOCK;
+    size_t numBlocks = (size_t)blocks.x * blocks.y * blocks.z;
+
+    // 1. Assign every triangle corner to its clustering cell
+    std::vector<unsigned int> cellOf(numCorners);
+    ThreadPool& pool = ThreadPool::instance();
+    pool.parallelFor(numCorners, 16384, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            glm::ivec3 c = glm::ivec3(mesh[i].getPosition() * glm::vec3(res));
+            c = glm::clamp(c, glm::ivec3(0), res - glm::ivec3(1));
+            cellOf[i] = ((unsigned int)c.z * res.y + c.y) * res.x + c.x;
+        }
+    });
+
+    // 2. Bucket corners by spatial block (counting sort)
+    std::vector<unsigned int> blockStart(numBlocks + 1, 0);
+    std::vector<unsigned int> blockOf(numCorners);
+    for (size_t i = 0; i < numCorners; ++i) {
+        unsigned int cell = cellOf[i];
+        int x = cell % res.x, y = (cell / res.x) % res.y, z = cell / (res.x * res.y);
+        blockOf[i] = ((unsigned int)(z / BLOCK) * blocks.y + y / BLOCK) * blocks.x + x / BLOCK;
+        blockStart[blockOf[i] + 1]++;
+    }
+    for (size_t b = 0; b < numBlocks; ++b) blockStart[b + 1] += blockStart[b];
+    std::vector<unsigned int> sorted(numCorners);
+    {
+        std::vector<unsigned int> fill(blockStart.begin(), blockStart.end() - 1);
+        for (size_t i = 0; i < numCorners; ++i) sorted[fill[blockOf[i]]++] = (unsigned int)i;
+    }
+
+    // 3. Per block: accumulate quadrics per cell and place one representative vertex
+    std::vector<Vertex> representative(numCorners);
+    glm::vec3 cellSize = 1.0f / glm::vec3(res);
+    pool.parallelFor(numBlocks, 1, [&](size_t beginBlock, size_t endBlock) {
+        std::vector<Cluster> clusters(BLOCK * BLOCK * BLOCK);
+        for (size_t b = beginBlock; b < endBlock; ++b) {
+            if (blockStart[b] == blockStart[b + 1]) continue;
+            glm::ivec3 blockPos((int)(b % blocks.x), (int)((b / blocks.x) % blocks.y), (int)(b / (blocks.x * blocks.y)));
+            glm::ivec3 base = blockPos * BLOCK;
+            std::fill(clusters.begin(), clusters.end(), Cluster());
+
+            for (unsigned int k = blockStart[b]; k < blockStart[b + 1]; ++k) {
+                unsigned int i = sorted[k];
+                unsigned int cell = cellOf[i];
+                glm::ivec3 c((int)(cell % res.x), (int)((cell / res.x) % res.y), (int)(cell / (res.x * res.y)));
+                glm::ivec3 local = c - base;
+                Cluster& cl = clusters[(local.z * BLOCK + local.y) * BLOCK + local.x];
+
+                size_t tri = i - i % 3;
+                glm::vec3 p0 = mesh[tri].getPosition();
+                glm::vec3 n = glm::cross(mesh[tri + 1].getPosition() - p0, mesh[tri + 2].getPosition() - p0);
+                float area2 = glm::length(n);
+                if (area2 > 0.0f) {
+                    n = n / area2;
+                    cl.q.addPlane(n, -glm::dot(n, p0), 0.5 * area2);
+                }
+                cl.posSum += mesh[i].getPosition();
+                cl.scalarSum += mesh[i].getScalar();
+                cl.normalSum += mesh[i].getNormal();
+                cl.count++;
+            }
+
+            for (unsigned int k = blockStart[b]; k < blockStart[b + 1]; ++k) {
+                unsigned int i = sorted[k];
+                unsigned int cell = cellOf[i];
+                glm::ivec3 c((int)(cell % res.x), (int)((cell / res.x) % res.y), (int)(cell / (res.x * res.y)));
+                glm::ivec3 local = c - base;
+                const Cluster& cl = clusters[(local.z * BLOCK + local.y) * BLOCK + local.x];
+
+                glm::vec3 mean = cl.posSum / (float)cl.count;
+                glm::vec3 pos;
+                if (!cl.q.minimize(pos)) pos = mean;
+                // Keep the vertex inside its cell so flat regions cannot shoot off
+                glm::vec3 lo = glm::vec3(c) * cellSize;
+                pos = glm::clamp(pos, lo, lo + cellSize);
+
+                representative[i].setPosition(pos);
+                representative[i].setScalar(cl.scalarSum / (float)cl.count);
+                if (glm::length(cl.normalSum) > 0.0f) {
+                    representative[i].setNormal(cl.normalSum);
+                } else {
+                    representative[i].normal[0] = mesh[i].normal[0];
+                    representative[i].normal[1] = mesh[i].normal[1];
+                }
+            }
+        }
+    });
+
+    // 4. Keep the triangles whose corners landed in three different cells
+    const size_t trisPerChunk = 16384;
+    size_t numTris = numCorners / 3;
+    std::vector<std::vector<Vertex>> partial((numTris + trisPerChunk - 1) / trisPerChunk);
+    pool.parallelFor(numTris, trisPerChunk, [&](size_t begin, size_t end) {
+        std::vector<Vertex>& kept = partial[begin / trisPerChunk];
+        for (size_t t = begin; t < end; ++t) {
+            size_t i = t * 3;
+            if (cellOf[i] == cellOf[i + 1] || cellOf[i + 1] == cellOf[i + 2] || cellOf[i] == cellOf[i + 2]) continue;
+            kept.push_back(representative[i]);
+            kept.push_back(representative[i + 1]);
+            kept.push_back(representative[i + 2]);
+        }
+    });
+
+    std::vector<Vertex> out;
+    size_t total = 0;
+    for (size_t p = 0; p < partial.size(); ++p) total += partial[p].size();
+    out.reserve(total);
+    for (size_t p = 0; p < partial.size(); ++p) out.insert(out.end(), partial[p].begin(), partial[p].end());
+    return out;
+}
+
+std::vector<LodLevel> MeshSimplifier::buildLods(const std::vector<Vertex>& mesh, glm::ivec3 dims, int numLevels) {
+    std::vector<LodLevel> lods;
+    if (numLevels < 1) return lods;
+
+    LodLevel base;
+    base.vertices = mesh;
+    base.cellVoxels = 1;
+    lods.push_back(base);
+
+    glm::ivec3 cells = glm::max(dims - glm::ivec3(1), glm::ivec3(1));
+    for (int level = 1; level < numLevels; ++level) {
+        LodLevel lod;
+        lod.cellVoxels = 1 << level;
+        glm::ivec3 res = (cells + glm::ivec3(lod.cellVoxels - 1)) / lod.cellVoxels;
+        lod.vertices = simplify(lods.back().vertices, res);
+        lods.push_back(lod);
+        if (res == glm::ivec3(1)) break;
+    }
+    return lods;
+}
+
+int MeshSimplifier::selectLevel(const std::vector<LodLevel>& lods, float voxelSize, float cameraDistance,
+                                float fovY, int viewportHeight, float maxPixelError) {
+    if (lods.empty()) return -1;
+    // World units covered by one pixel at the camera's orbit distance
+    float pixelSize = 2.0f * cameraDistance * std::tan(fovY * 0.5f) / (float)std::max(viewportHeight, 1);
+    int level = 0;
+    for (int i = 1; i < (int)lods.size(); ++i) {
+        if (lods[i].vertices.empty()) break;
+        float error = lods[i].cellVoxels * voxelSize;
+        if (error / pixelSize > maxPixelError) break;
+        level = i;
+    }
+    return level;
+}
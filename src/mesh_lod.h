@@ -0,0 +1,30 @@
+#ifndef MESH_LOD_H
+#define MESH_LOD_H
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "marching_cubes.h"
+
+// One level of detail of an isosurface mesh
+struct LodLevel {
+    std::vector<Vertex> vertices;
+    int cellVoxels; // Edge length of a clustering cell in voxels (1 = full resolution)
+};
+
+class MeshSimplifier {
+public:
+    // Builds `numLevels` levels; level 0 is `mesh` itself and every further
+    // level clusters the previous one on a grid twice as coarse.
+    std::vector<LodLevel> buildLods(const std::vector<Vertex>& mesh, glm::ivec3 dims, int numLevels);
+
+    // Quadric-error vertex clustering of a triangle soup in [0,1] unit space.
+    // The clustering grid is split into spatial blocks that are simplified in parallel.
+    std::vector<Vertex> simplify(const std::vector<Vertex>& mesh, glm::ivec3 gridRes);
+
+    // Picks the coarsest level whose clustering error, projected to the screen,
+    // stays below `maxPixelError`. `voxelSize` is the world size of one voxel.
+    static int selectLevel(const std::vector<LodLevel>& lods, float voxelSize, float cameraDistance,
+                           float fovY, int viewportHeight, float maxPixelError);
+};
+
+#endif // MESH_LOD_H
@@ -0,0 +1,135 @@
+#include "raw_volume.h"
+#include <cstring>
+#include <ostream>
+#include <stdint.h>
+
+namespace {
+
+const char CACHE_MAGIC[8] = { 'V', 'S', 'V', 'O', 'L', 'U', 'M', 'E' };
+const uint32_t CACHE_VERSION = 1;
+
+struct TypeName {
+    VoxelType type;
+    const char* name;
+    const char* vtkName;
+};
+
+const TypeName TYPE_NAMES[] = {
+    { VoxelUInt8,   "uint8",   "unsigned_char" },
+    { VoxelInt8,    "int8",    "char" },
+    { VoxelUInt16,  "uint16",  "unsigned_short" },
+    { VoxelInt16,   "int16",   "short" },
+    { VoxelUInt32,  "uint32",  "unsigned_int" },
+    { VoxelInt32,   "int32",   "int" },
+    { VoxelFloat32, "float32", "float" },
+    { VoxelFloat64, "float64", "double" }
+};
+
+void putU32(std::ostream& out, uint32_t v) {
+    unsigned char b[4] = { (unsigned char)v, (unsigned char)(v >> 8), (unsigned char)(v >> 16), (unsigned char)(v >> 24) };
+    out.write(reinterpret_cast<const char*>(b), 4);
+}
+
+void putF32(std::ostream& out, float f) {
+    uint32_t v;
+    std::memcpy(&v, &f, 4);
+    putU32(out, v);
+}
+
+uint32_t getU32(const char* p) {
+    const unsigned char* b = reinterpret_cast<const unsigned char*>(p);
+    return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+float getF32(const char* p) {
+    uint32_t v = getU32(p);
+    float f;
+    std::memcpy(&f, &v, 4);
+    return f;
+}
+
+// magic, version, dims[3], spacing[3], origin[3], type, name length
+const size_t FIXED_HEADER_SIZE = 8 + 4 * 12;
+
+} // namespace
+
+size_t voxelTypeSize(VoxelType type) {
+    switch (type) {
+        case VoxelUInt8: case VoxelInt8: return 1;
+        case VoxelUInt16: case VoxelInt16: return 2;
+        case VoxelUInt32: case VoxelInt32: case VoxelFloat32: return 4;
+        case VoxelFloat64: return 8;
+    }
+    return 0;
+}
+
+bool parseVoxelType(const std::string& name, VoxelType& type) {
+    for (size_t i = 0; i < sizeof(TYPE_NAMES) / sizeof(TYPE_NAMES[0]); ++i) {
+        if (name == TYPE_NAMES[i].name || name == TYPE_NAMES[i].vtkName) {
+            type = TYPE_NAMES[i].type;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* voxelTypeName(VoxelType type) {
+    return TYPE_NAMES[type].name;
+}
+
+const char* voxelTypeVtkName(VoxelType type) {
+    return TYPE_NAMES[type].vtkName;
+}
+
+void copyVoxels(const unsigned char* src, size_t elementSize, bool swap, unsigned char* dst,
+                size_t count, size_t stride) {
+    if (!swap && stride == 1) {
+        std::memcpy(dst, src, count * elementSize);
+        return;
+    }
+    const size_t step = stride * elementSize;
+    for (size_t i = 0; i < count; ++i, src += step, dst += elementSize) {
+        if (swap) {
+            for (size_t b = 0; b < elementSize; ++b) dst[b] = src[elementSize - 1 - b];
+        } else {
+            std::memcpy(dst, src, elementSize);
+        }
+    }
+}
+
+bool isVolumeCache(const char* data, size_t size) {
+    return size >= sizeof(CACHE_MAGIC) && std::memcmp(data, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0;
+}
+
+void writeVolumeCacheHeader(std::ostream& out, const VolumeCacheHeader& header) {
+    out.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    putU32(out, CACHE_VERSION);
+    for (int i = 0; i < 3; ++i) putU32(out, (uint32_t)header.dimensions[i]);
+    for (int i = 0; i < 3; ++i) putF32(out, header.spacing[i]);
+    for (int i = 0; i < 3; ++i) putF32(out, header.origin[i]);
+    putU32(out, (uint32_t)header.type);
+    putU32(out, (uint32_t)header.fieldName.size());
+    out.write(header.fieldName.data(), header.fieldName.size());
+    // Pad so the voxels start 16-byte aligned
+    size_t used = FIXED_HEADER_SIZE + header.fieldName.size();
+    static const char zeros[16] = { 0 };
+    out.write(zeros, (16 - used % 16) % 16);
+}
+
+bool readVolumeCacheHeader(const char* data, size_t size, VolumeCacheHeader& header, size_t& dataOffset) {
+    if (size < FIXED_HEADER_SIZE || !isVolumeCache(data, size)) return false;
+    const char* p = data + sizeof(CACHE_MAGIC);
+    if (getU32(p) != CACHE_VERSION) return false;
+    p += 4;
+    for (int i = 0; i < 3; ++i, p += 4) header.dimensions[i] = (int)getU32(p);
+    for (int i = 0; i < 3; ++i, p += 4) header.spacing[i] = getF32(p);
+    for (int i = 0; i < 3; ++i, p += 4) header.origin[i] = getF32(p);
+    uint32_t type = getU32(p); p += 4;
+    uint32_t nameLength = getU32(p); p += 4;
+    if (type > VoxelFloat64 || FIXED_HEADER_SIZE + nameLength > size) return false;
+    header.type = (VoxelType)type;
+    header.fieldName.assign(p, nameLength);
+    size_t used = FIXED_HEADER_SIZE + nameLength;
+    dataOffset = used + (16 - used % 16) % 16;
+    return dataOffset <= size;
+}
@@ -0,0 +1,53 @@
+#ifndef RAW_VOLUME_H
+#define RAW_VOLUME_H
+
+#include <iosfwd>
+#include <string>
+#include <glm/glm.hpp>
+
+// Element types of raw voxel data (RAW files, binary VTK, volume caches)
+enum VoxelType {
+    VoxelUInt8,
+    VoxelInt8,
+    VoxelUInt16,
+    VoxelInt16,
+    VoxelUInt32,
+    VoxelInt32,
+    VoxelFloat32,
+    VoxelFloat64
+};
+
+size_t voxelTypeSize(VoxelType type);
+
+// Accepts converter names (uint8, int16, float32, ...) and legacy VTK names
+// (unsigned_char, short, float, ...)
+bool parseVoxelType(const std::string& name, VoxelType& type);
+const char* voxelTypeName(VoxelType type);    // e.g. "uint16"
+const char* voxelTypeVtkName(VoxelType type); // e.g. "unsigned_short"
+
+inline bool hostIsBigEndian() {
+    const unsigned short one = 1;
+    return *reinterpret_cast<const unsigned char*>(&one) == 0;
+}
+
+// Copies `count` elements of `elementSize` bytes, `stride` elements apart in
+// `src`, into `dst` and reverses the bytes of each element if `swap` is set
+void copyVoxels(const unsigned char* src, size_t elementSize, bool swap, unsigned char* dst,
+                size_t count, size_t stride = 1);
+
+// Native volume cache: a fixed little-endian header followed by the raw
+// little-endian voxels, so loading is a single read with no text parsing.
+struct VolumeCacheHeader {
+    glm::ivec3 dimensions;
+    glm::vec3 spacing;
+    glm::vec3 origin;
+    VoxelType type;
+    std::string fieldName;
+};
+
+bool isVolumeCache(const char* data, size_t size);
+void writeVolumeCacheHeader(std::ostream& out, const VolumeCacheHeader& header);
+// Parses the header; `dataOffset` receives the byte offset of the first voxel
+bool readVolumeCacheHeader(const char* data, size_t size, VolumeCacheHeader& header, size_t& dataOffset);
+
+#endif // RAW_VOLUME_H
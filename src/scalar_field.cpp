@@ -0,0 +1,342 @@
+#include "scalar_field.h"
+#include "thread_pool.h"
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+const size_t RANGE_GRAIN = 1 << 20;
+
+// Same clamping and weights as VtkParser::getValue
+template <typename T>
+inline float trilinear(const T* v, const glm::ivec3& dims, const glm::vec3& coord) {
+    float x = glm::clamp(coord.x, 0.0f, (float)dims.x - 1.001f);
+    float y = glm::clamp(coord.y, 0.0f, (float)dims.y - 1.001f);
+    float z = glm::clamp(coord.z, 0.0f, (float)dims.z - 1.001f);
+
+    int x0 = (int)x, y0 = (int)y, z0 = (int)z;
+    float xd = x - x0, yd = y - y0, zd = z - z0;
+
+    size_t sliceSize = (size_t)dims.x * dims.y;
+    const T* p = v + (size_t)z0 * sliceSize + (size_t)y0 * dims.x + x0;
+    float c00 = (float)p[0] * (1 - xd) + (float)p[1] * xd;
+    float c10 = (float)p[dims.x] * (1 - xd) + (float)p[dims.x + 1] * xd;
+    p += sliceSize;
+    float c01 = (float)p[0] * (1 - xd) + (float)p[1] * xd;
+    float c11 = (float)p[dims.x] * (1 - xd) + (float)p[dims.x + 1] * xd;
+
+    float c0 = c00 * (1 - yd) + c10 * yd;
+    float c1 = c01 * (1 - yd) + c11 * yd;
+
+    return c0 * (1 - zd) + c1 * zd;
+}
+
+struct ValueKernel {
+    size_t index;
+    float result;
+    template <typename T> void operator()(const T* v) { result = (float)v[index]; }
+};
+
+template <typename T>
+float readValue(const void* values, size_t index) {
+    return (float)static_cast<const T*>(values)[index];
+}
+
+struct ReaderKernel {
+    ScalarField::Reader result;
+    template <typename T> void operator()(const T*) { result = &readValue<T>; }
+};
+
+struct SampleKernel {
+    glm::ivec3 dims;
+    glm::vec3 coord;
+    float result;
+    template <typename T> void operator()(const T* v) { result = trilinear(v, dims, coord); }
+};
+
+// Trilinear samples of points [begin, end) of SoA arrays x/y/z
+template <typename T>
+void sampleRange(const T* v, const glm::ivec3& dims, const float* x, const float* y, const float* z,
+                 size_t begin, size_t end, float* out) {
+    size_t i = begin;
+#ifdef __SSE2__
+    const size_t sliceSize = (size_t)dims.x * dims.y;
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    const __m128 maxX = _mm_set1_ps((float)dims.x - 1.001f);
+    const __m128 maxY = _mm_set1_ps((float)dims.y - 1.001f);
+    const __m128 maxZ = _mm_set1_ps((float)dims.z - 1.001f);
+    for (; i + 4 <= end; i += 4) {
+        __m128 px = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(x + i), zero), maxX);
+        __m128 py = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(y + i), zero), maxY);
+        __m128 pz = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(z + i), zero), maxZ);
+        __m128i ix = _mm_cvttps_epi32(px), iy = _mm_cvttps_epi32(py), iz = _mm_cvttps_epi32(pz);
+        __m128 xd = _mm_sub_ps(px, _mm_cvtepi32_ps(ix));
+        __m128 yd = _mm_sub_ps(py, _mm_cvtepi32_ps(iy));
+        __m128 zd = _mm_sub_ps(pz, _mm_cvtepi32_ps(iz));
+
+        // Gather the 8 corners of each of the 4 cells
+        int x0[4], y0[4], z0[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(x0), ix);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y0), iy);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(z0), iz);
+        float corner[8][4];
+        for (int k = 0; k < 4; ++k) {
+            const T* p = v + (size_t)z0[k] * sliceSize + (size_t)y0[k] * dims.x + x0[k];
+            corner[0][k] = (float)p[0];      corner[1][k] = (float)p[1];
+            corner[2][k] = (float)p[dims.x]; corner[3][k] = (float)p[dims.x + 1];
+            p += sliceSize;
+            corner[4][k] = (float)p[0];      corner[5][k] = (float)p[1];
+            corner[6][k] = (float)p[dims.x]; corner[7][k] = (float)p[dims.x + 1];
+        }
+
+        __m128 xd1 = _mm_sub_ps(one, xd), yd1 = _mm_sub_ps(one, yd), zd1 = _mm_sub_ps(one, zd);
+        __m128 c00 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(corner[0]), xd1), _mm_mul_ps(_mm_loadu_ps(corner[1]), xd));
+        __m128 c10 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(corner[2]), xd1), _mm_mul_ps(_mm_loadu_ps(corner[3]), xd));
+        __m128 c01 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(corner[4]), xd1), _mm_mul_ps(_mm_loadu_ps(corner[5]), xd));
+        __m128 c11 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(corner[6]), xd1), _mm_mul_ps(_mm_loadu_ps(corner[7]), xd));
+        __m128 c0 = _mm_add_ps(_mm_mul_ps(c00, yd1), _mm_mul_ps(c10, yd));
+        __m128 c1 = _mm_add_ps(_mm_mul_ps(c01, yd1), _mm_mul_ps(c11, yd));
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(c0, zd1), _mm_mul_ps(c1, zd)));
+    }
+#endif
+    for (; i < end; ++i) out[i] = trilinear(v, dims, glm::vec3(x[i], y[i], z[i]));
+}
+
+struct BatchKernel {
+    glm::ivec3 dims;
+    const float* x;
+    const float* y;
+    const float* z;
+    size_t count;
+    float* out;
+    bool parallel;
+
+    template <typename T> void operator()(const T* v) {
+        if (!parallel) { sampleRange(v, dims, x, y, z, 0, count, out); return; }
+        ThreadPool::instance().parallelFor(count, 4096, [&](size_t begin, size_t end) {
+            sampleRange(v, dims, x, y, z, begin, end, out);
+        });
+    }
+};
+
+// Samples one lattice row origin + i * step along grid axis `axis` only. The
+// two other coordinates are fixed, so their four neighbour rows and weights
+// are set up once and each point only interpolates along `axis`.
+template <typename T>
+void sampleAxisRow(const T* v, const glm::ivec3& dims, const glm::vec3& origin, int axis, float step,
+                   int count, float* out) {
+    const size_t strides[3] = { 1, (size_t)dims.x, (size_t)dims.x * dims.y };
+    int b = (axis + 1) % 3, c = (axis + 2) % 3;
+    if (b > c) std::swap(b, c);
+    float cb = glm::clamp(origin[b], 0.0f, (float)dims[b] - 1.001f);
+    float cc = glm::clamp(origin[c], 0.0f, (float)dims[c] - 1.001f);
+    int ib = (int)cb, ic = (int)cc;
+    float wb = cb - ib, wc = cc - ic;
+    const T* base = v + ib * strides[b] + ic * strides[c];
+    const size_t sb = strides[b], sc = strides[c], sa = strides[axis];
+    const float maxA = (float)dims[axis] - 1.001f;
+
+    for (int i = 0; i < count; ++i) {
+        float ca = glm::clamp(origin[axis] + step * (float)i, 0.0f, maxA);
+        int ia = (int)ca;
+        float wa = ca - ia;
+        const T* p = base + ia * sa;
+        // Blend along the axis first, then across the fixed rows
+        float r00 = (float)p[0] * (1 - wa) + (float)p[sa] * wa;
+        float r10 = (float)p[sb] * (1 - wa) + (float)p[sb + sa] * wa;
+        float r01 = (float)p[sc] * (1 - wa) + (float)p[sc + sa] * wa;
+        float r11 = (float)p[sb + sc] * (1 - wa) + (float)p[sb + sc + sa] * wa;
+        float r0 = r00 * (1 - wb) + r10 * wb;
+        float r1 = r01 * (1 - wb) + r11 * wb;
+        out[i] = r0 * (1 - wc) + r1 * wc;
+    }
+}
+
+struct LatticeKernel {
+    glm::ivec3 dims;
+    glm::vec3 origin, stepU, stepV;
+    int countU, countV;
+    float* out;
+    bool parallel;
+
+    template <typename T> void operator()(const T* v) {
+        int axis = -1;
+        if (stepU.y == 0.0f && stepU.z == 0.0f) axis = 0;
+        else if (stepU.x == 0.0f && stepU.z == 0.0f) axis = 1;
+        else if (stepU.x == 0.0f && stepU.y == 0.0f) axis = 2;
+
+        auto rows = [&](size_t rowBegin, size_t rowEnd) {
+            std::vector<float> x, y, z;
+            for (size_t j = rowBegin; j < rowEnd; ++j) {
+                glm::vec3 rowOrigin = origin + stepV * (float)j;
+                float* rowOut = out + j * countU;
+                if (axis >= 0) {
+                    sampleAxisRow(v, dims, rowOrigin, axis, stepU[axis], countU, rowOut);
+                    continue;
+                }
+                // Oblique rows go through the batched SoA path; positions are
+                // stepped incrementally rather than transformed per sample
+                x.resize(countU); y.resize(countU); z.resize(countU);
+                glm::vec3 p = rowOrigin;
+                for (int i = 0; i < countU; ++i, p += stepU) {
+                    x[i] = p.x; y[i] = p.y; z[i] = p.z;
+                }
+                sampleRange(v, dims, x.data(), y.data(), z.data(), 0, countU, rowOut);
+            }
+        };
+        if (parallel) ThreadPool::instance().parallelFor(countV, 8, rows);
+        else rows(0, countV);
+    }
+};
+
+struct RangeKernel {
+    size_t count;
+    float minValue, maxValue;
+    template <typename T> void operator()(const T* v) {
+        size_t numChunks = (count + RANGE_GRAIN - 1) / RANGE_GRAIN;
+        std::vector<T> chunkMin(numChunks), chunkMax(numChunks);
+        ThreadPool::instance().parallelFor(count, RANGE_GRAIN, [&](size_t begin, size_t end) {
+            T lo = v[begin], hi = v[begin];
+            for (size_t i = begin + 1; i < end; ++i) {
+                lo = std::min(lo, v[i]);
+                hi = std::max(hi, v[i]);
+            }
+            chunkMin[begin / RANGE_GRAIN] = lo;
+            chunkMax[begin / RANGE_GRAIN] = hi;
+        });
+        minValue = (float)*std::min_element(chunkMin.begin(), chunkMin.end());
+        maxValue = (float)*std::max_element(chunkMax.begin(), chunkMax.end());
+    }
+};
+
+struct ExtentRangeKernel {
+    glm::ivec3 dims;
+    GridExtent extent;
+    float minValue, maxValue;
+    template <typename T> void operator()(const T* v) {
+        glm::ivec3 size = extent.dimensions();
+        size_t numRows = (size_t)size.y * size.z;
+        size_t rowGrain = std::max<size_t>(1, RANGE_GRAIN / size.x);
+        size_t numChunks = (numRows + rowGrain - 1) / rowGrain;
+        std::vector<T> chunkMin(numChunks), chunkMax(numChunks);
+        ThreadPool::instance().parallelFor(numRows, rowGrain, [&](size_t begin, size_t end) {
+            T lo = 0, hi = 0;
+            for (size_t r = begin; r < end; ++r) {
+                size_t y = extent.first.y + r % size.y, z = extent.first.z + r / size.y;
+                const T* row = v + (z * dims.y + y) * dims.x + extent.first.x;
+                if (r == begin) lo = hi = row[0];
+                for (int i = 0; i < size.x; ++i) {
+                    lo = std::min(lo, row[i]);
+                    hi = std::max(hi, row[i]);
+                }
+            }
+            chunkMin[begin / rowGrain] = lo;
+            chunkMax[begin / rowGrain] = hi;
+        });
+        minValue = (float)*std::min_element(chunkMin.begin(), chunkMin.end());
+        maxValue = (float)*std::max_element(chunkMax.begin(), chunkMax.end());
+    }
+};
+
+struct MeanKernel {
+    size_t count;
+    double mean;
+    template <typename T> void operator()(const T* v) {
+        size_t numChunks = (count + RANGE_GRAIN - 1) / RANGE_GRAIN;
+        std::vector<double> chunkSum(numChunks, 0.0);
+        ThreadPool::instance().parallelFor(count, RANGE_GRAIN, [&](size_t begin, size_t end) {
+            double sum = 0.0;
+            for (size_t i = begin; i < end; ++i) sum += (double)v[i];
+            chunkSum[begin / RANGE_GRAIN] = sum;
+        });
+        double sum = 0.0;
+        for (size_t i = 0; i < numChunks; ++i) sum += chunkSum[i];
+        mean = count ? sum / count : 0.0;
+    }
+};
+
+struct ConvertKernel {
+    size_t count;
+    float* out;
+    template <typename T> void operator()(const T* v) {
+        ThreadPool::instance().parallelFor(count, RANGE_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) out[i] = (float)v[i];
+        });
+    }
+};
+
+} // namespace
+
+ScalarField::ScalarField() : type(VoxelFloat32), dimensions(0) {}
+
+ScalarField::ScalarField(VoxelType t, glm::ivec3 dims)
+    : type(t), dimensions(dims), storage(size() * voxelTypeSize(t), 0) {}
+
+float ScalarField::valueAt(size_t index) const {
+    ValueKernel kernel = { index, 0.0f };
+    visit(kernel);
+    return kernel.result;
+}
+
+ScalarField::Reader ScalarField::reader() const {
+    ReaderKernel kernel = { nullptr };
+    visit(kernel);
+    return kernel.result;
+}
+
+float ScalarField::sample(const glm::vec3& coord) const {
+    SampleKernel kernel = { dimensions, coord, 0.0f };
+    visit(kernel);
+    return kernel.result;
+}
+
+void ScalarField::sampleBatch(const float* x, const float* y, const float* z, size_t count, float* out,
+                              bool parallel) const {
+    BatchKernel kernel = { dimensions, x, y, z, count, out, parallel };
+    visit(kernel);
+}
+
+void ScalarField::sampleLattice(const glm::vec3& origin, const glm::vec3& stepU, const glm::vec3& stepV,
+                                int countU, int countV, float* out, bool parallel) const {
+    if (countU <= 0 || countV <= 0) return;
+    LatticeKernel kernel = { dimensions, origin, stepU, stepV, countU, countV, out, parallel };
+    visit(kernel);
+}
+
+void ScalarField::getRange(float& minValue, float& maxValue) const {
+    minValue = maxValue = 0.0f;
+    if (storage.empty()) return;
+    RangeKernel kernel = { size(), 0.0f, 0.0f };
+    visit(kernel);
+    minValue = kernel.minValue;
+    maxValue = kernel.maxValue;
+}
+
+void ScalarField::getRange(const GridExtent& extent, float& minValue, float& maxValue) const {
+    GridExtent clipped = extent.resolve(dimensions);
+    if (clipped == GridExtent::whole(dimensions)) {
+        getRange(minValue, maxValue);
+        return;
+    }
+    minValue = maxValue = 0.0f;
+    if (storage.empty() || clipped.empty()) return;
+    ExtentRangeKernel kernel = { dimensions, clipped, 0.0f, 0.0f };
+    visit(kernel);
+    minValue = kernel.minValue;
+    maxValue = kernel.maxValue;
+}
+
+double ScalarField::getMean() const {
+    if (storage.empty()) return 0.0;
+    MeanKernel kernel = { size(), 0.0 };
+    visit(kernel);
+    return kernel.mean;
+}
+
+void ScalarField::toFloat(std::vector<float>& out) const {
+    out.resize(size());
+    ConvertKernel kernel = { size(), out.data() };
+    visit(kernel);
+}
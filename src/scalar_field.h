@@ -0,0 +1,113 @@
+#ifndef SCALAR_FIELD_H
+#define SCALAR_FIELD_H
+
+#include "raw_volume.h"
+#include <vector>
+#include <stdint.h>
+#include <glm/glm.hpp>
+
+// Axis-aligned block of grid points given by inclusive index bounds, like a
+// VTK extent. The default extent is empty and stands for "the whole grid".
+struct GridExtent {
+    glm::ivec3 first;
+    glm::ivec3 last; // Inclusive
+
+    GridExtent() : first(0), last(-1) {}
+    GridExtent(const glm::ivec3& first, const glm::ivec3& last) : first(first), last(last) {}
+    static GridExtent whole(const glm::ivec3& dims) { return GridExtent(glm::ivec3(0), dims - glm::ivec3(1)); }
+
+    bool empty() const { return glm::any(glm::lessThan(last, first)); }
+    glm::ivec3 dimensions() const { return last - first + glm::ivec3(1); }
+    size_t pointCount() const {
+        glm::ivec3 d = dimensions();
+        return empty() ? 0 : (size_t)d.x * d.y * d.z;
+    }
+    bool operator==(const GridExtent& o) const { return first == o.first && last == o.last; }
+    bool operator!=(const GridExtent& o) const { return !(*this == o); }
+
+    // This extent clipped to a grid of `dims`; an empty extent becomes the whole grid
+    GridExtent resolve(const glm::ivec3& dims) const {
+        if (empty()) return whole(dims);
+        return GridExtent(glm::max(first, glm::ivec3(0)), glm::min(last, dims - glm::ivec3(1)));
+    }
+};
+
+// A scalar field on a regular grid, kept in the element type it was stored
+// with (a uint8 CT scan stays one byte per voxel). Kernels that read it are
+// templates over the element type and are selected once per call by visit().
+class ScalarField {
+public:
+    ScalarField();
+    // Allocates a zero-filled field
+    ScalarField(VoxelType type, glm::ivec3 dims);
+
+    VoxelType getType() const { return type; }
+    const glm::ivec3& getDimensions() const { return dimensions; }
+    size_t size() const { return (size_t)dimensions.x * dimensions.y * dimensions.z; }
+    bool empty() const { return storage.empty(); }
+    size_t byteSize() const { return storage.size(); }
+
+    void* data() { return storage.data(); }
+    const void* data() const { return storage.data(); }
+    template <typename T> T* values() { return reinterpret_cast<T*>(storage.data()); }
+    template <typename T> const T* values() const { return reinterpret_cast<const T*>(storage.data()); }
+
+    // Calls visitor(values) with `values` typed as the field's element type
+    template <typename Visitor>
+    void visit(Visitor& visitor) const;
+
+    // Value of one voxel as float (convenient, but dispatches per call)
+    float valueAt(size_t index) const;
+
+    // Type-specific accessor for data(), looked up once. Suits hot loops that
+    // read a few voxels of a field other than the one being visited.
+    typedef float (*Reader)(const void* values, size_t index);
+    Reader reader() const;
+
+    // Trilinear interpolation at a grid-space coordinate, clamped to the grid
+    float sample(const glm::vec3& coord) const;
+
+    // Samples `count` grid-space points given as separate x/y/z arrays into
+    // `out`; matches sample() per point. Weights are computed four points at
+    // a time with SIMD, and large batches are split across the thread pool.
+    void sampleBatch(const float* x, const float* y, const float* z, size_t count, float* out,
+                     bool parallel = true) const;
+
+    // Samples the lattice origin + i * stepU + j * stepV (i < countU, j < countV)
+    // into out[j * countU + i]. Rows that step along one grid axis take a fast
+    // path: the weights of the two fixed axes are computed once per row.
+    void sampleLattice(const glm::vec3& origin, const glm::vec3& stepU, const glm::vec3& stepV,
+                       int countU, int countV, float* out, bool parallel = true) const;
+
+    // Smallest and largest value, computed in parallel
+    void getRange(float& minValue, float& maxValue) const;
+    // The same over a sub-extent only
+    void getRange(const GridExtent& extent, float& minValue, float& maxValue) const;
+
+    // Mean of all values, summed per chunk in double precision
+    double getMean() const;
+
+    // Copy of the values converted to float
+    void toFloat(std::vector<float>& out) const;
+
+private:
+    VoxelType type;
+    glm::ivec3 dimensions;
+    std::vector<unsigned char> storage;
+};
+
+template <typename Visitor>
+void ScalarField::visit(Visitor& visitor) const {
+    switch (type) {
+        case VoxelUInt8:   visitor(values<uint8_t>()); break;
+        case VoxelInt8:    visitor(values<int8_t>()); break;
+        case VoxelUInt16:  visitor(values<uint16_t>()); break;
+        case VoxelInt16:   visitor(values<int16_t>()); break;
+        case VoxelUInt32:  visitor(values<uint32_t>()); break;
+        case VoxelInt32:   visitor(values<int32_t>()); break;
+        case VoxelFloat32: visitor(values<float>()); break;
+        case VoxelFloat64: visitor(values<double>()); break;
+    }
+}
+
+#endif // SCALAR_FIELD_H
@@ -0,0 +1,148 @@
+#include "session_script.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+namespace {
+
+const int KEY_SPACE = 32; // GLFW_KEY_SPACE; printable GLFW key codes are ASCII
+
+std::string keyName(int key) {
+    if (key == KEY_SPACE) return "SPACE";
+    if (key > KEY_SPACE && key < 127) return std::string(1, (char)key);
+    std::ostringstream name;
+    name << key;
+    return name.str();
+}
+
+bool parseKey(const std::string& name, int& key) {
+    if (name == "SPACE") { key = KEY_SPACE; return true; }
+    if (name.size() == 1) {
+        key = std::toupper((unsigned char)name[0]);
+        return key > KEY_SPACE && key < 127;
+    }
+    std::istringstream in(name);
+    return (in >> key) && in.eof() && key > 0;
+}
+
+// Nearest-rank percentile of sorted values
+double percentile(const std::vector<double>& sorted, double p) {
+    size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+} // namespace
+
+SessionScript::SessionScript() : frameStep(1.0 / 60.0), frameCount(0) {}
+
+void SessionScript::addCameraPose(long frame, float yaw, float pitch, float zoom) {
+    SessionEvent event = { frame, SessionEvent::CameraPose, yaw, pitch, zoom, 0 };
+    events.push_back(event);
+}
+
+void SessionScript::addKeyPress(long frame, int key) {
+    SessionEvent event = { frame, SessionEvent::KeyPress, 0.0f, 0.0f, 0.0f, key };
+    events.push_back(event);
+}
+
+bool SessionScript::load(const std::string& path) {
+    std::ifstream file(path.c_str());
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open session script: " << path << std::endl;
+        return false;
+    }
+    frameStep = 1.0 / 60.0;
+    frameCount = 0;
+    events.clear();
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        ++lineNumber;
+        std::string::size_type comment = line.find('#');
+        if (comment != std::string::npos) line.erase(comment);
+        std::istringstream in(line);
+        std::string first, kind;
+        if (!(in >> first)) continue;
+
+        bool ok = true;
+        if (first == "step") {
+            ok = (in >> frameStep) && frameStep > 0.0;
+        } else if (first == "frames") {
+            ok = (in >> frameCount) && frameCount >= 0;
+        } else {
+            std::istringstream frameIn(first);
+            long frame = 0;
+            ok = (frameIn >> frame) && frameIn.eof() && frame >= 0 && (in >> kind) &&
+                 (events.empty() || frame >= events.back().frame);
+            if (ok && kind == "camera") {
+                float yaw, pitch, zoom;
+                ok = (bool)(in >> yaw >> pitch >> zoom);
+                if (ok) addCameraPose(frame, yaw, pitch, zoom);
+            } else if (ok && kind == "key") {
+                std::string name;
+                int key = 0;
+                ok = (in >> name) && parseKey(name, key);
+                if (ok) addKeyPress(frame, key);
+            } else {
+                ok = false;
+            }
+        }
+        std::string rest;
+        if (!ok || (in >> rest)) {
+            std::cerr << "Error: Bad line " << lineNumber << " in session script " << path << ": " << line << std::endl;
+            return false;
+        }
+    }
+    if (!events.empty()) frameCount = std::max(frameCount, events.back().frame + 1);
+    return true;
+}
+
+bool SessionScript::save(const std::string& path) const {
+    std::ofstream file(path.c_str());
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not create session script: " << path << std::endl;
+        return false;
+    }
+    file << "# Visualizer session: <frame> camera <yaw> <pitch> <zoom> | <frame> key <key>" << std::endl;
+    file << std::setprecision(std::numeric_limits<double>::max_digits10);
+    file << "step " << frameStep << std::endl;
+    file << "frames " << frameCount << std::endl;
+    file << std::setprecision(std::numeric_limits<float>::max_digits10);
+    for (size_t i = 0; i < events.size(); ++i) {
+        const SessionEvent& e = events[i];
+        if (e.kind == SessionEvent::CameraPose) {
+            file << e.frame << " camera " << e.yaw << " " << e.pitch << " " << e.zoom << std::endl;
+        } else {
+            file << e.frame << " key " << keyName(e.key) << std::endl;
+        }
+    }
+    return (bool)file;
+}
+
+void FrameTimeStats::add(const std::string& mode, double milliseconds) {
+    for (size_t i = 0; i < modes.size(); ++i) {
+        if (modes[i].first == mode) {
+            modes[i].second.push_back(milliseconds);
+            return;
+        }
+    }
+    modes.push_back(std::make_pair(mode, std::vector<double>(1, milliseconds)));
+}
+
+void FrameTimeStats::print(std::ostream& out) const {
+    out << "mode,frames,mean_ms,p50_ms,p90_ms,p99_ms,max_ms" << std::endl;
+    for (size_t i = 0; i < modes.size(); ++i) {
+        std::vector<double> sorted = modes[i].second;
+        std::sort(sorted.begin(), sorted.end());
+        double sum = 0.0;
+        for (size_t k = 0; k < sorted.size(); ++k) sum += sorted[k];
+        out << modes[i].first << "," << sorted.size() << "," << sum / sorted.size() << ","
+            << percentile(sorted, 50.0) << "," << percentile(sorted, 90.0) << ","
+            << percentile(sorted, 99.0) << "," << sorted.back() << std::endl;
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef SESSION_SCRIPT_H
+#define SESSION_SCRIPT_H
+
+#include <iosfwd>
+#include <string>
+#include <utility>
+#include <vector>
+
+// One input of a recorded session, applied before frame `frame` is drawn
+struct SessionEvent {
+    enum Kind { CameraPose, KeyPress };
+
+    long frame;
+    Kind kind;
+    float yaw, pitch, zoom; // CameraPose
+    int key;                // KeyPress: GLFW key code
+};
+
+// Viewer input recorded against a simulated clock: every frame advances the
+// animation by the same step, so replaying the events at their frames
+// reproduces the session exactly. Saved as a small text file, one event per
+// line ("<frame> camera <yaw> <pitch> <zoom>" or "<frame> key <key>", keys
+// written as their character, SPACE, or the GLFW key code).
+class SessionScript {
+public:
+    SessionScript();
+
+    // Simulated seconds per frame (default 1/60)
+    double getFrameStep() const { return frameStep; }
+    void setFrameStep(double step) { frameStep = step; }
+    // Frames the recorded session lasted
+    long getFrameCount() const { return frameCount; }
+    void setFrameCount(long count) { frameCount = count; }
+
+    // Events are kept in frame order; add them with non-decreasing frames
+    void addCameraPose(long frame, float yaw, float pitch, float zoom);
+    void addKeyPress(long frame, int key);
+    const std::vector<SessionEvent>& getEvents() const { return events; }
+
+    // Errors go to std::cerr
+    bool load(const std::string& path);
+    bool save(const std::string& path) const;
+
+private:
+    double frameStep;
+    long frameCount;
+    std::vector<SessionEvent> events;
+};
+
+// Frame times grouped by viewer mode, reported as percentiles
+class FrameTimeStats {
+public:
+    void add(const std::string& mode, double milliseconds);
+    // One CSV row per mode, in the order the modes first appeared
+    void print(std::ostream& out) const;
+
+private:
+    std::vector<std::pair<std::string, std::vector<double>>> modes;
+};
+
+#endif // SESSION_SCRIPT_H
@@ -0,0 +1,270 @@
+#include "shader_manager.h"
+#include "shader_utils.h"
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+#include <stdint.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+namespace {
+
+const char BINARY_MAGIC[4] = { 'V', 'S', 'P', 'B' };
+const int MAX_INCLUDE_DEPTH = 8;
+
+// 64-bit FNV-1a, chained through `hash`
+uint64_t hashBytes(const std::string& bytes, uint64_t hash = 14695981039346656037ull) {
+    for (size_t i = 0; i < bytes.size(); ++i) {
+        hash ^= (unsigned char)bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::time_t modificationTime(const std::string& path) {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 ? info.st_mtime : 0;
+}
+
+void makeDirectory(const std::string& path) {
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
+std::string directoryOf(const std::string& path) {
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? "" : path.substr(0, slash + 1);
+}
+
+// Program restored from a cached binary; 0 if the file is missing, was built
+// from other sources or the driver rejects it
+GLuint loadBinary(const std::string& path, uint64_t key) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file) return 0;
+    char magic[4];
+    uint64_t fileKey = 0;
+    uint32_t format = 0;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&fileKey), sizeof(fileKey));
+    file.read(reinterpret_cast<char*>(&format), sizeof(format));
+    if (!file || std::memcmp(magic, BINARY_MAGIC, sizeof(magic)) != 0 || fileKey != key) return 0;
+    std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (binary.empty()) return 0;
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, format, binary.data(), (GLsizei)binary.size());
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (linked != GL_TRUE) {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+void saveBinary(GLuint program, const std::string& path, uint64_t key) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+    std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!file) return;
+    uint32_t format32 = format;
+    file.write(BINARY_MAGIC, sizeof(BINARY_MAGIC));
+    file.write(reinterpret_cast<const char*>(&key), sizeof(key));
+    file.write(reinterpret_cast<const char*>(&format32), sizeof(format32));
+    file.write(binary.data(), length);
+}
+
+} // namespace
+
+void ShaderProgram::setSampler(const std::string& samplerName, GLint unit) {
+    bool found = false;
+    for (size_t i = 0; i < samplers.size(); ++i) {
+        if (samplers[i].first == samplerName) {
+            samplers[i].second = unit;
+            found = true;
+        }
+    }
+    if (!found) samplers.push_back(std::make_pair(samplerName, unit));
+    if (program) {
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, samplerName.c_str()), unit);
+    }
+}
+
+void ShaderProgram::resolve() {
+    for (size_t i = 0; i < uniformNames.size(); ++i) {
+        locations[i] = glGetUniformLocation(program, uniformNames[i].c_str());
+    }
+    GLuint block = glGetUniformBlockIndex(program, "Frame");
+    if (block != GL_INVALID_INDEX) glUniformBlockBinding(program, block, FRAME_UNIFORMS_BINDING);
+    if (!samplers.empty()) {
+        glUseProgram(program);
+        for (size_t i = 0; i < samplers.size(); ++i) {
+            glUniform1i(glGetUniformLocation(program, samplers[i].first.c_str()), samplers[i].second);
+        }
+    }
+}
+
+ShaderManager::ShaderManager(const std::string& cacheDirectory)
+    : cacheDirectory(cacheDirectory), binaryCache(false), frameBuffer(0) {
+    stats.fromCache = stats.compiled = 0;
+    stats.seconds = 0.0;
+
+    // A binary is only valid for the driver that produced it
+    const char* strings[3] = {
+        reinterpret_cast<const char*>(glGetString(GL_VENDOR)),
+        reinterpret_cast<const char*>(glGetString(GL_RENDERER)),
+        reinterpret_cast<const char*>(glGetString(GL_VERSION))
+    };
+    for (int i = 0; i < 3; ++i) {
+        driver += strings[i] ? strings[i] : "";
+        driver += '\n';
+    }
+    if (!cacheDirectory.empty() && (GLEW_ARB_get_program_binary || GLEW_VERSION_4_1)) {
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        binaryCache = formats > 0;
+    }
+    if (binaryCache) makeDirectory(cacheDirectory);
+
+    glGenBuffers(1, &frameBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, frameBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, frameBuffer);
+}
+
+ShaderManager::~ShaderManager() {
+    for (size_t i = 0; i < programs.size(); ++i) glDeleteProgram(programs[i]->program);
+    glDeleteBuffers(1, &frameBuffer);
+}
+
+ShaderProgram* ShaderManager::load(const std::string& name, const std::string& vsPath, const std::string& gsPath,
+                                   const std::string& fsPath) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::unique_ptr<ShaderProgram> shader(new ShaderProgram());
+    shader->name = name;
+    shader->stagePaths.push_back(vsPath);
+    shader->stagePaths.push_back(gsPath);
+    shader->stagePaths.push_back(fsPath);
+    shader->program = build(*shader);
+    stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!shader->program) {
+        std::cerr << "Error: Could not build shader program '" << name << "'." << std::endl;
+        return nullptr;
+    }
+    shader->resolve();
+    programs.push_back(std::move(shader));
+    return programs.back().get();
+}
+
+GLuint ShaderManager::build(ShaderProgram& shader) {
+    static const GLenum stageTypes[3] = { GL_VERTEX_SHADER, GL_GEOMETRY_SHADER, GL_FRAGMENT_SHADER };
+    static const char* stageNames[3] = { "vertex", "geometry", "fragment" };
+    std::vector<std::pair<std::string, std::time_t>> files;
+    std::string sources[3];
+    uint64_t key = hashBytes(driver);
+    for (int i = 0; i < 3; ++i) {
+        if (shader.stagePaths[i].empty()) continue;
+        if (!expandSource(shader.stagePaths[i], 0, sources[i], files)) return 0;
+        key = hashBytes(std::string(stageNames[i]) + '\n' + sources[i], key);
+    }
+    std::string cachePath = cacheDirectory + "/" + shader.name + ".bin";
+
+    GLuint program = binaryCache ? loadBinary(cachePath, key) : 0;
+    if (program) {
+        ++stats.fromCache;
+    } else {
+        program = glCreateProgram();
+        if (binaryCache) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        GLuint stages[3] = { 0, 0, 0 };
+        bool compiled = true;
+        for (int i = 0; i < 3 && compiled; ++i) {
+            if (sources[i].empty()) continue;
+            stages[i] = compileShader(stageTypes[i], sources[i], stageNames[i]);
+            if (stages[i]) glAttachShader(program, stages[i]);
+            else compiled = false;
+        }
+        if (compiled) glLinkProgram(program);
+        for (int i = 0; i < 3; ++i) {
+            if (stages[i]) glDeleteShader(stages[i]);
+        }
+        if (!compiled || !checkLinkStatus(program)) {
+            glDeleteProgram(program);
+            return 0;
+        }
+        if (binaryCache) saveBinary(program, cachePath, key);
+        ++stats.compiled;
+    }
+    shader.files.swap(files);
+    return program;
+}
+
+bool ShaderManager::expandSource(const std::string& path, int depth, std::string& out,
+                                 std::vector<std::pair<std::string, std::time_t>>& files) const {
+    std::string source = loadShaderSource(path);
+    if (source.empty()) return false;
+    files.push_back(std::make_pair(path, modificationTime(path)));
+
+    std::istringstream lines(source);
+    std::string line;
+    while (std::getline(lines, line)) {
+        size_t first = line.find_first_not_of(" \t");
+        if (first == std::string::npos || line.compare(first, 8, "#include") != 0) {
+            out += line;
+            out += '\n';
+            continue;
+        }
+        size_t open = line.find('"', first), close = line.find('"', open + 1);
+        if (open == std::string::npos || close == std::string::npos || depth >= MAX_INCLUDE_DEPTH) {
+            std::cerr << "Error: Bad #include in " << path << ": " << line << std::endl;
+            return false;
+        }
+        if (!expandSource(directoryOf(path) + line.substr(open + 1, close - open - 1), depth + 1, out, files)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int ShaderManager::reloadChanged() {
+    int reloaded = 0;
+    for (size_t i = 0; i < programs.size(); ++i) {
+        ShaderProgram& shader = *programs[i];
+        bool changed = false;
+        for (size_t f = 0; f < shader.files.size(); ++f) {
+            std::time_t time = modificationTime(shader.files[f].first);
+            if (time != shader.files[f].second) {
+                shader.files[f].second = time; // A broken edit is retried on the next save only
+                changed = true;
+            }
+        }
+        if (!changed) continue;
+        GLuint program = build(shader);
+        if (!program) {
+            std::cerr << "Shader program '" << shader.name << "' failed to rebuild; keeping the previous version" << std::endl;
+            continue;
+        }
+        glDeleteProgram(shader.program);
+        shader.program = program;
+        shader.resolve();
+        std::cout << "Reloaded shader program '" << shader.name << "'" << std::endl;
+        ++reloaded;
+    }
+    return reloaded;
+}
+
+void ShaderManager::updateFrame(const FrameUniforms& frame) {
+    glBindBuffer(GL_UNIFORM_BUFFER, frameBuffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &frame);
+}
@@ -0,0 +1,149 @@
+#ifndef SHADER_MANAGER_H
+#define SHADER_MANAGER_H
+
+#include <ctime>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+// Per-frame values shared by every program through one uniform buffer.
+// Mirrors the Frame block in shaders/frame_uniforms.glsl (std140).
+struct FrameUniforms {
+    glm::mat4 viewProjection;
+    glm::mat4 view; // World to eye space
+};
+
+const GLuint FRAME_UNIFORMS_BINDING = 0;
+
+inline void setUniformValue(GLint location, float value) { glUniform1f(location, value); }
+inline void setUniformValue(GLint location, int value) { glUniform1i(location, value); }
+inline void setUniformValue(GLint location, bool value) { glUniform1i(location, value); }
+inline void setUniformValue(GLint location, GLuint value) { glUniform1ui(location, value); }
+inline void setUniformValue(GLint location, const glm::vec3& value) { glUniform3fv(location, 1, glm::value_ptr(value)); }
+inline void setUniformValue(GLint location, const glm::ivec3& value) { glUniform3iv(location, 1, glm::value_ptr(value)); }
+inline void setUniformValue(GLint location, const glm::mat3& value) { glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(value)); }
+inline void setUniformValue(GLint location, const glm::mat4& value) { glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value)); }
+inline void setUniformValues(GLint location, const float* values, GLsizei count) { glUniform1fv(location, count, values); }
+
+class ShaderProgram;
+
+// Typed handle to a uniform of one program. The location is looked up once
+// per link, so setting it costs no string lookup; a uniform the compiler
+// removed has location -1, which GL ignores. Requires the program in use.
+template <typename T>
+class Uniform {
+public:
+    Uniform() : program(nullptr), slot(0) {}
+    Uniform(const ShaderProgram* program, size_t slot) : program(program), slot(slot) {}
+
+    void set(const T& value) const;
+    void set(const T* values, GLsizei count) const; // Uniform arrays
+
+private:
+    const ShaderProgram* program;
+    size_t slot;
+};
+
+// A linked program and what it was built from. Its GL name changes when it is
+// reloaded; uniform handles and sampler units follow automatically.
+class ShaderProgram {
+public:
+    GLuint id() const { return program; }
+    const std::string& getName() const { return name; }
+    void use() const { glUseProgram(program); }
+
+    template <typename T>
+    Uniform<T> uniform(const std::string& uniformName) {
+        uniformNames.push_back(uniformName);
+        locations.push_back(program ? glGetUniformLocation(program, uniformName.c_str()) : -1);
+        return Uniform<T>(this, locations.size() - 1);
+    }
+
+    // Texture unit of a sampler uniform; set now and after every reload
+    void setSampler(const std::string& samplerName, GLint unit);
+
+    GLint location(size_t slot) const { return locations[slot]; }
+
+private:
+    friend class ShaderManager;
+    ShaderProgram() : program(0) {}
+
+    // Looks up uniform locations and sets samplers and the block binding after a (re)link
+    void resolve();
+
+    std::string name;
+    std::vector<std::string> stagePaths; // Vertex, geometry (may be empty), fragment
+    GLuint program;
+    std::vector<std::string> uniformNames;
+    std::vector<GLint> locations;
+    std::vector<std::pair<std::string, GLint>> samplers;
+    std::vector<std::pair<std::string, std::time_t>> files; // Every source read, with its modification time
+};
+
+template <typename T>
+void Uniform<T>::set(const T& value) const {
+    if (program) setUniformValue(program->location(slot), value);
+}
+
+template <typename T>
+void Uniform<T>::set(const T* values, GLsizei count) const {
+    if (program) setUniformValues(program->location(slot), values, count);
+}
+
+// Builds and owns the shader programs. Shader files may pull in shared code
+// with #include "file" (relative to the including file). Linked programs are
+// stored on disk with glGetProgramBinary, keyed by a hash of the expanded
+// sources and the GL vendor, renderer and version, so later starts skip
+// compilation until a shader or the driver changes. Also owns the per-frame
+// uniform buffer.
+class ShaderManager {
+public:
+    // Needs a current GL context
+    explicit ShaderManager(const std::string& cacheDirectory = ".shader_cache");
+    ~ShaderManager();
+
+    // Program from a vertex, optional geometry (empty path) and fragment
+    // shader; nullptr if it does not compile or link
+    ShaderProgram* load(const std::string& name, const std::string& vsPath, const std::string& gsPath,
+                        const std::string& fsPath);
+    ShaderProgram* load(const std::string& name, const std::string& vsPath, const std::string& fsPath) {
+        return load(name, vsPath, "", fsPath);
+    }
+
+    // Rebuilds programs whose source files changed since they were built. A
+    // program that fails to build keeps its previous version. Returns the
+    // number of programs replaced.
+    int reloadChanged();
+
+    // Uploads this frame's shared uniforms
+    void updateFrame(const FrameUniforms& frame);
+
+    struct Stats {
+        int fromCache;  // Programs restored from a binary
+        int compiled;   // Programs compiled from source
+        double seconds; // Time spent in load()
+    };
+    const Stats& getStats() const { return stats; }
+
+private:
+    ShaderManager(const ShaderManager&);
+    ShaderManager& operator=(const ShaderManager&);
+
+    // Links a new GL program for `shader`, from the binary cache if possible; 0 on failure
+    GLuint build(ShaderProgram& shader);
+    bool expandSource(const std::string& path, int depth, std::string& out,
+                      std::vector<std::pair<std::string, std::time_t>>& files) const;
+
+    std::string cacheDirectory;
+    bool binaryCache; // Driver supports program binaries
+    std::string driver;
+    std::vector<std::unique_ptr<ShaderProgram>> programs;
+    GLuint frameBuffer;
+    Stats stats;
+};
+
+#endif // SHADER_MANAGER_H
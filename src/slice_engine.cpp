@@ -0,0 +1,144 @@
+#include "slice_engine.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Slack when deciding whether a sample lies inside the region, in voxels
+const float INSIDE_EPSILON = 1e-3f;
+
+glm::vec3 boxCorner(const glm::vec3& lo, const glm::vec3& hi, int c) {
+    return glm::vec3((c & 1) ? hi.x : lo.x, (c & 2) ? hi.y : lo.y, (c & 4) ? hi.z : lo.z);
+}
+
+} // namespace
+
+SliceEngine::SliceEngine() : field(nullptr), sparseField(nullptr), spacing(1.0f) {}
+
+void SliceEngine::setField(const ScalarField* field, const glm::vec3& spacing, const GridExtent& extent) {
+    this->field = field;
+    this->sparseField = nullptr;
+    this->spacing = spacing;
+    this->extent = field ? extent.resolve(field->getDimensions()) : GridExtent();
+    invalidate();
+}
+
+void SliceEngine::setField(const SparseField* field, const glm::vec3& spacing, const GridExtent& extent) {
+    this->field = nullptr;
+    this->sparseField = field;
+    this->spacing = spacing;
+    this->extent = field ? extent.resolve(field->getDimensions()) : GridExtent();
+    invalidate();
+}
+
+void SliceEngine::invalidate() {
+    cache.clear();
+}
+
+const SliceImage& SliceEngine::slice(size_t slot, const SlicePlane& plane, bool* resampled) {
+    if (slot >= cache.size()) cache.resize(slot + 1);
+    CacheEntry& entry = cache[slot];
+    bool stale = !entry.valid || entry.plane != plane;
+    if (stale) {
+        resample(plane, entry.image);
+        entry.plane = plane;
+        entry.valid = true;
+    }
+    if (resampled) *resampled = stale;
+    return entry.image;
+}
+
+void SliceEngine::offsetRange(const glm::vec3& normal, float& minOffset, float& maxOffset) const {
+    glm::vec3 lo = glm::vec3(extent.first) * spacing, hi = glm::vec3(extent.last) * spacing;
+    minOffset = maxOffset = glm::dot(normal, lo);
+    for (int c = 1; c < 8; ++c) {
+        float d = glm::dot(normal, boxCorner(lo, hi, c));
+        minOffset = std::min(minOffset, d);
+        maxOffset = std::max(maxOffset, d);
+    }
+}
+
+void SliceEngine::layout(const SlicePlane& plane, SliceImage& image) const {
+    image.width = image.height = 0;
+    if (extent.empty()) return;
+    const glm::vec3& n = plane.normal;
+
+    // In-plane axes from the two grid axes least aligned with the normal, so an
+    // axis-aligned plane gets rows along x or y and columns along y or z
+    int k = 0;
+    for (int a = 1; a < 3; ++a) {
+        if (std::fabs(n[a]) > std::fabs(n[k])) k = a;
+    }
+    int a = (k + 1) % 3, b = (k + 2) % 3;
+    if (a > b) std::swap(a, b);
+    glm::vec3 ea(0.0f), eb(0.0f);
+    ea[a] = 1.0f;
+    eb[b] = 1.0f;
+    glm::vec3 u = glm::normalize(ea - n * n[a]);
+    glm::vec3 v = eb - n * n[b];
+    v = glm::normalize(v - u * glm::dot(v, u));
+
+    // One sample per voxel: the world length of a unit grid step along each axis
+    image.axisU = u;
+    image.axisV = v;
+    image.stepU = 1.0f / glm::length(u / spacing);
+    image.stepV = 1.0f / glm::length(v / spacing);
+
+    // Bounding rectangle of the region's corners projected into the plane
+    glm::vec3 lo = glm::vec3(extent.first) * spacing, hi = glm::vec3(extent.last) * spacing;
+    float uMin = glm::dot(lo, u), uMax = uMin, vMin = glm::dot(lo, v), vMax = vMin;
+    for (int c = 1; c < 8; ++c) {
+        glm::vec3 p = boxCorner(lo, hi, c);
+        uMin = std::min(uMin, glm::dot(p, u)); uMax = std::max(uMax, glm::dot(p, u));
+        vMin = std::min(vMin, glm::dot(p, v)); vMax = std::max(vMax, glm::dot(p, v));
+    }
+    image.width = (int)std::floor((uMax - uMin) / image.stepU + INSIDE_EPSILON) + 1;
+    image.height = (int)std::floor((vMax - vMin) / image.stepV + INSIDE_EPSILON) + 1;
+    image.corner = n * plane.offset + u * uMin + v * vMin;
+}
+
+void SliceEngine::resample(const SlicePlane& plane, SliceImage& image) const {
+    layout(plane, image);
+    image.values.assign((size_t)image.width * image.height, std::numeric_limits<float>::quiet_NaN());
+    if ((!field && !sparseField) || image.values.empty()) return;
+
+    // The lattice in grid coordinates: row j starts at origin + j * dv and steps by du
+    const glm::vec3 origin = image.corner / spacing;
+    const glm::vec3 du = image.axisU * image.stepU / spacing;
+    const glm::vec3 dv = image.axisV * image.stepV / spacing;
+    const glm::vec3 lo = glm::vec3(extent.first) - glm::vec3(INSIDE_EPSILON);
+    const glm::vec3 hi = glm::vec3(extent.last) + glm::vec3(INSIDE_EPSILON);
+    const int width = image.width;
+    float* values = image.values.data();
+
+    ThreadPool::instance().parallelFor(image.height, 8, [&](size_t rowBegin, size_t rowEnd) {
+        for (size_t j = rowBegin; j < rowEnd; ++j) {
+            glm::vec3 rowOrigin = origin + dv * (float)j;
+            // Clip the row to the region slab by slab; only the inside is sampled
+            float first = 0.0f, last = (float)(width - 1);
+            for (int axis = 0; axis < 3 && first <= last; ++axis) {
+                if (du[axis] == 0.0f) {
+                    if (rowOrigin[axis] < lo[axis] || rowOrigin[axis] > hi[axis]) last = -1.0f;
+                    continue;
+                }
+                float t0 = (lo[axis] - rowOrigin[axis]) / du[axis];
+                float t1 = (hi[axis] - rowOrigin[axis]) / du[axis];
+                if (t0 > t1) std::swap(t0, t1);
+                first = std::max(first, t0);
+                last = std::min(last, t1);
+            }
+            if (first > last) continue;
+            int iBegin = (int)std::ceil(first), iEnd = (int)std::floor(last);
+            if (iBegin > iEnd) continue;
+            if (field) {
+                field->sampleLattice(rowOrigin + du * (float)iBegin, du, dv, iEnd - iBegin + 1, 1,
+                                     values + j * width + iBegin, false);
+                continue;
+            }
+            glm::vec3 p = rowOrigin + du * (float)iBegin;
+            for (int i = iBegin; i <= iEnd; ++i, p += du) values[j * width + i] = sparseField->sample(p);
+        }
+    });
+}
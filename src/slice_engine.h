@@ -0,0 +1,78 @@
+#ifndef SLICE_ENGINE_H
+#define SLICE_ENGINE_H
+
+#include "scalar_field.h"
+#include "sparse_field.h"
+#include <vector>
+#include <glm/glm.hpp>
+
+// The plane dot(normal, p) = offset, with p in world units relative to grid point 0
+struct SlicePlane {
+    glm::vec3 normal; // Unit length
+    float offset;
+
+    SlicePlane() : normal(0.0f, 0.0f, 1.0f), offset(0.0f) {}
+    SlicePlane(const glm::vec3& normal, float offset) : normal(normal), offset(offset) {}
+
+    bool operator==(const SlicePlane& o) const { return normal == o.normal && offset == o.offset; }
+    bool operator!=(const SlicePlane& o) const { return !(*this == o); }
+};
+
+// A plane resampled on a regular 2D lattice. Sample (i, j) lies at
+// corner + axisU * (i * stepU) + axisV * (j * stepV); samples outside the
+// sliced region are NaN.
+struct SliceImage {
+    std::vector<float> values; // Row-major, width * height
+    int width, height;
+    glm::vec3 corner;       // World position of sample (0, 0)
+    glm::vec3 axisU, axisV; // Unit in-plane directions of rows and columns
+    float stepU, stepV;     // World distance between neighbouring samples
+
+    SliceImage() : width(0), height(0), stepU(0.0f), stepV(0.0f) {}
+};
+
+// Resamples arbitrary planes through a scalar field. For an axis-aligned
+// plane the lattice falls on grid points. Rows are clipped to the region
+// analytically, stepped incrementally and sampled in parallel, and every
+// plane on screen has a cache slot so unchanged planes are not resampled.
+class SliceEngine {
+public:
+    SliceEngine();
+
+    // Field and block of grid points that slices cover (empty = whole grid).
+    // Drops every cached image.
+    void setField(const ScalarField* field, const glm::vec3& spacing, const GridExtent& extent = GridExtent());
+    // The same for a tiled field, sampled point by point
+    void setField(const SparseField* field, const glm::vec3& spacing, const GridExtent& extent = GridExtent());
+
+    // Image of `plane` for cache slot `slot`, resampled only when the plane
+    // differs from the slot's previous one. `resampled` reports whether it was.
+    const SliceImage& slice(size_t slot, const SlicePlane& plane, bool* resampled = nullptr);
+
+    // Lattice of `plane` (everything but the values): the in-plane bounding
+    // rectangle of the region, one voxel per sample along each direction
+    void layout(const SlicePlane& plane, SliceImage& image) const;
+
+    // Offsets at which a plane with `normal` first and last touches the region
+    void offsetRange(const glm::vec3& normal, float& minOffset, float& maxOffset) const;
+
+    void invalidate();
+
+private:
+    struct CacheEntry {
+        SlicePlane plane;
+        SliceImage image;
+        bool valid;
+        CacheEntry() : valid(false) {}
+    };
+
+    void resample(const SlicePlane& plane, SliceImage& image) const;
+
+    const ScalarField* field;
+    const SparseField* sparseField; // Set instead of `field` for a tiled field
+    glm::vec3 spacing;
+    GridExtent extent; // Resolved against the field
+    std::vector<CacheEntry> cache;
+};
+
+#endif // SLICE_ENGINE_H
@@ -0,0 +1,241 @@
+#include "software_renderer.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdint.h>
+
+namespace {
+
+float edge(const glm::vec2& a, const glm::vec2& b, const glm::vec2& p) {
+    return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x);
+}
+
+// --- PNG container (stored deflate blocks) ---
+
+struct CrcTable {
+    uint32_t values[256];
+    CrcTable() {
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            values[n] = c;
+        }
+    }
+};
+
+uint32_t crc32(const unsigned char* data, size_t size) {
+    static const CrcTable table;
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i) crc = table.values[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+void appendBigEndian(std::vector<unsigned char>& out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) out.push_back((unsigned char)(value >> shift));
+}
+
+void writeChunk(std::ostream& out, const char* type, const std::vector<unsigned char>& data) {
+    std::vector<unsigned char> chunk;
+    appendBigEndian(chunk, (uint32_t)data.size());
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    appendBigEndian(chunk, crc32(chunk.data() + 4, chunk.size() - 4));
+    out.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+}
+
+bool writePng(std::ostream& out, int width, int height, const std::vector<unsigned char>& rgb) {
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    out.write(reinterpret_cast<const char*>(signature), 8);
+
+    std::vector<unsigned char> header;
+    appendBigEndian(header, (uint32_t)width);
+    appendBigEndian(header, (uint32_t)height);
+    const unsigned char format[5] = { 8, 2, 0, 0, 0 }; // 8-bit RGB, no interlace
+    header.insert(header.end(), format, format + 5);
+    writeChunk(out, "IHDR", header);
+
+    // Scanlines with filter type 0, wrapped in a zlib stream of stored blocks
+    size_t rowBytes = (size_t)width * 3;
+    std::vector<unsigned char> raw;
+    raw.reserve((rowBytes + 1) * height);
+    for (int y = 0; y < height; ++y) {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgb.begin() + y * rowBytes, rgb.begin() + (y + 1) * rowBytes);
+    }
+    std::vector<unsigned char> zlib;
+    zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+    const size_t maxBlock = 65535;
+    for (size_t offset = 0; offset < raw.size(); offset += maxBlock) {
+        size_t size = std::min(maxBlock, raw.size() - offset);
+        zlib.push_back(offset + size == raw.size() ? 1 : 0); // BFINAL, BTYPE = stored
+        zlib.push_back((unsigned char)size);
+        zlib.push_back((unsigned char)(size >> 8));
+        zlib.push_back((unsigned char)~size);
+        zlib.push_back((unsigned char)(~size >> 8));
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + size);
+    }
+    uint32_t a = 1, b = 0; // Adler-32
+    for (size_t i = 0; i < raw.size(); ++i) {
+        a = (a + raw[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    appendBigEndian(zlib, (b << 16) | a);
+    writeChunk(out, "IDAT", zlib);
+    writeChunk(out, "IEND", std::vector<unsigned char>());
+    return (bool)out;
+}
+
+} // namespace
+
+SoftwareRenderer::SoftwareRenderer(int width, int height)
+    : width(width), height(height), pixels((size_t)width * height * 3), depth((size_t)width * height, 1.0f),
+      viewProjection(1.0f), view(1.0f) {}
+
+void SoftwareRenderer::clear(const glm::vec3& color) {
+    for (size_t i = 0; i < depth.size(); ++i) {
+        for (int c = 0; c < 3; ++c) pixels[i * 3 + c] = (unsigned char)(glm::clamp(color[c], 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+    std::fill(depth.begin(), depth.end(), 1.0f);
+}
+
+void SoftwareRenderer::setCamera(const glm::mat4& viewProjection, const glm::mat4& view) {
+    this->viewProjection = viewProjection;
+    this->view = view;
+}
+
+void SoftwareRenderer::plot(int x, int y, float z, const glm::vec3& color) {
+    size_t i = (size_t)y * width + x;
+    depth[i] = z;
+    for (int c = 0; c < 3; ++c) pixels[i * 3 + c] = (unsigned char)(glm::clamp(color[c], 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+glm::vec3 SoftwareRenderer::colormapAt(float coordinate) const {
+    if (colormap.size() < 2) return colormap.empty() ? glm::vec3(coordinate) : colormap[0];
+    // Linear filtering between texel centres, clamped to the edges
+    float x = glm::clamp(coordinate * colormap.size() - 0.5f, 0.0f, (float)(colormap.size() - 1));
+    size_t i = std::min((size_t)x, colormap.size() - 2);
+    return glm::mix(colormap[i], colormap[i + 1], x - i);
+}
+
+template <typename FragmentShader>
+void SoftwareRenderer::drawTriangle(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c,
+                                    const FragmentShader& shade) {
+    const ClipVertex* v[3] = { &a, &b, &c };
+    glm::vec2 screen[3];
+    float z[3], invW[3];
+    for (int k = 0; k < 3; ++k) {
+        const glm::vec4& p = v[k]->position;
+        if (p.w <= 0.0f || p.z < -p.w) return;
+        invW[k] = 1.0f / p.w;
+        screen[k] = glm::vec2((p.x * invW[k] * 0.5f + 0.5f) * width, (0.5f - p.y * invW[k] * 0.5f) * height);
+        z[k] = p.z * invW[k] * 0.5f + 0.5f;
+    }
+    float area = edge(screen[0], screen[1], screen[2]);
+    if (std::abs(area) < 1e-12f) return;
+
+    glm::vec2 lower = glm::min(screen[0], glm::min(screen[1], screen[2]));
+    glm::vec2 upper = glm::max(screen[0], glm::max(screen[1], screen[2]));
+    int x0 = std::max(0, (int)std::floor(lower.x)), x1 = std::min(width - 1, (int)std::ceil(upper.x));
+    int y0 = std::max(0, (int)std::floor(lower.y)), y1 = std::min(height - 1, (int)std::ceil(upper.y));
+    for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+            glm::vec2 p(x + 0.5f, y + 0.5f);
+            float w0 = edge(screen[1], screen[2], p) / area;
+            float w1 = edge(screen[2], screen[0], p) / area;
+            float w2 = edge(screen[0], screen[1], p) / area;
+            if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) continue;
+            float fragmentDepth = w0 * z[0] + w1 * z[1] + w2 * z[2];
+            if (fragmentDepth > 1.0f || fragmentDepth >= depth[(size_t)y * width + x]) continue;
+            // Perspective-correct interpolation through 1/w
+            float q0 = w0 * invW[0], q1 = w1 * invW[1], q2 = w2 * invW[2];
+            glm::vec4 attributes = (q0 * a.attributes + q1 * b.attributes + q2 * c.attributes) / (q0 + q1 + q2);
+            glm::vec3 color;
+            if (shade(attributes, color)) plot(x, y, fragmentDepth, color);
+        }
+    }
+}
+
+void SoftwareRenderer::drawLines(const std::vector<glm::vec3>& points, const glm::mat4& model, const glm::vec3& color) {
+    glm::mat4 transform = viewProjection * model;
+    for (size_t i = 0; i + 1 < points.size(); i += 2) {
+        glm::vec4 a = transform * glm::vec4(points[i], 1.0f);
+        glm::vec4 b = transform * glm::vec4(points[i + 1], 1.0f);
+        if (a.w <= 0.0f || b.w <= 0.0f || a.z < -a.w || b.z < -b.w) continue;
+        glm::vec3 sa((a.x / a.w * 0.5f + 0.5f) * width, (0.5f - a.y / a.w * 0.5f) * height, a.z / a.w * 0.5f + 0.5f);
+        glm::vec3 sb((b.x / b.w * 0.5f + 0.5f) * width, (0.5f - b.y / b.w * 0.5f) * height, b.z / b.w * 0.5f + 0.5f);
+        int steps = (int)std::ceil(std::max(std::abs(sb.x - sa.x), std::abs(sb.y - sa.y)));
+        for (int s = 0; s <= steps; ++s) {
+            glm::vec3 p = steps > 0 ? glm::mix(sa, sb, (float)s / steps) : sa;
+            int x = (int)std::floor(p.x), y = (int)std::floor(p.y);
+            if (x < 0 || y < 0 || x >= width || y >= height || p.z > 1.0f) continue;
+            if (p.z < depth[(size_t)y * width + x]) plot(x, y, p.z, color);
+        }
+    }
+}
+
+void SoftwareRenderer::drawSurface(const std::vector<Vertex>& vertices, const glm::mat4& model) {
+    glm::mat4 transform = viewProjection * model;
+    glm::mat3 normalToView(view);
+    // mc_cpu_frag.glsl: colormap at the scalar, lit by a headlight from either side
+    auto shade = [this](const glm::vec4& attributes, glm::vec3& color) {
+        glm::vec3 normal(attributes);
+        float length = glm::length(normal);
+        float diffuse = length > 0.0f ? std::abs(normal.z / length) : 0.0f;
+        color = colormapAt(attributes.w) * (0.25f + 0.75f * diffuse);
+        return true;
+    };
+    for (size_t i = 0; i + 2 < vertices.size(); i += 3) {
+        ClipVertex corners[3];
+        for (int k = 0; k < 3; ++k) {
+            const Vertex& vertex = vertices[i + k];
+            corners[k].position = transform * glm::vec4(vertex.getPosition(), 1.0f);
+            corners[k].attributes = glm::vec4(normalToView * vertex.getNormal(), vertex.getScalar());
+        }
+        drawTriangle(corners[0], corners[1], corners[2], shade);
+    }
+}
+
+void SoftwareRenderer::drawSlice(const SliceImage& image, float minValue, float maxValue, const glm::mat4& model) {
+    if (image.width < 1 || image.height < 1 || image.values.size() < (size_t)image.width * image.height) return;
+    float range = maxValue > minValue ? maxValue - minValue : 1.0f;
+    // Texel lookup of the slice texture: bilinear inside the region, nearest at its NaN border
+    auto shade = [&](const glm::vec4& attributes, glm::vec3& color) {
+        float u = glm::clamp(attributes.x, 0.0f, (float)(image.width - 1));
+        float v = glm::clamp(attributes.y, 0.0f, (float)(image.height - 1));
+        int i = std::min((int)u, std::max(image.width - 2, 0)), j = std::min((int)v, std::max(image.height - 2, 0));
+        int i1 = std::min(i + 1, image.width - 1), j1 = std::min(j + 1, image.height - 1);
+        float fu = u - i, fv = v - j;
+        const float* row0 = &image.values[(size_t)j * image.width];
+        const float* row1 = &image.values[(size_t)j1 * image.width];
+        float value = (1.0f - fv) * ((1.0f - fu) * row0[i] + fu * row0[i1]) + fv * ((1.0f - fu) * row1[i] + fu * row1[i1]);
+        if (value != value) {
+            value = image.values[(size_t)(v + 0.5f) * image.width + (int)(u + 0.5f)];
+            if (value != value) return false;
+        }
+        color = colormapAt((value - minValue) / range);
+        return true;
+    };
+    glm::vec3 edgeU = image.axisU * (image.stepU * (image.width - 1));
+    glm::vec3 edgeV = image.axisV * (image.stepV * (image.height - 1));
+    glm::mat4 transform = viewProjection * model;
+    ClipVertex corners[4];
+    for (int k = 0; k < 4; ++k) {
+        float s = (k == 1 || k == 2) ? 1.0f : 0.0f, t = (k >= 2) ? 1.0f : 0.0f;
+        corners[k].position = transform * glm::vec4(image.corner + s * edgeU + t * edgeV, 1.0f);
+        corners[k].attributes = glm::vec4(s * (image.width - 1), t * (image.height - 1), 0.0f, 0.0f);
+    }
+    drawTriangle(corners[0], corners[1], corners[2], shade);
+    drawTriangle(corners[0], corners[2], corners[3], shade);
+}
+
+bool writeImage(const std::string& path, int width, int height, const std::vector<unsigned char>& rgb) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) return false;
+    bool png = path.size() >= 4 && path.compare(path.size() - 4, 4, ".png") == 0;
+    if (png) return writePng(out, width, height, rgb);
+    out << "P6\n" << width << " " << height << "\n255\n";
+    out.write(reinterpret_cast<const char*>(rgb.data()), rgb.size());
+    return (bool)out;
+}
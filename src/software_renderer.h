@@ -0,0 +1,65 @@
+#ifndef SOFTWARE_RENDERER_H
+#define SOFTWARE_RENDERER_H
+
+#include "marching_cubes.h"
+#include "slice_engine.h"
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Depth-buffered rasterizer that draws what the viewer's shaders draw (box
+// lines, colormapped slices, headlight-shaded isosurfaces) into an RGB image
+// on the CPU, so frames can be rendered without a display or a GL context.
+// One renderer draws one image on the calling thread; render several frames
+// at once with one renderer each.
+class SoftwareRenderer {
+public:
+    SoftwareRenderer(int width, int height);
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    // Row-major RGB8, top row first
+    const std::vector<unsigned char>& getPixels() const { return pixels; }
+
+    void clear(const glm::vec3& color);
+    // Camera for the following draws, as in FrameUniforms
+    void setCamera(const glm::mat4& viewProjection, const glm::mat4& view);
+    // Colormap used by drawSurface and drawSlice, sampled like a 1D texture
+    void setColormap(const std::vector<glm::vec3>& colormap) { this->colormap = colormap; }
+
+    // GL_LINES: every two points make a segment
+    void drawLines(const std::vector<glm::vec3>& points, const glm::mat4& model, const glm::vec3& color);
+    // Triangles of compact vertices (mc_cpu shaders): colormap coordinate with
+    // a two-sided headlight
+    void drawSurface(const std::vector<Vertex>& vertices, const glm::mat4& model);
+    // The slice lattice drawn in place, values mapped from [minValue, maxValue]
+    // to the colormap and filtered bilinearly; NaN samples stay transparent.
+    // `model` maps world positions relative to grid point 0 to the scene.
+    void drawSlice(const SliceImage& image, float minValue, float maxValue, const glm::mat4& model);
+
+private:
+    struct ClipVertex {
+        glm::vec4 position;   // Clip space
+        glm::vec4 attributes; // Interpolated for the fragment shader
+    };
+
+    // Rasterizes one triangle with perspective-correct attributes; `shade`
+    // turns them into a colour or returns false to discard the fragment.
+    // Triangles reaching behind the near plane are skipped rather than clipped.
+    template <typename FragmentShader>
+    void drawTriangle(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c, const FragmentShader& shade);
+    glm::vec3 colormapAt(float coordinate) const;
+    void plot(int x, int y, float depth, const glm::vec3& color);
+
+    int width, height;
+    std::vector<unsigned char> pixels;
+    std::vector<float> depth; // NDC depth, 1 = far
+    glm::mat4 viewProjection, view;
+    std::vector<glm::vec3> colormap;
+};
+
+// Writes RGB8 pixels (top row first) as binary PPM, or as PNG when `path`
+// ends in ".png". PNG data is stored uncompressed, so no zlib is needed.
+bool writeImage(const std::string& path, int width, int height, const std::vector<unsigned char>& rgb);
+
+#endif // SOFTWARE_RENDERER_H
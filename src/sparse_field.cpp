@@ -0,0 +1,325 @@
+#include "sparse_field.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+const int SparseField::TILE_SIZE;
+const int SparseField::TILE_POINTS;
+const uint32_t SparseField::CONSTANT_TILE;
+
+namespace {
+
+const size_t TILE_GRAIN = 16;
+
+glm::ivec3 tileCoord(size_t index, const glm::ivec3& count) {
+    return glm::ivec3((int)(index % count.x), (int)((index / count.x) % count.y), (int)(index / ((size_t)count.x * count.y)));
+}
+
+// Offset of a grid point inside its tile's block of values
+inline size_t tileOffset(int x, int y, int z) {
+    const int s = SparseField::TILE_SIZE;
+    return ((size_t)(z % s) * s + (y % s)) * s + (x % s);
+}
+
+} // namespace
+
+struct SparseField::BuildKernel {
+    SparseField& field;
+
+    template <typename T> void operator()(const T* v) {
+        glm::ivec3 dims = field.dimensions;
+        size_t tileTotal = field.tiles.size();
+        T* constantValues = field.constants.values<T>();
+        std::vector<unsigned char> uniform(tileTotal, 0);
+
+        // Classify each tile and record its range
+        ThreadPool::instance().parallelFor(tileTotal, TILE_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t t = begin; t < end; ++t) {
+                GridExtent ext = field.tileExtent(tileCoord(t, field.tileCount));
+                T first = v[((size_t)ext.first.z * dims.y + ext.first.y) * dims.x + ext.first.x];
+                float lo = std::numeric_limits<float>::infinity(), hi = -lo;
+                bool same = true, nan = false;
+                for (int z = ext.first.z; z <= ext.last.z; ++z) {
+                    for (int y = ext.first.y; y <= ext.last.y; ++y) {
+                        const T* row = v + ((size_t)z * dims.y + y) * dims.x;
+                        for (int x = ext.first.x; x <= ext.last.x; ++x) {
+                            T value = row[x];
+                            if (same && std::memcmp(&value, &first, sizeof(T)) != 0) same = false;
+                            if (value != value) { nan = true; continue; }
+                            lo = std::min(lo, (float)value);
+                            hi = std::max(hi, (float)value);
+                        }
+                    }
+                }
+                constantValues[t] = first;
+                uniform[t] = same;
+                field.tileMin[t] = lo;
+                field.tileMax[t] = hi;
+                field.tileNaN[t] = nan;
+            }
+        });
+
+        // Number the tiles that keep their values, in tile order
+        size_t denseCount = 0;
+        for (size_t t = 0; t < tileTotal; ++t) {
+            field.tiles[t] = uniform[t] ? CONSTANT_TILE : (uint32_t)denseCount++;
+        }
+        field.denseTileCount = denseCount;
+        field.denseTiles = ScalarField(field.type, glm::ivec3(TILE_POINTS, (int)denseCount, 1));
+        T* blocks = field.denseTiles.values<T>();
+
+        // Copy them; points past the grid's far faces repeat the tile's first value
+        ThreadPool::instance().parallelFor(tileTotal, TILE_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t t = begin; t < end; ++t) {
+                if (field.tiles[t] == CONSTANT_TILE) continue;
+                T* block = blocks + (size_t)field.tiles[t] * TILE_POINTS;
+                std::fill(block, block + TILE_POINTS, constantValues[t]);
+                GridExtent ext = field.tileExtent(tileCoord(t, field.tileCount));
+                for (int z = ext.first.z; z <= ext.last.z; ++z) {
+                    for (int y = ext.first.y; y <= ext.last.y; ++y) {
+                        const T* row = v + ((size_t)z * dims.y + y) * dims.x;
+                        std::copy(row + ext.first.x, row + ext.last.x + 1, block + tileOffset(ext.first.x, y, z));
+                    }
+                }
+            }
+        });
+    }
+};
+
+struct SparseField::ExpandKernel {
+    const SparseField& field;
+    void* out;
+
+    template <typename T> void operator()(const T* constantValues) {
+        glm::ivec3 dims = field.dimensions;
+        T* dense = static_cast<T*>(out);
+        const T* blocks = field.denseTiles.values<T>();
+        ThreadPool::instance().parallelFor(field.tiles.size(), TILE_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t t = begin; t < end; ++t) {
+                GridExtent ext = field.tileExtent(tileCoord(t, field.tileCount));
+                const T* block = field.tiles[t] == CONSTANT_TILE ? nullptr : blocks + (size_t)field.tiles[t] * TILE_POINTS;
+                for (int z = ext.first.z; z <= ext.last.z; ++z) {
+                    for (int y = ext.first.y; y <= ext.last.y; ++y) {
+                        T* row = dense + ((size_t)z * dims.y + y) * dims.x;
+                        if (block) {
+                            const T* src = block + tileOffset(ext.first.x, y, z);
+                            std::copy(src, src + (ext.last.x - ext.first.x + 1), row + ext.first.x);
+                        } else {
+                            std::fill(row + ext.first.x, row + ext.last.x + 1, constantValues[t]);
+                        }
+                    }
+                }
+            }
+        });
+    }
+};
+
+struct SparseField::BlockKernel {
+    const SparseField& field;
+    GridExtent extent;
+    float* out;
+
+    template <typename T> void operator()(const T* constantValues) {
+        const T* blocks = field.denseTiles.values<T>();
+        glm::ivec3 size = extent.dimensions();
+        glm::ivec3 tileFirst = extent.first / TILE_SIZE, tileLast = extent.last / TILE_SIZE;
+        for (int tz = tileFirst.z; tz <= tileLast.z; ++tz) {
+            for (int ty = tileFirst.y; ty <= tileLast.y; ++ty) {
+                for (int tx = tileFirst.x; tx <= tileLast.x; ++tx) {
+                    glm::ivec3 tile(tx, ty, tz);
+                    size_t t = field.tileIndex(tile);
+                    glm::ivec3 first = glm::max(tile * TILE_SIZE, extent.first);
+                    glm::ivec3 last = glm::min(tile * TILE_SIZE + glm::ivec3(TILE_SIZE - 1), extent.last);
+                    int count = last.x - first.x + 1;
+                    const T* block = field.tiles[t] == CONSTANT_TILE ? nullptr : blocks + (size_t)field.tiles[t] * TILE_POINTS;
+                    for (int z = first.z; z <= last.z; ++z) {
+                        for (int y = first.y; y <= last.y; ++y) {
+                            float* row = out + ((size_t)(z - extent.first.z) * size.y + (y - extent.first.y)) * size.x
+                                             + (first.x - extent.first.x);
+                            if (block) {
+                                const T* src = block + tileOffset(first.x, y, z);
+                                for (int i = 0; i < count; ++i) row[i] = (float)src[i];
+                            } else {
+                                std::fill(row, row + count, (float)constantValues[t]);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+};
+
+SparseField::SparseField() : type(VoxelFloat32), dimensions(0), tileCount(0), denseTileCount(0), read(nullptr) {}
+
+SparseField::SparseField(const ScalarField& dense)
+    : type(dense.getType()), dimensions(dense.getDimensions()), tileCount(0), denseTileCount(0), read(nullptr) {
+    if (dense.empty()) return;
+    tileCount = (dimensions + glm::ivec3(TILE_SIZE - 1)) / TILE_SIZE;
+    size_t tileTotal = (size_t)tileCount.x * tileCount.y * tileCount.z;
+    tiles.assign(tileTotal, CONSTANT_TILE);
+    tileMin.resize(tileTotal);
+    tileMax.resize(tileTotal);
+    tileNaN.resize(tileTotal);
+    constants = ScalarField(type, glm::ivec3((int)tileTotal, 1, 1));
+    BuildKernel kernel = { *this };
+    dense.visit(kernel);
+    read = constants.reader();
+}
+
+void SparseField::toDense(ScalarField& out) const {
+    if (out.getType() != type || out.getDimensions() != dimensions) out = ScalarField(type, dimensions);
+    if (tiles.empty()) return;
+    ExpandKernel kernel = { *this, out.data() };
+    constants.visit(kernel);
+}
+
+size_t SparseField::byteSize() const {
+    return constants.byteSize() + denseTiles.byteSize() + tiles.size() * sizeof(uint32_t)
+         + (tileMin.size() + tileMax.size()) * sizeof(float) + tileNaN.size();
+}
+
+GridExtent SparseField::tileExtent(const glm::ivec3& tile) const {
+    glm::ivec3 first = tile * TILE_SIZE;
+    return GridExtent(first, glm::min(first + glm::ivec3(TILE_SIZE - 1), dimensions - glm::ivec3(1)));
+}
+
+void SparseField::getTileRange(const glm::ivec3& tile, float& minValue, float& maxValue) const {
+    size_t t = tileIndex(tile);
+    if (tileMin[t] > tileMax[t]) {
+        minValue = maxValue = std::numeric_limits<float>::quiet_NaN();
+        return;
+    }
+    minValue = tileMin[t];
+    maxValue = tileMax[t];
+}
+
+void SparseField::getCellBlockRange(const glm::ivec3& tile, float& minValue, float& maxValue) const {
+    minValue = std::numeric_limits<float>::infinity();
+    maxValue = -minValue;
+    glm::ivec3 last = glm::min(tile + glm::ivec3(1), tileCount - glm::ivec3(1));
+    for (int z = tile.z; z <= last.z; ++z) {
+        for (int y = tile.y; y <= last.y; ++y) {
+            for (int x = tile.x; x <= last.x; ++x) {
+                size_t t = tileIndex(glm::ivec3(x, y, z));
+                minValue = std::min(minValue, tileMin[t]);
+                maxValue = std::max(maxValue, tileNaN[t] ? std::numeric_limits<float>::infinity() : tileMax[t]);
+            }
+        }
+    }
+}
+
+float SparseField::valueAt(const glm::ivec3& p) const {
+    size_t t = tileIndex(p / TILE_SIZE);
+    if (tiles[t] == CONSTANT_TILE) return read(constants.data(), t);
+    return read(denseTiles.data(), (size_t)tiles[t] * TILE_POINTS + tileOffset(p.x, p.y, p.z));
+}
+
+float SparseField::sample(const glm::vec3& coord) const {
+    float x = glm::clamp(coord.x, 0.0f, (float)dimensions.x - 1.001f);
+    float y = glm::clamp(coord.y, 0.0f, (float)dimensions.y - 1.001f);
+    float z = glm::clamp(coord.z, 0.0f, (float)dimensions.z - 1.001f);
+
+    int x0 = (int)x, y0 = (int)y, z0 = (int)z;
+    float xd = x - x0, yd = y - y0, zd = z - z0;
+
+    float c00 = valueAt(glm::ivec3(x0, y0, z0)) * (1 - xd) + valueAt(glm::ivec3(x0 + 1, y0, z0)) * xd;
+    float c10 = valueAt(glm::ivec3(x0, y0 + 1, z0)) * (1 - xd) + valueAt(glm::ivec3(x0 + 1, y0 + 1, z0)) * xd;
+    float c01 = valueAt(glm::ivec3(x0, y0, z0 + 1)) * (1 - xd) + valueAt(glm::ivec3(x0 + 1, y0, z0 + 1)) * xd;
+    float c11 = valueAt(glm::ivec3(x0, y0 + 1, z0 + 1)) * (1 - xd) + valueAt(glm::ivec3(x0 + 1, y0 + 1, z0 + 1)) * xd;
+
+    float c0 = c00 * (1 - yd) + c10 * yd;
+    float c1 = c01 * (1 - yd) + c11 * yd;
+
+    return c0 * (1 - zd) + c1 * zd;
+}
+
+void SparseField::readBlock(const GridExtent& extent, float* out) const {
+    if (tiles.empty() || extent.empty()) return;
+    BlockKernel kernel = { *this, extent, out };
+    constants.visit(kernel);
+}
+
+void SparseField::getRange(float& minValue, float& maxValue) const {
+    minValue = maxValue = 0.0f;
+    if (tiles.empty()) return;
+    float lo = std::numeric_limits<float>::infinity(), hi = -lo;
+    for (size_t t = 0; t < tiles.size(); ++t) {
+        lo = std::min(lo, tileMin[t]);
+        hi = std::max(hi, tileMax[t]);
+    }
+    if (lo > hi) lo = hi = std::numeric_limits<float>::quiet_NaN(); // Every point is NaN
+    minValue = lo;
+    maxValue = hi;
+}
+
+void SparseField::getRange(const GridExtent& extent, float& minValue, float& maxValue) const {
+    GridExtent clipped = extent.resolve(dimensions);
+    if (clipped == GridExtent::whole(dimensions)) {
+        getRange(minValue, maxValue);
+        return;
+    }
+    minValue = maxValue = 0.0f;
+    if (tiles.empty() || clipped.empty()) return;
+    float lo = std::numeric_limits<float>::infinity(), hi = -lo;
+    glm::ivec3 tileFirst = clipped.first / TILE_SIZE, tileLast = clipped.last / TILE_SIZE;
+    for (int tz = tileFirst.z; tz <= tileLast.z; ++tz) {
+        for (int ty = tileFirst.y; ty <= tileLast.y; ++ty) {
+            for (int tx = tileFirst.x; tx <= tileLast.x; ++tx) {
+                glm::ivec3 tile(tx, ty, tz);
+                size_t t = tileIndex(tile);
+                GridExtent ext = tileExtent(tile);
+                glm::ivec3 first = glm::max(ext.first, clipped.first), last = glm::min(ext.last, clipped.last);
+                if (tiles[t] == CONSTANT_TILE || (first == ext.first && last == ext.last)) {
+                    lo = std::min(lo, tileMin[t]);
+                    hi = std::max(hi, tileMax[t]);
+                    continue;
+                }
+                size_t base = (size_t)tiles[t] * TILE_POINTS;
+                for (int z = first.z; z <= last.z; ++z) {
+                    for (int y = first.y; y <= last.y; ++y) {
+                        for (int x = first.x; x <= last.x; ++x) {
+                            float value = read(denseTiles.data(), base + tileOffset(x, y, z));
+                            if (value != value) continue;
+                            lo = std::min(lo, value);
+                            hi = std::max(hi, value);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    if (lo > hi) lo = hi = std::numeric_limits<float>::quiet_NaN(); // Every point is NaN
+    minValue = lo;
+    maxValue = hi;
+}
+
+double SparseField::getMean() const {
+    if (tiles.empty()) return 0.0;
+    size_t tileTotal = tiles.size();
+    size_t numChunks = (tileTotal + TILE_GRAIN - 1) / TILE_GRAIN;
+    std::vector<double> chunkSum(numChunks, 0.0);
+    ThreadPool::instance().parallelFor(tileTotal, TILE_GRAIN, [&](size_t begin, size_t end) {
+        double sum = 0.0;
+        for (size_t t = begin; t < end; ++t) {
+            GridExtent ext = tileExtent(tileCoord(t, tileCount));
+            if (tiles[t] == CONSTANT_TILE) {
+                sum += (double)read(constants.data(), t) * ext.pointCount();
+                continue;
+            }
+            size_t base = (size_t)tiles[t] * TILE_POINTS;
+            for (int z = ext.first.z; z <= ext.last.z; ++z) {
+                for (int y = ext.first.y; y <= ext.last.y; ++y) {
+                    size_t offset = base + tileOffset(ext.first.x, y, z);
+                    for (int x = ext.first.x; x <= ext.last.x; ++x) sum += (double)read(denseTiles.data(), offset++);
+                }
+            }
+        }
+        chunkSum[begin / TILE_GRAIN] = sum;
+    });
+    double sum = 0.0;
+    for (size_t i = 0; i < numChunks; ++i) sum += chunkSum[i];
+    size_t count = (size_t)dimensions.x * dimensions.y * dimensions.z;
+    return sum / count;
+}
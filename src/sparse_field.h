@@ -0,0 +1,87 @@
+#ifndef SPARSE_FIELD_H
+#define SPARSE_FIELD_H
+
+#include "scalar_field.h"
+#include <stdint.h>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Tiled copy of a ScalarField for fields that are mostly one background
+// value (land in masked ocean data, empty space around a segmentation). A
+// table with one entry per tile of TILE_SIZE^3 grid points leads either to a
+// single value, for tiles whose points are all equal, or to the tile's own
+// block of values. Values keep the dense field's element type, and every tile
+// records its value range, so range queries and extraction can pass over
+// tiles without reading them.
+class SparseField {
+public:
+    static const int TILE_SIZE = 8;
+    static const int TILE_POINTS = TILE_SIZE * TILE_SIZE * TILE_SIZE;
+
+    SparseField();
+    // Tiles `dense` in parallel. Points compare by their bytes, so a NaN
+    // background collapses too.
+    explicit SparseField(const ScalarField& dense);
+
+    // Expands into `out`, reallocated if its type or dimensions differ
+    void toDense(ScalarField& out) const;
+
+    VoxelType getType() const { return type; }
+    const glm::ivec3& getDimensions() const { return dimensions; }
+    const glm::ivec3& getTileCount() const { return tileCount; }
+    bool empty() const { return tiles.empty(); }
+    size_t getConstantTileCount() const { return tiles.size() - denseTileCount; }
+    size_t getDenseTileCount() const { return denseTileCount; }
+    // Bytes held for values, tile table and tile ranges
+    size_t byteSize() const;
+
+    // Grid points of `tile` (tile coordinates), clipped at the far faces
+    GridExtent tileExtent(const glm::ivec3& tile) const;
+    bool isConstantTile(const glm::ivec3& tile) const { return tiles[tileIndex(tile)] == CONSTANT_TILE; }
+    // Range of one tile, NaN points ignored (NaN, NaN if it holds no other value)
+    void getTileRange(const glm::ivec3& tile, float& minValue, float& maxValue) const;
+    // Bounds for the corners of the cells whose first corner lies in `tile`,
+    // from the tile and its neighbours towards +x, +y and +z. NaN points count
+    // as +infinity, as marching cubes classifies them above every isovalue.
+    void getCellBlockRange(const glm::ivec3& tile, float& minValue, float& maxValue) const;
+
+    // Value of one grid point
+    float valueAt(const glm::ivec3& p) const;
+    // Trilinear interpolation with the clamping and weights of ScalarField::sample
+    float sample(const glm::vec3& coord) const;
+    // Copies the points of `extent` (inside the grid) to `out` as float, x fastest
+    void readBlock(const GridExtent& extent, float* out) const;
+
+    // Range from the per-tile ranges without reading any values; NaN points
+    // are ignored
+    void getRange(float& minValue, float& maxValue) const;
+    // The same over a sub-extent; only tiles cut by its faces are read
+    void getRange(const GridExtent& extent, float& minValue, float& maxValue) const;
+    // Mean with each constant tile counted as value * points
+    double getMean() const;
+
+private:
+    static const uint32_t CONSTANT_TILE = 0xFFFFFFFFu;
+
+    size_t tileIndex(const glm::ivec3& tile) const {
+        return ((size_t)tile.z * tileCount.y + tile.y) * tileCount.x + tile.x;
+    }
+
+    VoxelType type;
+    glm::ivec3 dimensions;
+    glm::ivec3 tileCount;
+    std::vector<uint32_t> tiles;    // Per tile: block in denseTiles, or CONSTANT_TILE
+    std::vector<float> tileMin, tileMax;   // NaN points ignored; +inf/-inf if all NaN
+    std::vector<unsigned char> tileNaN;    // Per tile: holds NaN points
+    ScalarField constants;          // Per tile: its value if constant, else its first value
+    ScalarField denseTiles;         // TILE_POINTS values per non-constant tile, x fastest
+    size_t denseTileCount;
+    ScalarField::Reader read;
+
+    // Tiling, expansion and block copy loops, instantiated per element type
+    struct BuildKernel;
+    struct ExpandKernel;
+    struct BlockKernel;
+};
+
+#endif // SPARSE_FIELD_H
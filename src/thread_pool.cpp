@@ -0,0 +1,249 @@
+#include "thread_pool.h"
+#include <algorithm>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+ThreadPool::Options sharedOptions;
+
+// Which pool (if any) the current thread works for, and its worker index
+thread_local const ThreadPool* currentPool = nullptr;
+thread_local int currentIndex = -1;
+// Tasks running on this thread; tasks run while an outer one waits are nested
+thread_local int taskDepth = 0;
+
+} // namespace
+
+void ThreadPool::configure(const Options& options) {
+    sharedOptions = options;
+}
+
+ThreadPool& ThreadPool::instance() {
+    static ThreadPool pool(sharedOptions);
+    return pool;
+}
+
+ThreadPool::ThreadPool(const Options& options)
+    : pending(0), nextQueue(0), stopping(false), statsStart(std::chrono::steady_clock::now()) {
+    int threads = options.numThreads > 0 ? options.numThreads : (int)std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 0; i < threads - 1; ++i) workers.push_back(std::unique_ptr<Worker>(new Worker()));
+    for (int i = 0; i < (int)workers.size(); ++i) {
+        workers[i]->thread = std::thread(&ThreadPool::workerLoop, this, i, options.pinThreads);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (size_t i = 0; i < workers.size(); ++i) workers[i]->thread.join();
+}
+
+int ThreadPool::currentWorkerIndex() const {
+    return currentPool == this ? currentIndex : -1;
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    if (workers.empty()) { task(); return; }
+    int self = currentWorkerIndex();
+    int queue = self >= 0 ? self : (int)(nextQueue.fetch_add(1) % workers.size());
+    // Counted before it becomes visible, so a thief popping it at once can
+    // never take `pending` below zero
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        pending++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(workers[queue]->mutex);
+        workers[queue]->tasks.push_back(std::move(task));
+    }
+    wake.notify_one();
+}
+
+bool ThreadPool::popTask(int self, std::function<void()>& task, bool& wasStolen) {
+    // Own queue first, newest task (LIFO keeps nested work cache-warm)
+    if (self >= 0) {
+        Worker& own = *workers[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            pending--;
+            wasStolen = false;
+            return true;
+        }
+    }
+    // Steal the oldest task from another queue
+    int n = (int)workers.size();
+    int start = self >= 0 ? self + 1 : (int)(nextQueue.load() % n);
+    for (int k = 0; k < n; ++k) {
+        int victim = (start + k) % n;
+        if (victim == self) continue;
+        Worker& other = *workers[victim];
+        std::lock_guard<std::mutex> lock(other.mutex);
+        if (!other.tasks.empty()) {
+            task = std::move(other.tasks.front());
+            other.tasks.pop_front();
+            pending--;
+            wasStolen = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::runTask(int self, std::function<void()>& task, bool wasStolen) {
+    if (self < 0) { task(); return; }
+    Worker& w = *workers[self];
+    if (taskDepth > 0) {
+        // The outer task's timer already covers this one
+        ++taskDepth;
+        task();
+        --taskDepth;
+    } else {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        ++taskDepth;
+        task();
+        --taskDepth;
+        w.busyNanos += (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+    w.executed++;
+    if (wasStolen) w.stolen++;
+}
+
+bool ThreadPool::runPendingTask() {
+    if (workers.empty() || pending.load() == 0) return false;
+    int self = currentWorkerIndex();
+    std::function<void()> task;
+    bool wasStolen = false;
+    if (!popTask(self, task, wasStolen)) return false;
+    runTask(self, task, wasStolen);
+    return true;
+}
+
+void ThreadPool::workerLoop(int index, bool pin) {
+    currentPool = this;
+    currentIndex = index;
+#ifdef __linux__
+    if (pin) {
+        unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET((index + 1) % cores, &set); // Core 0 is left to the main thread
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+#else
+    (void)pin;
+#endif
+    for (;;) {
+        std::function<void()> task;
+        bool wasStolen = false;
+        if (popTask(index, task, wasStolen)) {
+            runTask(index, task, wasStolen);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this] { return stopping || pending.load() > 0; });
+        if (stopping) return;
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn,
+                             const CancellationToken* token) {
+    if (count == 0) return;
+    grain = std::max<size_t>(1, grain);
+    size_t numChunks = (count + grain - 1) / grain;
+    if (numChunks == 1 || workers.empty()) {
+        for (size_t c = 0; c < numChunks; ++c) {
+            if (token && token->isCancelled()) return;
+            fn(c * grain, std::min(count, (c + 1) * grain));
+        }
+        return;
+    }
+
+    // Chunks are handed out through a shared counter, so fast threads simply take more
+    std::atomic<size_t> nextChunk(0);
+    auto drain = [&]() {
+        for (;;) {
+            size_t c = nextChunk.fetch_add(1);
+            if (c >= numChunks) return;
+            if (token && token->isCancelled()) continue;
+            fn(c * grain, std::min(count, (c + 1) * grain));
+        }
+    };
+    TaskGroup group(*this);
+    size_t helpers = std::min(workers.size(), numChunks - 1);
+    for (size_t i = 0; i < helpers; ++i) group.run(drain);
+    drain();
+    group.wait();
+}
+
+void ThreadPool::parallelFor(const Range3D& range, glm::ivec3 grain, const std::function<void(const Range3D&)>& fn,
+                             const CancellationToken* token) {
+    glm::ivec3 extent = range.end - range.begin;
+    if (extent.x <= 0 || extent.y <= 0 || extent.z <= 0) return;
+    grain = glm::max(grain, glm::ivec3(1));
+    glm::ivec3 tiles = (extent + grain - glm::ivec3(1)) / grain;
+    size_t numTiles = (size_t)tiles.x * tiles.y * tiles.z;
+    parallelFor(numTiles, 1, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; ++t) {
+            glm::ivec3 tile((int)(t % tiles.x), (int)((t / tiles.x) % tiles.y), (int)(t / ((size_t)tiles.x * tiles.y)));
+            glm::ivec3 lo = range.begin + tile * grain;
+            fn(Range3D(lo, glm::min(lo + grain, range.end)));
+        }
+    }, token);
+}
+
+std::vector<WorkerStats> ThreadPool::getStats() const {
+    std::vector<WorkerStats> stats(workers.size());
+    for (size_t i = 0; i < workers.size(); ++i) {
+        stats[i].tasksExecuted = workers[i]->executed.load();
+        stats[i].tasksStolen = workers[i]->stolen.load();
+        stats[i].busySeconds = workers[i]->busyNanos.load() * 1e-9;
+    }
+    return stats;
+}
+
+double ThreadPool::getStatsWindowSeconds() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - statsStart).count();
+}
+
+void ThreadPool::resetStats() {
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers[i]->executed = 0;
+        workers[i]->stolen = 0;
+        workers[i]->busyNanos = 0;
+    }
+    statsStart = std::chrono::steady_clock::now();
+}
+
+TaskGroup::TaskGroup(ThreadPool& p, const CancellationToken* token)
+    : pool(p), externalToken(token), outstanding(0) {}
+
+TaskGroup::~TaskGroup() {
+    wait();
+}
+
+void TaskGroup::run(std::function<void()> task) {
+    outstanding++;
+    pool.submit([this, task]() {
+        if (!isCancelled()) task();
+        // Under the lock, so wait() cannot return and free the group while it is signalled
+        std::lock_guard<std::mutex> lock(doneMutex);
+        if (--outstanding == 0) done.notify_all();
+    });
+}
+
+void TaskGroup::wait() {
+    while (outstanding.load() > 0 && pool.runPendingTask()) {}
+    // Nothing left to help with: sleep until the tasks running elsewhere finish.
+    // Taking the lock also waits out a task still signalling, so the group can go.
+    std::unique_lock<std::mutex> lock(doneMutex);
+    done.wait(lock, [this] { return outstanding.load() == 0; });
+}
@@ -0,0 +1,134 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Cooperative cancellation flag shared between a caller and running tasks
+class CancellationToken {
+public:
+    CancellationToken() : cancelled(false) {}
+    void cancel() { cancelled.store(true, std::memory_order_relaxed); }
+    void reset() { cancelled.store(false, std::memory_order_relaxed); }
+    bool isCancelled() const { return cancelled.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<bool> cancelled;
+};
+
+// Half-open box of grid indices [begin, end) on each axis
+struct Range3D {
+    glm::ivec3 begin;
+    glm::ivec3 end;
+    Range3D() : begin(0), end(0) {}
+    Range3D(glm::ivec3 b, glm::ivec3 e) : begin(b), end(e) {}
+};
+
+// Per-worker counters since the last resetStats()
+struct WorkerStats {
+    unsigned long long tasksExecuted;
+    unsigned long long tasksStolen;
+    double busySeconds;
+};
+
+// Work-stealing thread pool shared by the parser, the extractors and the
+// slicer so that concurrent users never oversubscribe the machine. Each
+// worker owns a deque: it pops its own newest task and steals the oldest
+// task of another worker when idle. Threads that wait on work help run it.
+class ThreadPool {
+public:
+    struct Options {
+        int numThreads;  // Threads doing work, including the caller; 0 = one per core
+        bool pinThreads; // Pin worker i to core i + 1, leaving core 0 to the main thread (Linux only)
+        Options() : numThreads(0), pinThreads(false) {}
+    };
+
+    // Configures the shared pool; only effective before its first use
+    static void configure(const Options& options);
+    static ThreadPool& instance();
+
+    explicit ThreadPool(const Options& options = Options());
+    ~ThreadPool();
+
+    // Number of threads that execute work (workers plus the calling thread)
+    int concurrency() const { return (int)workers.size() + 1; }
+
+    void submit(std::function<void()> task);
+
+    // Runs one queued task on the calling thread; false if none was available
+    bool runPendingTask();
+
+    // Calls fn(begin, end) over [0, count) in chunks of `grain` items. The
+    // caller takes part and the call returns when every chunk has finished.
+    // Chunks not yet started are skipped once `token` is cancelled.
+    void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn,
+                     const CancellationToken* token = nullptr);
+
+    // 3D variant: fn receives sub-boxes of `range` no larger than `grain`
+    void parallelFor(const Range3D& range, glm::ivec3 grain, const std::function<void(const Range3D&)>& fn,
+                     const CancellationToken* token = nullptr);
+
+    std::vector<WorkerStats> getStats() const;
+    double getStatsWindowSeconds() const; // Wall time covered by getStats()
+    void resetStats();
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+        std::thread thread;
+        std::atomic<unsigned long long> executed;
+        std::atomic<unsigned long long> stolen;
+        std::atomic<unsigned long long> busyNanos;
+        Worker() : executed(0), stolen(0), busyNanos(0) {}
+    };
+
+    void workerLoop(int index, bool pin);
+    bool popTask(int self, std::function<void()>& task, bool& wasStolen);
+    void runTask(int self, std::function<void()>& task, bool wasStolen);
+    int currentWorkerIndex() const;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<size_t> pending;
+    std::atomic<unsigned> nextQueue;
+    bool stopping;
+    std::chrono::steady_clock::time_point statsStart;
+};
+
+// A set of tasks that can be waited on and cancelled together
+class TaskGroup {
+public:
+    explicit TaskGroup(ThreadPool& pool = ThreadPool::instance(), const CancellationToken* token = nullptr);
+    ~TaskGroup();
+
+    // Queues a task; it is skipped if the group is cancelled before it starts
+    void run(std::function<void()> task);
+    // Blocks until every task finished, executing queued work meanwhile and
+    // sleeping once none is left
+    void wait();
+    void cancel() { ownToken.cancel(); }
+    bool isCancelled() const { return ownToken.isCancelled() || (externalToken && externalToken->isCancelled()); }
+
+private:
+    TaskGroup(const TaskGroup&);
+    TaskGroup& operator=(const TaskGroup&);
+
+    ThreadPool& pool;
+    CancellationToken ownToken;
+    const CancellationToken* externalToken;
+    std::atomic<int> outstanding;
+    std::mutex doneMutex;
+    std::condition_variable done; // Signalled when `outstanding` reaches zero
+};
+
+#endif // THREAD_POOL_H
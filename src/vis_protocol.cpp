@@ -0,0 +1,154 @@
+#include "vis_protocol.h"
+#include <algorithm>
+#include <cstring>
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+const size_t READ_CHUNK = 64 * 1024;
+}
+
+VisConnection::VisConnection(int fd) : fd(fd), bufferBegin(0), bufferEnd(0) {}
+
+VisConnection::~VisConnection() {
+    close();
+}
+
+#ifndef _WIN32
+
+bool VisConnection::connect(const std::string& path) {
+    close();
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) return false;
+    std::strcpy(address.sun_path, path.c_str());
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return false;
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void VisConnection::close() {
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+    bufferBegin = bufferEnd = 0;
+}
+
+bool VisConnection::readLine(std::string& line, size_t maxLength) {
+    line.clear();
+    for (;;) {
+        const char* begin = buffer.data() + bufferBegin;
+        const char* end = buffer.data() + bufferEnd;
+        const char* newline = std::find(begin, end, '\n');
+        line.append(begin, newline);
+        if (newline != end) {
+            bufferBegin += (newline - begin) + 1;
+            if (!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+            return true;
+        }
+        bufferBegin = bufferEnd = 0;
+        if (line.size() > maxLength) return false;
+        if (buffer.size() < READ_CHUNK) buffer.resize(READ_CHUNK);
+        ssize_t received = recv(fd, buffer.data(), buffer.size(), 0);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) return false;
+        bufferEnd = (size_t)received;
+    }
+}
+
+bool VisConnection::read(void* data, size_t size) {
+    char* out = static_cast<char*>(data);
+    size_t buffered = std::min(size, bufferEnd - bufferBegin);
+    std::memcpy(out, buffer.data() + bufferBegin, buffered);
+    bufferBegin += buffered;
+    for (size_t done = buffered; done < size;) {
+        ssize_t received = recv(fd, out + done, size - done, 0);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) return false;
+        done += (size_t)received;
+    }
+    return true;
+}
+
+bool VisConnection::write(const void* data, size_t size) {
+    const char* in = static_cast<const char*>(data);
+    for (size_t done = 0; done < size;) {
+        ssize_t sent = send(fd, in + done, size - done, 0);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        done += (size_t)sent;
+    }
+    return true;
+}
+
+SharedPayload::~SharedPayload() {
+    if (data) munmap(const_cast<char*>(data), size);
+}
+
+bool SharedPayload::open(const std::string& name) {
+    int object = shm_open(name.c_str(), O_RDONLY, 0);
+    if (object < 0) return false;
+    shm_unlink(name.c_str());
+    struct stat info;
+    bool ok = fstat(object, &info) == 0;
+    size = ok ? (size_t)info.st_size : 0;
+    if (ok && size > 0) {
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, object, 0);
+        ok = mapping != MAP_FAILED;
+        if (ok) data = static_cast<const char*>(mapping);
+    }
+    ::close(object);
+    if (!ok) size = 0;
+    return ok;
+}
+
+bool writeSharedPayload(const std::string& name, const void* data, size_t size) {
+    int object = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (object < 0) return false;
+    bool ok = ftruncate(object, (off_t)size) == 0;
+    if (ok && size > 0) {
+        void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, object, 0);
+        ok = mapping != MAP_FAILED;
+        if (ok) {
+            std::memcpy(mapping, data, size);
+            munmap(mapping, size);
+        }
+    }
+    ::close(object);
+    if (!ok) shm_unlink(name.c_str());
+    return ok;
+}
+
+void removeSharedPayload(const std::string& name) {
+    shm_unlink(name.c_str());
+}
+
+#else // Unix-domain sockets and POSIX shared memory are not available
+
+bool VisConnection::connect(const std::string&) { return false; }
+void VisConnection::close() { fd = -1; }
+bool VisConnection::readLine(std::string&, size_t) { return false; }
+bool VisConnection::read(void*, size_t) { return false; }
+bool VisConnection::write(const void*, size_t) { return false; }
+SharedPayload::~SharedPayload() {}
+bool SharedPayload::open(const std::string&) { return false; }
+bool writeSharedPayload(const std::string&, const void*, size_t) { return false; }
+void removeSharedPayload(const std::string&) {}
+
+#endif
+
+bool VisConnection::writeLine(const std::string& line) {
+    std::string text = line + '\n';
+    return write(text.data(), text.size());
+}
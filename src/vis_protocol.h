@@ -0,0 +1,70 @@
+#ifndef VIS_PROTOCOL_H
+#define VIS_PROTOCOL_H
+
+#include <string>
+#include <vector>
+
+// Wire format of the visualization server (see vis_server.h), spoken over a
+// local Unix-domain socket. A request is one text line; a response is one
+// header line, possibly followed by a binary payload:
+//   OK <bytes> [key=value ...]        then <bytes> of payload
+//   SHM <name> <bytes> [key=value ...] payload in a POSIX shared memory object
+//   ERR <message>
+// Shared memory is only used after the client sent "SHM ON". The client maps
+// the object and unlinks it; the server unlinks any it sent that are left
+// over when the next request arrives or the connection closes.
+
+// Payloads at least this large go through shared memory when enabled
+const size_t VIS_SHARED_PAYLOAD_MIN = 1 << 20;
+
+// One end of a connection, with a read buffer for line-based input
+class VisConnection {
+public:
+    explicit VisConnection(int fd = -1);
+    ~VisConnection();
+
+    // Connects to the server listening at `path`; false if nobody answers
+    bool connect(const std::string& path);
+    void close();
+    int descriptor() const { return fd; }
+
+    // Reads up to the next '\n' (not included); false on EOF, error or a
+    // line longer than `maxLength`
+    bool readLine(std::string& line, size_t maxLength = 64u << 20);
+    bool read(void* data, size_t size);
+    bool write(const void* data, size_t size);
+    bool writeLine(const std::string& line);
+
+private:
+    VisConnection(const VisConnection&);
+    VisConnection& operator=(const VisConnection&);
+
+    int fd;
+    std::vector<char> buffer;
+    size_t bufferBegin, bufferEnd;
+};
+
+// Read-only mapping of a payload the server put in shared memory
+class SharedPayload {
+public:
+    SharedPayload() : data(nullptr), size(0) {}
+    ~SharedPayload();
+
+    // Maps the object and unlinks its name; the mapping stays valid
+    bool open(const std::string& name);
+    const char* getData() const { return data; }
+    size_t getSize() const { return size; }
+
+private:
+    SharedPayload(const SharedPayload&);
+    SharedPayload& operator=(const SharedPayload&);
+
+    const char* data;
+    size_t size;
+};
+
+// Creates a shared memory object `name` holding a copy of `data`
+bool writeSharedPayload(const std::string& name, const void* data, size_t size);
+void removeSharedPayload(const std::string& name);
+
+#endif // VIS_PROTOCOL_H
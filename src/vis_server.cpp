@@ -0,0 +1,322 @@
+#include "vis_server.h"
+#include "marching_cubes.h"
+#include "slice_engine.h"
+#include "vis_protocol.h"
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#ifndef _WIN32
+#include <cerrno>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+volatile sig_atomic_t stopRequested = 0;
+
+void requestStop(int) {
+    stopRequested = 1;
+}
+
+std::string format(double value) {
+    std::ostringstream out;
+    out << std::setprecision(9) << value;
+    return out.str();
+}
+
+std::string format(const glm::vec3& v) {
+    return format(v.x) + "," + format(v.y) + "," + format(v.z);
+}
+
+template <typename T>
+void appendValues(std::vector<char>& payload, const T* values, size_t count) {
+    const char* bytes = reinterpret_cast<const char*>(values);
+    payload.insert(payload.end(), bytes, bytes + count * sizeof(T));
+}
+
+} // namespace
+
+VisServer::VisServer(const VtkParser& parser, size_t cacheBudgetBytes)
+    : parser(parser), cache(cacheBudgetBytes), payloadCount(0) {}
+
+#ifndef _WIN32
+
+bool VisServer::run(const std::string& path) {
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Error: Socket path '" << path << "' is too long." << std::endl;
+        return false;
+    }
+    std::strcpy(address.sun_path, path.c_str());
+
+    // A socket file nobody answers on is left over from a server that died
+    VisConnection probe;
+    if (probe.connect(path)) {
+        std::cerr << "Error: A server is already listening on '" << path << "'." << std::endl;
+        return false;
+    }
+    unlink(path.c_str());
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listener, 16) != 0) {
+        std::cerr << "Error: Could not listen on '" << path << "': " << std::strerror(errno) << std::endl;
+        if (listener >= 0) close(listener);
+        return false;
+    }
+
+    struct sigaction stop, previousInt, previousTerm, previousPipe;
+    std::memset(&stop, 0, sizeof(stop));
+    stop.sa_handler = requestStop;
+    sigemptyset(&stop.sa_mask);
+    sigaction(SIGINT, &stop, &previousInt);
+    sigaction(SIGTERM, &stop, &previousTerm);
+    struct sigaction ignore = stop;
+    ignore.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignore, &previousPipe); // A client that went away is a failed write, not a crash
+    stopRequested = 0;
+    std::cout << "Serving on " << path << " (Ctrl+C to stop)" << std::endl;
+
+    while (!stopRequested) {
+        // Polled with a timeout so a signal handled by another thread is noticed too
+        pollfd waiting = { listener, POLLIN, 0 };
+        if (poll(&waiting, 1, 250) <= 0) continue;
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) continue;
+
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        for (std::list<Client>::iterator it = clients.begin(); it != clients.end();) {
+            if (it->fd < 0) {
+                it->thread.join();
+                it = clients.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        clients.push_back(Client());
+        Client& client = clients.back();
+        client.fd = fd;
+        client.thread = std::thread(&VisServer::serveClient, this, std::ref(client));
+    }
+
+    std::cout << "Stopping server" << std::endl;
+    close(listener);
+    unlink(path.c_str());
+    {
+        // Wakes every client thread out of its blocking read
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        for (std::list<Client>::iterator it = clients.begin(); it != clients.end(); ++it) {
+            if (it->fd >= 0) shutdown(it->fd, SHUT_RDWR);
+        }
+    }
+    for (std::list<Client>::iterator it = clients.begin(); it != clients.end(); ++it) it->thread.join();
+    clients.clear();
+    sigaction(SIGINT, &previousInt, nullptr);
+    sigaction(SIGTERM, &previousTerm, nullptr);
+    sigaction(SIGPIPE, &previousPipe, nullptr);
+    return true;
+}
+
+void VisServer::serveClient(Client& client) {
+    VisConnection connection(client.fd);
+    bool sharedMemory = false;
+    std::vector<std::string> sent; // Shared memory objects the client may not have taken yet
+    std::string request;
+    while (connection.readLine(request)) {
+        for (size_t i = 0; i < sent.size(); ++i) removeSharedPayload(sent[i]);
+        sent.clear();
+
+        std::string error;
+        ResponsePointer response;
+        if (request == "SHM ON" || request == "SHM OFF") {
+            sharedMemory = request == "SHM ON";
+            response = std::make_shared<Response>();
+        } else {
+            response = handle(request, error);
+        }
+        if (!response) {
+            if (!connection.writeLine("ERR " + error)) break;
+            continue;
+        }
+
+        const std::vector<char>& payload = response->payload;
+        std::string suffix = response->header.empty() ? "" : " " + response->header;
+        bool written;
+        if (sharedMemory && payload.size() >= VIS_SHARED_PAYLOAD_MIN) {
+            std::string name = "/vis-" + std::to_string(getpid()) + "-" + std::to_string(payloadCount++);
+            if (writeSharedPayload(name, payload.data(), payload.size())) {
+                sent.push_back(name);
+                written = connection.writeLine("SHM " + name + " " + std::to_string(payload.size()) + suffix);
+            } else {
+                written = connection.writeLine("ERR could not create shared memory for the result");
+            }
+        } else {
+            written = connection.writeLine("OK " + std::to_string(payload.size()) + suffix) &&
+                      connection.write(payload.data(), payload.size());
+        }
+        if (!written) break;
+    }
+    for (size_t i = 0; i < sent.size(); ++i) removeSharedPayload(sent[i]);
+
+    std::lock_guard<std::mutex> lock(clientsMutex);
+    connection.close();
+    client.fd = -1;
+}
+
+#else // No Unix-domain sockets
+
+bool VisServer::run(const std::string&) {
+    std::cerr << "Error: Server mode is not supported on Windows." << std::endl;
+    return false;
+}
+
+void VisServer::serveClient(Client&) {}
+
+#endif
+
+VisServer::ResponsePointer VisServer::handle(const std::string& request, std::string& error) {
+    std::istringstream in(request);
+    std::string command, fieldName;
+    in >> command;
+    if (command == "FIELDS") {
+        std::shared_ptr<Response> response = std::make_shared<Response>();
+        std::vector<std::string> names = parser.getFieldNames();
+        for (size_t i = 0; i < names.size(); ++i) {
+            std::string line = names[i] + " " + voxelTypeName(parser.getScalarField(names[i])->getType()) + "\n";
+            response->payload.insert(response->payload.end(), line.begin(), line.end());
+        }
+        return response;
+    }
+    if (command == "CACHE") {
+        LruCache<std::string, Response>::Stats stats = cache.getStats();
+        std::shared_ptr<Response> response = std::make_shared<Response>();
+        response->header = "hits=" + std::to_string(stats.hits) + " misses=" + std::to_string(stats.misses) +
+                           " evictions=" + std::to_string(stats.evictions) + " bytes=" + std::to_string(stats.bytes) +
+                           " budget=" + std::to_string(stats.budget);
+        return response;
+    }
+    if (command != "STATS" && command != "SAMPLE" && command != "ISOSURFACE" && command != "SLICE") {
+        error = "unknown request '" + command + "'";
+        return ResponsePointer();
+    }
+
+    if (!(in >> fieldName)) {
+        error = command + " needs a field name";
+        return ResponsePointer();
+    }
+    std::vector<std::string> names = parser.getFieldNames();
+    if (std::find(names.begin(), names.end(), fieldName) == names.end()) {
+        error = "unknown field '" + fieldName + "'";
+        return ResponsePointer();
+    }
+    const ScalarField& field = *parser.getScalarField(fieldName);
+    if (command == "STATS") return stats(fieldName, field);
+
+    if (command == "SAMPLE") {
+        // World positions to grid coordinates, as separate x/y/z arrays
+        std::vector<float> numbers, coords[3];
+        float number;
+        while (in >> number) numbers.push_back(number);
+        if (numbers.empty() || numbers.size() % 3 != 0 || !in.eof()) {
+            error = "SAMPLE expects a field name and x y z triples";
+            return ResponsePointer();
+        }
+        for (size_t i = 0; i < numbers.size(); i += 3) {
+            glm::vec3 grid = (glm::vec3(numbers[i], numbers[i + 1], numbers[i + 2]) - parser.getOrigin()) /
+                             parser.getSpacing();
+            for (int k = 0; k < 3; ++k) coords[k].push_back(grid[k]);
+        }
+        size_t count = coords[0].size();
+        std::vector<float> values(count);
+        parser.sampleBatch(field, coords[0].data(), coords[1].data(), coords[2].data(), count, values.data());
+        std::shared_ptr<Response> response = std::make_shared<Response>();
+        response->header = "points=" + std::to_string(count);
+        appendValues(response->payload, values.data(), count);
+        return response;
+    }
+
+    if (command == "ISOSURFACE") {
+        float isovalue;
+        if (!(in >> isovalue)) {
+            error = "ISOSURFACE expects a field name and an isovalue";
+            return ResponsePointer();
+        }
+        return isosurface(fieldName, field, isovalue);
+    }
+
+    glm::vec3 normal;
+    float offset;
+    if (!(in >> normal.x >> normal.y >> normal.z >> offset) || glm::length(normal) == 0.0f) {
+        error = "SLICE expects a field name, a non-zero normal nx ny nz and an offset";
+        return ResponsePointer();
+    }
+    return slice(fieldName, field, glm::normalize(normal), offset);
+}
+
+VisServer::ResponsePointer VisServer::stats(const std::string& fieldName, const ScalarField& field) {
+    return cache.getOrCompute("STATS " + fieldName, [&](size_t& bytes) {
+        float minValue, maxValue;
+        field.getRange(minValue, maxValue);
+        std::shared_ptr<Response> response = std::make_shared<Response>();
+        response->header = std::string("type=") + voxelTypeName(field.getType()) +
+                           " dims=" + std::to_string(field.getDimensions().x) + "," +
+                           std::to_string(field.getDimensions().y) + "," + std::to_string(field.getDimensions().z) +
+                           " spacing=" + format(parser.getSpacing()) + " origin=" + format(parser.getOrigin()) +
+                           " min=" + format(minValue) + " max=" + format(maxValue) + " mean=" + format(field.getMean());
+        bytes = response->header.size();
+        return ResponsePointer(response);
+    });
+}
+
+VisServer::ResponsePointer VisServer::isosurface(const std::string& fieldName, const ScalarField& field,
+                                                 float isovalue) {
+    return cache.getOrCompute("ISOSURFACE " + fieldName + " " + format(isovalue), [&](size_t& bytes) {
+        MarchingCubes extractor;
+        extractor.setSpacing(parser.getSpacing());
+        SurfaceMetrics metrics;
+        std::vector<Vertex> vertices = extractor.generateSurface(field, isovalue, nullptr, nullptr, metrics);
+
+        // Unit-space vertex positions back to world units
+        glm::vec3 scale = glm::vec3(field.getDimensions() - glm::ivec3(1)) * parser.getSpacing();
+        std::vector<float> positions(vertices.size() * 3);
+        for (size_t i = 0; i < vertices.size(); ++i) {
+            glm::vec3 p = parser.getOrigin() + vertices[i].getPosition() * scale;
+            positions[i * 3] = p.x;
+            positions[i * 3 + 1] = p.y;
+            positions[i * 3 + 2] = p.z;
+        }
+        std::shared_ptr<Response> response = std::make_shared<Response>();
+        response->header = "triangles=" + std::to_string(metrics.triangleCount) + " area=" + format(metrics.area) +
+                           " volume=" + format(metrics.volume);
+        appendValues(response->payload, positions.data(), positions.size());
+        bytes = response->header.size() + response->payload.size();
+        return ResponsePointer(response);
+    });
+}
+
+VisServer::ResponsePointer VisServer::slice(const std::string& fieldName, const ScalarField& field,
+                                            const glm::vec3& normal, float offset) {
+    std::string key = "SLICE " + fieldName + " " + format(normal) + " " + format(offset);
+    return cache.getOrCompute(key, [&](size_t& bytes) {
+        // The engine measures planes from grid point 0, clients from the world origin
+        SliceEngine engine;
+        engine.setField(&field, parser.getSpacing());
+        const SliceImage& image = engine.slice(0, SlicePlane(normal, offset - glm::dot(normal, parser.getOrigin())));
+
+        std::shared_ptr<Response> response = std::make_shared<Response>();
+        response->header = "width=" + std::to_string(image.width) + " height=" + std::to_string(image.height) +
+                           " corner=" + format(parser.getOrigin() + image.corner) + " u=" + format(image.axisU) +
+                           " v=" + format(image.axisV) + " stepU=" + format(image.stepU) +
+                           " stepV=" + format(image.stepV);
+        appendValues(response->payload, image.values.data(), image.values.size());
+        bytes = response->header.size() + response->payload.size();
+        return ResponsePointer(response);
+    });
+}
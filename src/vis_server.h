@@ -0,0 +1,62 @@
+#ifndef VIS_SERVER_H
+#define VIS_SERVER_H
+
+#include "lru_cache.h"
+#include "vtk_parser.h"
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Headless server that keeps one dataset resident and answers requests from
+// any number of local clients over a Unix-domain socket (protocol in
+// vis_protocol.h). Requests, one per line, with positions in world units:
+//   FIELDS                          names and element types, one per line
+//   STATS <field>                   type, grid, range and mean in the header
+//   SAMPLE <field> x y z [x y z...] float32 per point
+//   ISOSURFACE <field> <value>      float32 x,y,z per vertex, 3 per triangle
+//   SLICE <field> nx ny nz offset   float32 image of the plane dot(n, p) = offset
+//   CACHE                           result cache statistics
+//   SHM ON|OFF                      large payloads through shared memory
+// Every client has its own thread; the extraction and slicing kernels run on
+// the shared thread pool. Isosurfaces, slices and stats are kept in a result
+// cache, and identical requests that arrive together are computed once.
+class VisServer {
+public:
+    explicit VisServer(const VtkParser& parser, size_t cacheBudgetBytes = (size_t)512 << 20);
+
+    // Listens on `path` until SIGINT or SIGTERM, then closes every
+    // connection and removes the socket. False if it could not listen, e.g.
+    // because another server already answers there.
+    bool run(const std::string& path);
+
+private:
+    struct Response {
+        std::string header;     // key=value pairs after the size
+        std::vector<char> payload;
+    };
+    typedef LruCache<std::string, Response>::Pointer ResponsePointer;
+
+    struct Client {
+        int fd; // -1 once the client thread has closed it
+        std::thread thread;
+    };
+
+    void serveClient(Client& client);
+    // Response to one request; null with `error` set if it is malformed
+    ResponsePointer handle(const std::string& request, std::string& error);
+    ResponsePointer stats(const std::string& fieldName, const ScalarField& field);
+    ResponsePointer isosurface(const std::string& fieldName, const ScalarField& field, float isovalue);
+    ResponsePointer slice(const std::string& fieldName, const ScalarField& field, const glm::vec3& normal,
+                          float offset);
+
+    const VtkParser& parser;
+    LruCache<std::string, Response> cache; // Normalized request to response
+    std::atomic<unsigned> payloadCount;    // Names shared memory objects
+    std::mutex clientsMutex;
+    std::list<Client> clients;
+};
+
+#endif // VIS_SERVER_H
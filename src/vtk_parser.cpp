@@ -1,25 +1,149 @@
 #include "vtk_parser.h"
+#include "raw_volume.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <stdint.h>
 
 VtkParser::VtkParser(const std::string& path) 
     : filepath(path), dimensions(0), spacing(1.0f), origin(0.0f) {}
 
+namespace {
+
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' || c == '\v';
+}
+
+// Reads the next line of `buffer` starting at `pos` and advances `pos` past it
+bool nextLine(const std::string& buffer, size_t& pos, std::string& line) {
+    if (pos >= buffer.size()) return false;
+    size_t end = buffer.find('\n', pos);
+    if (end == std::string::npos) end = buffer.size();
+    line.assign(buffer, pos, end - pos);
+    pos = end + 1;
+    return true;
+}
+
+// Whitespace-separated tokens of buffer[begin, end), split into chunks that
+// can be scanned independently. chunkFirstToken[c] is the global index of
+// the first token starting in chunk c.
+struct TokenChunks {
+    std::vector<size_t> chunkBegin; // chunkBegin.size() == numChunks + 1
+    std::vector<long long> chunkFirstToken;
+};
+
+TokenChunks countTokens(const std::string& buffer, size_t begin, size_t end) {
+    const size_t chunkBytes = 1 << 20;
+    TokenChunks chunks;
+    // Chunk boundaries are moved forward onto whitespace so no token is split
+    for (size_t pos = begin; pos < end; ) {
+        chunks.chunkBegin.push_back(pos);
+        pos = std::min(end, pos + chunkBytes);
+        while (pos < end && !isSpace(buffer[pos])) ++pos;
+    }
+    chunks.chunkBegin.push_back(end);
+    size_t numChunks = chunks.chunkBegin.size() - 1;
+
+    std::vector<long long> counts(numChunks, 0);
+    ThreadPool::instance().parallelFor(numChunks, 1, [&](size_t cBegin, size_t cEnd) {
+        for (size_t c = cBegin; c < cEnd; ++c) {
+            long long n = 0;
+            bool inToken = false;
+            for (size_t i = chunks.chunkBegin[c]; i < chunks.chunkBegin[c + 1]; ++i) {
+                bool space = isSpace(buffer[i]);
+                if (!space && !inToken) ++n;
+                inToken = !space;
+            }
+            counts[c] = n;
+        }
+    });
+
+    chunks.chunkFirstToken.resize(numChunks + 1, 0);
+    for (size_t c = 0; c < numChunks; ++c) chunks.chunkFirstToken[c + 1] = chunks.chunkFirstToken[c] + counts[c];
+    return chunks;
+}
+
+// Byte offset of token number `token` (which must exist)
+size_t findToken(const std::string& buffer, const TokenChunks& chunks, long long token) {
+    size_t c = std::upper_bound(chunks.chunkFirstToken.begin(), chunks.chunkFirstToken.end(), token)
+             - chunks.chunkFirstToken.begin() - 1;
+    long long n = chunks.chunkFirstToken[c];
+    size_t i = chunks.chunkBegin[c];
+    for (;;) {
+        while (isSpace(buffer[i])) ++i;
+        if (n == token) return i;
+        while (i < buffer.size() && !isSpace(buffer[i])) ++i;
+        ++n;
+    }
+}
+
+typedef void (*StoreFn)(void* data, long long index, double value);
+
+template <typename T>
+void storeAs(void* data, long long index, double value) {
+    static_cast<T*>(data)[index] = static_cast<T>(value);
+}
+
+StoreFn storeFunction(VoxelType type) {
+    switch (type) {
+        case VoxelUInt8:  return &storeAs<uint8_t>;
+        case VoxelInt8:   return &storeAs<int8_t>;
+        case VoxelUInt16: return &storeAs<uint16_t>;
+        case VoxelInt16:  return &storeAs<int16_t>;
+        default:          return &storeAs<float>;
+    }
+}
+
+// Small integer types are kept as declared; everything else in ASCII files
+// (float, double, 32-bit ints) is stored as float32 as before
+VoxelType asciiStorageType(const std::string& dataType) {
+    VoxelType type;
+    if (parseVoxelType(dataType, type) && voxelTypeSize(type) <= 2) return type;
+    return VoxelFloat32;
+}
+
+// Copies raw voxels of `field` from `src` in parallel, fixing the byte order
+void copyField(const unsigned char* src, bool bigEndian, ScalarField& field) {
+    size_t valueSize = voxelTypeSize(field.getType());
+    bool swap = bigEndian != hostIsBigEndian();
+    unsigned char* dst = static_cast<unsigned char*>(field.data());
+    ThreadPool::instance().parallelFor(field.size(), 1 << 20, [&](size_t begin, size_t end) {
+        copyVoxels(src + begin * valueSize, valueSize, swap, dst + begin * valueSize, end - begin);
+    });
+}
+
+} // namespace
+
 bool VtkParser::read() {
-    std::ifstream file(filepath);
+    std::ifstream file(filepath, std::ios::binary);
     if (!file.is_open()) {
         std::cerr << "Error: Could not open VTK file: " << filepath << std::endl;
         return false;
     }
+    // The whole file is loaded once so that the value blocks can be parsed in parallel
+    file.seekg(0, std::ios::end);
+    std::string buffer((size_t)file.tellg(), '\0');
+    file.seekg(0, std::ios::beg);
+    file.read(&buffer[0], buffer.size());
+    file.close();
 
+    if (isVolumeCache(buffer.data(), buffer.size())) return readCache(buffer);
+
+    size_t pos = 0;
     std::string line;
-    while (std::getline(file, line)) {
+    bool binary = false;
+    while (nextLine(buffer, pos, line)) {
         std::stringstream ss(line);
         std::string keyword;
         ss >> keyword;
 
-        if (keyword == "DIMENSIONS") {
+        if (keyword == "BINARY") {
+            binary = true;
+        } else if (keyword == "DIMENSIONS") {
             ss >> dimensions.x >> dimensions.y >> dimensions.z;
         } else if (keyword == "SPACING") {
             ss >> spacing.x >> spacing.y >> spacing.z;
@@ -38,42 +162,83 @@ bool VtkParser::read() {
             }
 
             // Next line should be FIELD
-            if (std::getline(file, line)) {
+            if (nextLine(buffer, pos, line)) {
                 std::stringstream field_ss(line);
                 std::string field_keyword, field_data_keyword;
                 int num_fields;
                 field_ss >> field_keyword >> field_data_keyword >> num_fields;
 
                 if (field_keyword != "FIELD") continue;
+                if (binary) return readBinaryFields(buffer, pos, num_fields, totalPoints);
 
-                // Loop to read each named field
+                // Every field is a 4-token header line followed by totalPoints values
+                TokenChunks chunks = countTokens(buffer, pos, buffer.size());
+                long long availableTokens = chunks.chunkFirstToken.back();
+                std::vector<std::string> names;
                 for (int i = 0; i < num_fields; ++i) {
-                    if (std::getline(file, line)) {
-                        std::stringstream header_ss(line);
-                        std::string field_name, data_type;
-                        int num_components;
-                        long long num_tuples;
-                        
-                        header_ss >> field_name >> num_components >> num_tuples >> data_type;
-
-                        if (num_tuples != totalPoints) {
-                            std::cerr << "Parser Error: Field '" << field_name << "' tuple count mismatch." << std::endl;
-                            return false;
-                        }
+                    long long headerToken = i * (totalPoints + 4);
+                    if (headerToken + 4 > availableTokens) break;
+                    size_t headerPos = findToken(buffer, chunks, headerToken);
+                    size_t headerEnd = buffer.find('\n', headerPos);
+                    std::stringstream header_ss(buffer.substr(headerPos, headerEnd == std::string::npos ? std::string::npos : headerEnd - headerPos));
+                    std::string field_name, data_type;
+                    int num_components;
+                    long long num_tuples;
+                    
+                    header_ss >> field_name >> num_components >> num_tuples >> data_type;
+
+                    if (num_tuples != totalPoints) {
+                        std::cerr << "Parser Error: Field '" << field_name << "' tuple count mismatch." << std::endl;
+                        return false;
+                    }
+                    if (headerToken + 4 + totalPoints > availableTokens) {
+                        std::cerr << "Parser Error: Failed reading value #" << (availableTokens - headerToken - 4)
+                                  << " for field '" << field_name << "'." << std::endl;
+                        return false;
+                    }
+                    names.push_back(field_name);
+                    scalarFields[field_name] = ScalarField(asciiStorageType(data_type), dimensions);
+                }
 
-                        // Read the actual data for this field
-                        std::vector<float> data(totalPoints);
-                        for (long long j = 0; j < totalPoints; ++j) {
-                            double val;
-                            if (!(file >> val)) {
-                                std::cerr << "Parser Error: Failed reading value #" << j << " for field '" << field_name << "'." << std::endl;
-                                return false;
+                // Parse every chunk in parallel, routing each value to its field
+                std::vector<void*> fieldData;
+                std::vector<StoreFn> fieldStore;
+                for (size_t f = 0; f < names.size(); ++f) {
+                    ScalarField& field = scalarFields[names[f]];
+                    fieldData.push_back(field.data());
+                    fieldStore.push_back(storeFunction(field.getType()));
+                }
+                std::atomic<long long> badToken(-1);
+                long long stride = totalPoints + 4;
+                ThreadPool::instance().parallelFor(chunks.chunkBegin.size() - 1, 1, [&](size_t cBegin, size_t cEnd) {
+                    for (size_t c = cBegin; c < cEnd; ++c) {
+                        long long token = chunks.chunkFirstToken[c];
+                        const char* p = buffer.c_str() + chunks.chunkBegin[c];
+                        const char* chunkEnd = buffer.c_str() + chunks.chunkBegin[c + 1];
+                        for (;;) {
+                            while (p < chunkEnd && isSpace(*p)) ++p;
+                            if (p >= chunkEnd) break;
+                            long long f = token / stride, k = token % stride - 4;
+                            if (f >= (long long)fieldData.size()) break;
+                            if (k >= 0) {
+                                char* next;
+                                double val = std::strtod(p, &next);
+                                if (next == p) { badToken = token; break; }
+                                fieldStore[f](fieldData[f], k, val);
                             }
-                            data[j] = static_cast<float>(val);
+                            while (p < chunkEnd && !isSpace(*p)) ++p;
+                            ++token;
                         }
-                        scalarFields[field_name] = data;
-                        std::cout << "Successfully read field: " << field_name << std::endl;
                     }
+                });
+                if (badToken >= 0) {
+                    long long f = badToken / stride;
+                    std::cerr << "Parser Error: Failed reading value #" << (badToken % stride - 4)
+                              << " for field '" << names[f] << "'." << std::endl;
+                    return false;
+                }
+                for (size_t f = 0; f < names.size(); ++f) {
+                    std::cout << "Successfully read field: " << names[f] << std::endl;
                 }
                 return true; // Finished parsing all fields
             }
@@ -82,39 +247,117 @@ bool VtkParser::read() {
     return false; // Reached end of file without finding POINT_DATA
 }
 
-bool VtkParser::getScalarField(const std::string& fieldName, std::vector<float>& scalars) const {
+bool VtkParser::readBinaryFields(const std::string& buffer, size_t pos, int numFields, long long totalPoints) {
+    // Each field is a text header line followed by totalPoints big-endian values
+    std::string line;
+    for (int i = 0; i < numFields; ++i) {
+        while (pos < buffer.size() && isSpace(buffer[pos])) ++pos;
+        if (!nextLine(buffer, pos, line)) break;
+        std::stringstream header_ss(line);
+        std::string field_name, data_type;
+        int num_components;
+        long long num_tuples;
+        header_ss >> field_name >> num_components >> num_tuples >> data_type;
+
+        if (num_tuples != totalPoints) {
+            std::cerr << "Parser Error: Field '" << field_name << "' tuple count mismatch." << std::endl;
+            return false;
+        }
+        VoxelType type;
+        if (!parseVoxelType(data_type, type)) {
+            std::cerr << "Parser Error: Unsupported binary data type '" << data_type
+                      << "' for field '" << field_name << "'." << std::endl;
+            return false;
+        }
+        size_t valueSize = voxelTypeSize(type);
+        size_t available = (buffer.size() - pos) / valueSize;
+        if ((long long)available < totalPoints) {
+            std::cerr << "Parser Error: Failed reading value #" << available
+                      << " for field '" << field_name << "'." << std::endl;
+            return false;
+        }
+
+        ScalarField& field = scalarFields[field_name];
+        field = ScalarField(type, dimensions);
+        copyField(reinterpret_cast<const unsigned char*>(buffer.data()) + pos, true, field);
+        pos += totalPoints * valueSize;
+        std::cout << "Successfully read field: " << field_name << std::endl;
+    }
+    return true;
+}
+
+bool VtkParser::readCache(const std::string& buffer) {
+    VolumeCacheHeader header;
+    size_t dataOffset;
+    if (!readVolumeCacheHeader(buffer.data(), buffer.size(), header, dataOffset)) {
+        std::cerr << "Parser Error: Invalid volume cache header in " << filepath << std::endl;
+        return false;
+    }
+    dimensions = header.dimensions;
+    spacing = header.spacing;
+    origin = header.origin;
+
+    long long totalPoints = (long long)dimensions.x * dimensions.y * dimensions.z;
+    size_t valueSize = voxelTypeSize(header.type);
+    if (totalPoints <= 0 || (buffer.size() - dataOffset) / valueSize < (size_t)totalPoints) {
+        std::cerr << "Parser Error: Volume cache " << filepath << " is truncated." << std::endl;
+        return false;
+    }
+
+    ScalarField& field = scalarFields[header.fieldName];
+    field = ScalarField(header.type, dimensions);
+    copyField(reinterpret_cast<const unsigned char*>(buffer.data()) + dataOffset, false, field);
+    std::cout << "Successfully read field: " << header.fieldName << std::endl;
+    return true;
+}
+
+const ScalarField* VtkParser::getScalarField(const std::string& fieldName) const {
     auto it = scalarFields.find(fieldName);
     if (it != scalarFields.end()) {
-        scalars = it->second;
-        return true;
+        return &it->second;
     }
     std::cerr << "Error: Field '" << fieldName << "' not found in VTK file." << std::endl;
-    return false;
+    return nullptr;
 }
 
-float VtkParser::getValue(const std::vector<float>& scalars, const glm::vec3& coord) const {
-    float x = glm::clamp(coord.x, 0.0f, (float)dimensions.x - 1.001f);
-    float y = glm::clamp(coord.y, 0.0f, (float)dimensions.y - 1.001f);
-    float z = glm::clamp(coord.z, 0.0f, (float)dimensions.z - 1.001f);
+ScalarField* VtkParser::createScalarField(const std::string& fieldName, VoxelType type) {
+    if (scalarFields.count(fieldName)) {
+        std::cerr << "Error: Field '" << fieldName << "' already exists." << std::endl;
+        return nullptr;
+    }
+    ScalarField& field = scalarFields[fieldName];
+    field = ScalarField(type, dimensions);
+    return &field;
+}
 
-    int x0 = (int)x, y0 = (int)y, z0 = (int)z;
-    int x1 = x0 + 1, y1 = y0 + 1, z1 = z0 + 1;
+bool VtkParser::releaseScalarField(const std::string& fieldName) {
+    return scalarFields.erase(fieldName) > 0;
+}
 
-    float xd = x - x0, yd = y - y0, zd = z - z0;
+float VtkParser::getValue(const ScalarField& field, const glm::vec3& coord) const {
+    return field.sample(coord);
+}
 
-    auto get_val = [&](int i, int j, int k) {
-        return scalars[k * dimensions.x * dimensions.y + j * dimensions.x + i];
-    };
+float VtkParser::getValue(const SparseField& field, const glm::vec3& coord) const {
+    return field.sample(coord);
+}
 
-    float c00 = get_val(x0, y0, z0) * (1 - xd) + get_val(x1, y0, z0) * xd;
-    float c01 = get_val(x0, y0, z1) * (1 - xd) + get_val(x1, y0, z1) * xd;
-    float c10 = get_val(x0, y1, z0) * (1 - xd) + get_val(x1, y1, z0) * xd;
-    float c11 = get_val(x0, y1, z1) * (1 - xd) + get_val(x1, y1, z1) * xd;
+void VtkParser::sampleBatch(const ScalarField& field, const float* x, const float* y, const float* z,
+                            size_t count, float* out, bool parallel) const {
+    field.sampleBatch(x, y, z, count, out, parallel);
+}
 
-    float c0 = c00 * (1 - yd) + c10 * yd;
-    float c1 = c01 * (1 - yd) + c11 * yd;
+void VtkParser::sampleLattice(const ScalarField& field, const glm::vec3& origin, const glm::vec3& stepU,
+                              const glm::vec3& stepV, int countU, int countV, float* out, bool parallel) const {
+    field.sampleLattice(origin, stepU, stepV, countU, countV, out, parallel);
+}
 
-    return c0 * (1 - zd) + c1 * zd;
+std::vector<std::string> VtkParser::getFieldNames() const {
+    std::vector<std::string> names;
+    for (std::map<std::string, ScalarField>::const_iterator it = scalarFields.begin(); it != scalarFields.end(); ++it) {
+        names.push_back(it->first);
+    }
+    return names;
 }
 
 std::string VtkParser::getFirstFieldName() const {
@@ -1,6 +1,8 @@
 #ifndef VTK_PARSER_H
 #define VTK_PARSER_H
 
+#include "scalar_field.h"
+#include "sparse_field.h"
 #include <string>
 #include <vector>
 #include <map>
@@ -16,25 +18,46 @@ public:
     // Accessors
     const glm::ivec3& getDimensions() const { return dimensions; }
     std::string getFirstFieldName() const;
+    std::vector<std::string> getFieldNames() const;
     
     
-    // Get a specific scalar field by name
-    bool getScalarField(const std::string& fieldName, std::vector<float>& scalars) const;
+    // Get a specific scalar field by name; nullptr if it does not exist
+    const ScalarField* getScalarField(const std::string& fieldName) const;
+
+    // Adds a zero-filled field of the file's dimensions, e.g. to hold a
+    // derived field; nullptr if a field of that name already exists
+    ScalarField* createScalarField(const std::string& fieldName, VoxelType type);
+
+    // Frees a field's values, e.g. once a tiled copy replaces it; pointers
+    // to it become invalid. False if there is no such field.
+    bool releaseScalarField(const std::string& fieldName);
 
     // Get a value using trilinear interpolation from a given field
-    float getValue(const std::vector<float>& scalars, const glm::vec3& coord) const;
+    float getValue(const ScalarField& field, const glm::vec3& coord) const;
+    // The same from a tiled copy of a field (see SparseField)
+    float getValue(const SparseField& field, const glm::vec3& coord) const;
+
+    // Batched versions of getValue for many points (SoA arrays or a regular
+    // lattice); see ScalarField::sampleBatch and ScalarField::sampleLattice
+    void sampleBatch(const ScalarField& field, const float* x, const float* y, const float* z,
+                     size_t count, float* out, bool parallel = true) const;
+    void sampleLattice(const ScalarField& field, const glm::vec3& origin, const glm::vec3& stepU,
+                       const glm::vec3& stepV, int countU, int countV, float* out, bool parallel = true) const;
     
     const glm::vec3& getOrigin() const { return origin; }
     const glm::vec3& getSpacing() const { return spacing; }
 
 private:
+    bool readCache(const std::string& buffer);
+    bool readBinaryFields(const std::string& buffer, size_t pos, int numFields, long long totalPoints);
+
     std::string filepath;
     glm::ivec3 dimensions;
     glm::vec3 spacing;
     glm::vec3 origin;
     
-    // Store multiple named scalar fields
-    std::map<std::string, std::vector<float>> scalarFields;
+    // Store multiple named scalar fields, each in its source element type
+    std::map<std::string, ScalarField> scalarFields;
 };
 
 #endif // VTK_PARSER_H
@@ -0,0 +1,288 @@
+// Converts RAW voxel volumes to binary legacy VTK or to the native volume
+// cache read by the Visualizer. The input is memory-mapped and converted in
+// parallel slabs; values keep their original type.
+
+#include "raw_volume.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <cstdio>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Read-only view of a whole file; memory-mapped where available
+class MappedFile {
+public:
+    MappedFile() : data(nullptr), size(0) {}
+    ~MappedFile() {
+#ifndef _WIN32
+        if (data) munmap(const_cast<unsigned char*>(data), size);
+#endif
+    }
+
+    bool open(const std::string& path) {
+#ifdef _WIN32
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) return false;
+        file.seekg(0, std::ios::end);
+        fallback.resize((size_t)file.tellg());
+        file.seekg(0, std::ios::beg);
+        file.read(reinterpret_cast<char*>(fallback.data()), fallback.size());
+        data = fallback.data();
+        size = fallback.size();
+        return true;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0) { close(fd); return false; }
+        size = (size_t)st.st_size;
+        void* mapped = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+        close(fd);
+        if (mapped == MAP_FAILED) { size = 0; return false; }
+        madvise(mapped, size, MADV_SEQUENTIAL);
+        data = static_cast<const unsigned char*>(mapped);
+        return true;
+#endif
+    }
+
+    const unsigned char* data;
+    size_t size;
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+#ifdef _WIN32
+    std::vector<unsigned char> fallback;
+#endif
+};
+
+struct Options {
+    std::string input;
+    std::string output;
+    std::string format;    // "vtk" or "cache"
+    std::string fieldName;
+    bool haveType;
+    VoxelType type;
+    bool bigEndian;
+    glm::ivec3 dims;
+    glm::vec3 spacing;
+    glm::vec3 origin;
+    glm::ivec3 cropBegin;
+    glm::ivec3 cropEnd;    // Exclusive; 0 means "to the end"
+    glm::ivec3 stride;
+    Options() : format("vtk"), fieldName("ScalarField"), haveType(false), type(VoxelFloat32), bigEndian(false),
+                dims(0), spacing(1.0f), origin(0.0f), cropBegin(0), cropEnd(0), stride(1) {}
+};
+
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " <input.raw> [options]\n"
+              << "  -o <path>                  Output file (default: input with .vtk or .vcache)\n"
+              << "  --format vtk|cache         Binary legacy VTK (default) or native volume cache\n"
+              << "  --type <type>              uint8, int8, uint16, int16, uint32, int32, float32, float64\n"
+              << "  --endian little|big        Byte order of the input (default: little)\n"
+              << "  --dims X Y Z               Input dimensions\n"
+              << "  --spacing X Y Z            Voxel spacing (default: 1 1 1)\n"
+              << "  --origin X Y Z             Dataset origin (default: 0 0 0)\n"
+              << "  --crop X0 Y0 Z0 X1 Y1 Z1   Keep voxels in [X0,X1) x [Y0,Y1) x [Z0,Z1)\n"
+              << "  --stride S | SX SY SZ      Keep every S-th voxel along each axis\n"
+              << "  --field <name>             Field name (default: ScalarField)\n"
+              << "  --threads N                Worker threads (default: one per core)\n"
+              << "Dimensions and type default to the file name, e.g. volume_512x512x512_uint8.raw" << std::endl;
+}
+
+bool isNumber(const char* s) {
+    char* end;
+    std::strtod(s, &end);
+    return end != s && *end == '\0';
+}
+
+// Reads `count` numbers following argv[i]; false if any is missing
+template <typename T>
+bool readVector(int argc, char* argv[], int& i, int count, T& out) {
+    if (i + count >= argc) return false;
+    for (int k = 0; k < count; ++k) out[k] = std::atof(argv[++i]);
+    return true;
+}
+
+bool parseArguments(int argc, char* argv[], Options& opt, ThreadPool::Options& poolOptions) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool ok = true;
+        if (arg == "-o" && i + 1 < argc) opt.output = argv[++i];
+        else if (arg == "--format" && i + 1 < argc) opt.format = argv[++i];
+        else if (arg == "--field" && i + 1 < argc) opt.fieldName = argv[++i];
+        else if (arg == "--threads" && i + 1 < argc) poolOptions.numThreads = std::atoi(argv[++i]);
+        else if (arg == "--type" && i + 1 < argc) {
+            std::string name = argv[++i];
+            opt.haveType = parseVoxelType(name, opt.type);
+            if (!opt.haveType) { std::cerr << "Error: Unknown type '" << name << "'." << std::endl; return false; }
+        } else if (arg == "--endian" && i + 1 < argc) {
+            std::string order = argv[++i];
+            if (order != "little" && order != "big") { std::cerr << "Error: Unknown byte order '" << order << "'." << std::endl; return false; }
+            opt.bigEndian = order == "big";
+        }
+        else if (arg == "--dims") ok = readVector(argc, argv, i, 3, opt.dims);
+        else if (arg == "--spacing") ok = readVector(argc, argv, i, 3, opt.spacing);
+        else if (arg == "--origin") ok = readVector(argc, argv, i, 3, opt.origin);
+        else if (arg == "--crop") ok = readVector(argc, argv, i, 3, opt.cropBegin) && readVector(argc, argv, i, 3, opt.cropEnd);
+        else if (arg == "--stride") {
+            // One value applies to all axes
+            if (i + 3 < argc && isNumber(argv[i + 2]) && isNumber(argv[i + 3])) ok = readVector(argc, argv, i, 3, opt.stride);
+            else if (i + 1 < argc) opt.stride = glm::ivec3(std::atoi(argv[++i]));
+            else ok = false;
+        }
+        else if (arg[0] != '-' && opt.input.empty()) opt.input = arg;
+        else { std::cerr << "Error: Unexpected argument '" << arg << "'." << std::endl; return false; }
+        if (!ok) { std::cerr << "Error: Missing values for " << arg << "." << std::endl; return false; }
+    }
+    if (opt.input.empty()) return false;
+    if (opt.format != "vtk" && opt.format != "cache") {
+        std::cerr << "Error: Unknown format '" << opt.format << "'." << std::endl;
+        return false;
+    }
+
+    // Fill dimensions and type from names like "name_512x512x512_float32.raw"
+    std::string filename = opt.input.substr(opt.input.find_last_of("/\\") + 1);
+    std::smatch match;
+    if (opt.dims == glm::ivec3(0) && std::regex_search(filename, match, std::regex("(\\d+)x(\\d+)x(\\d+)"))) {
+        opt.dims = glm::ivec3(std::atoi(match[1].str().c_str()), std::atoi(match[2].str().c_str()), std::atoi(match[3].str().c_str()));
+    }
+    if (!opt.haveType && std::regex_search(filename, match, std::regex("(u?int(8|16|32)|float(32|64))"))) {
+        opt.haveType = parseVoxelType(match[1].str(), opt.type);
+    }
+    if (glm::any(glm::lessThanEqual(opt.dims, glm::ivec3(0)))) {
+        std::cerr << "Error: Could not determine dimensions; pass --dims X Y Z or name the file like 'volume_512x512x512_uint8.raw'." << std::endl;
+        return false;
+    }
+    if (!opt.haveType) {
+        std::cerr << "Error: Could not determine the data type; pass --type or include it in the file name." << std::endl;
+        return false;
+    }
+
+    for (int a = 0; a < 3; ++a) {
+        if (opt.cropEnd[a] <= 0) opt.cropEnd[a] = opt.dims[a];
+    }
+    opt.cropEnd = glm::min(opt.cropEnd, opt.dims);
+    if (glm::any(glm::lessThan(opt.cropBegin, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(opt.cropBegin, opt.cropEnd))) {
+        std::cerr << "Error: Crop box is empty or outside the volume." << std::endl;
+        return false;
+    }
+    if (glm::any(glm::lessThan(opt.stride, glm::ivec3(1)))) {
+        std::cerr << "Error: Stride must be at least 1." << std::endl;
+        return false;
+    }
+
+    if (opt.output.empty()) {
+        size_t dot = opt.input.find_last_of('.'), slash = opt.input.find_last_of("/\\");
+        bool hasExtension = dot != std::string::npos && (slash == std::string::npos || dot > slash);
+        std::string base = hasExtension ? opt.input.substr(0, dot) : opt.input;
+        opt.output = base + (opt.format == "vtk" ? ".vtk" : ".vcache");
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options opt;
+    ThreadPool::Options poolOptions;
+    if (!parseArguments(argc, argv, opt, poolOptions)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    ThreadPool::configure(poolOptions);
+
+    MappedFile input;
+    if (!input.open(opt.input)) {
+        std::cerr << "Error: Could not open RAW file: " << opt.input << std::endl;
+        return 1;
+    }
+    size_t valueSize = voxelTypeSize(opt.type);
+    size_t expected = (size_t)opt.dims.x * opt.dims.y * opt.dims.z * valueSize;
+    if (input.size != expected) {
+        std::cerr << "Error: Data size mismatch! Expected " << expected << " bytes for "
+                  << opt.dims.x << "x" << opt.dims.y << "x" << opt.dims.z << " " << voxelTypeName(opt.type)
+                  << ", found " << input.size << "." << std::endl;
+        return 1;
+    }
+
+    glm::ivec3 outDims = (opt.cropEnd - opt.cropBegin + opt.stride - glm::ivec3(1)) / opt.stride;
+    glm::vec3 outSpacing = opt.spacing * glm::vec3(opt.stride);
+    glm::vec3 outOrigin = opt.origin + glm::vec3(opt.cropBegin) * opt.spacing;
+    size_t numPoints = (size_t)outDims.x * outDims.y * outDims.z;
+
+    std::ofstream out(opt.output, std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "Error: Could not create output file: " << opt.output << std::endl;
+        return 1;
+    }
+
+    // Legacy VTK binary data is big-endian; the cache is little-endian
+    bool outBigEndian = opt.format == "vtk";
+    if (outBigEndian) {
+        out << "# vtk DataFile Version 3.0\n"
+            << "Converted from " << opt.input.substr(opt.input.find_last_of("/\\") + 1) << "\n"
+            << "BINARY\n"
+            << "DATASET STRUCTURED_POINTS\n"
+            << "DIMENSIONS " << outDims.x << " " << outDims.y << " " << outDims.z << "\n"
+            << "SPACING " << outSpacing.x << " " << outSpacing.y << " " << outSpacing.z << "\n"
+            << "ORIGIN " << outOrigin.x << " " << outOrigin.y << " " << outOrigin.z << "\n"
+            << "POINT_DATA " << numPoints << "\n"
+            << "FIELD FieldData 1\n"
+            << opt.fieldName << " 1 " << numPoints << " " << voxelTypeVtkName(opt.type) << "\n";
+    } else {
+        VolumeCacheHeader header;
+        header.dimensions = outDims;
+        header.spacing = outSpacing;
+        header.origin = outOrigin;
+        header.type = opt.type;
+        header.fieldName = opt.fieldName;
+        writeVolumeCacheHeader(out, header);
+    }
+
+    // Convert a batch of output slices in parallel rows, then append it to the file
+    bool swap = opt.bigEndian != outBigEndian;
+    size_t rowBytes = (size_t)outDims.x * valueSize;
+    size_t sliceBytes = rowBytes * outDims.y;
+    int slicesPerBatch = (int)std::max<size_t>(1, (64u << 20) / sliceBytes);
+    std::vector<unsigned char> batch((size_t)std::min(slicesPerBatch, outDims.z) * sliceBytes);
+    ThreadPool& pool = ThreadPool::instance();
+    for (int zBegin = 0; zBegin < outDims.z; zBegin += slicesPerBatch) {
+        int zEnd = std::min(outDims.z, zBegin + slicesPerBatch);
+        size_t numRows = (size_t)(zEnd - zBegin) * outDims.y;
+        pool.parallelFor(numRows, 64, [&](size_t rowBegin, size_t rowEnd) {
+            for (size_t r = rowBegin; r < rowEnd; ++r) {
+                int oz = zBegin + (int)(r / outDims.y), oy = (int)(r % outDims.y);
+                size_t sz = opt.cropBegin.z + (size_t)oz * opt.stride.z;
+                size_t sy = opt.cropBegin.y + (size_t)oy * opt.stride.y;
+                size_t srcIndex = (sz * opt.dims.y + sy) * opt.dims.x + opt.cropBegin.x;
+                copyVoxels(input.data + srcIndex * valueSize, valueSize, swap,
+                           batch.data() + r * rowBytes, outDims.x, opt.stride.x);
+            }
+        });
+        out.write(reinterpret_cast<const char*>(batch.data()), numRows * rowBytes);
+    }
+    if (outBigEndian) out << "\n";
+    if (!out) {
+        std::cerr << "Error: Failed writing " << opt.output << std::endl;
+        return 1;
+    }
+
+    std::cout << "Converted " << opt.input << " (" << opt.dims.x << "x" << opt.dims.y << "x" << opt.dims.z << " "
+              << voxelTypeName(opt.type) << ") to " << opt.output << " ("
+              << outDims.x << "x" << outDims.y << "x" << outDims.z << ")" << std::endl;
+    return 0;
+}
@@ -0,0 +1,107 @@
+// Checks the isosurface extractor against a field with a known answer: a
+// sphere of radius 10 given as a distance field. The dense and tiled
+// extractors must emit the same triangles and metrics, area and volume must
+// be close to the analytic values, and a box that clips the sphere must
+// still get the exact enclosed volume (the two parts add up to the whole).
+// Runs every check and exits with 1 if any failed; run with `make check`.
+
+#include "marching_cubes.h"
+#include "sparse_field.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+const float RADIUS = 10.0f;
+const double PI = 3.14159265358979323846;
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    std::cout << (ok ? "ok   " : "FAIL ") << what << std::endl;
+    if (!ok) ++failures;
+}
+
+bool near(double a, double b, double relative) {
+    return std::abs(a - b) <= relative * std::max(std::abs(a), std::abs(b));
+}
+
+// Triangles as sorted byte strings, so meshes compare regardless of order
+std::vector<std::string> triangleSet(const std::vector<Vertex>& vertices) {
+    std::vector<std::string> triangles;
+    for (size_t i = 0; i + 2 < vertices.size(); i += 3) {
+        triangles.push_back(std::string(reinterpret_cast<const char*>(&vertices[i]), 3 * sizeof(Vertex)));
+    }
+    std::sort(triangles.begin(), triangles.end());
+    return triangles;
+}
+
+bool sameMetrics(const SurfaceMetrics& a, const SurfaceMetrics& b) {
+    return a.triangleCount == b.triangleCount && near(a.area, b.area, 1e-9) && near(a.volume, b.volume, 1e-9);
+}
+
+// Dense and tiled extraction of one box; returns the dense metrics
+SurfaceMetrics compare(const ScalarField& dense, const SparseField& sparse, const GridExtent& box,
+                       const std::string& name) {
+    MarchingCubes mc;
+    mc.setExtent(box);
+    SurfaceMetrics denseMetrics, sparseMetrics;
+    std::vector<Vertex> denseMesh = mc.generateSurface(dense, 0.0f, nullptr, nullptr, denseMetrics);
+    std::vector<Vertex> sparseMesh = mc.generateSurface(sparse, 0.0f, nullptr, nullptr, sparseMetrics);
+    std::cout << name << ": " << denseMetrics.triangleCount << " triangles, area " << denseMetrics.area
+              << ", volume " << denseMetrics.volume << std::endl;
+    check(denseMetrics.triangleCount > 0, name + ": surface found");
+    check(triangleSet(denseMesh) == triangleSet(sparseMesh), name + ": dense and sparse triangles match");
+    check(sameMetrics(denseMetrics, sparseMetrics), name + ": dense and sparse metrics match");
+
+    // The metrics-only sweep measures the same surface
+    std::vector<float> level(1, 0.0f);
+    check(sameMetrics(mc.measureSurfaces(dense, level)[0], denseMetrics), name + ": dense sweep matches");
+    check(sameMetrics(mc.measureSurfaces(sparse, level)[0], denseMetrics), name + ": sparse sweep matches");
+    return denseMetrics;
+}
+
+} // namespace
+
+int main() {
+    // Off-grid centre, so no grid point lies exactly on the surface; outside
+    // r = 12 the field is a constant background that collapses into tiles
+    const glm::ivec3 dims(34, 34, 34);
+    const glm::vec3 centre(16.3f, 16.1f, 16.7f);
+    ScalarField dense(VoxelFloat32, dims);
+    float* values = dense.values<float>();
+    for (int z = 0; z < dims.z; ++z) {
+        for (int y = 0; y < dims.y; ++y) {
+            for (int x = 0; x < dims.x; ++x) {
+                float r = glm::length(glm::vec3(x, y, z) - centre);
+                values[((size_t)z * dims.y + y) * dims.x + x] = std::max(RADIUS - r, -2.0f);
+            }
+        }
+    }
+    SparseField sparse(dense);
+    check(sparse.getConstantTileCount() > 0, "background tiles collapse");
+
+    // Whole grid: the polygonal surface is slightly inside the sphere
+    SurfaceMetrics whole = compare(dense, sparse, GridExtent(), "whole grid");
+    check(near(whole.area, 4.0 * PI * RADIUS * RADIUS, 0.01), "area within 1% of 4 pi r^2");
+    check(near(whole.volume, 4.0 / 3.0 * PI * RADIUS * RADIUS * RADIUS, 0.01), "volume within 1% of 4/3 pi r^3");
+
+    // Boxes cut at x = 16 hold the two parts of the sphere; the cut plane closes each one
+    SurfaceMetrics nearPart = compare(dense, sparse, GridExtent(glm::ivec3(0), glm::ivec3(16, 33, 33)), "x <= 16");
+    SurfaceMetrics farPart = compare(dense, sparse, GridExtent(glm::ivec3(16, 0, 0), glm::ivec3(33)), "x >= 16");
+    check(near(nearPart.volume + farPart.volume, whole.volume, 1e-9), "clipped volumes add up to the whole");
+    check(nearPart.triangleCount + farPart.triangleCount == whole.triangleCount, "clipped triangles add up to the whole");
+    double capHeight = RADIUS - (centre.x - 16.0f); // The x <= 16 part is a cap of this height
+    double capVolume = PI * capHeight * capHeight * (3.0 * RADIUS - capHeight) / 3.0;
+    check(near(nearPart.volume, capVolume, 0.01), "clipped volume within 1% of the spherical cap");
+
+    if (failures) {
+        std::cout << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All surface checks passed" << std::endl;
+    return 0;
+}
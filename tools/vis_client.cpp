@@ -0,0 +1,87 @@
+// Sends requests to a running visualization server (Visualizer --serve) and
+// writes the responses: each header line goes to stderr and the payloads, in
+// request order, to stdout or a file. Also a reference for thin clients.
+
+#include "vis_protocol.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " <socket> <request> [request ...] [-o output] [--shm]" << std::endl;
+    std::cerr << "Example: " << program << " /tmp/vis.sock \"ISOSURFACE TEMP 25\" -o surface.f32" << std::endl;
+    std::cerr << "Requests: FIELDS, STATS f, SAMPLE f x y z ..., ISOSURFACE f v, SLICE f nx ny nz offset, CACHE"
+              << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string socketPath, outputPath;
+    std::vector<std::string> requests;
+    bool sharedMemory = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc) outputPath = argv[++i];
+        else if (arg == "--shm") sharedMemory = true;
+        else if (socketPath.empty()) socketPath = arg;
+        else requests.push_back(arg);
+    }
+    if (socketPath.empty() || requests.empty()) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    VisConnection connection;
+    if (!connection.connect(socketPath)) {
+        std::cerr << "Error: No server is listening on '" << socketPath << "'." << std::endl;
+        return 1;
+    }
+    if (sharedMemory) requests.insert(requests.begin(), "SHM ON");
+    std::ofstream file;
+    if (!outputPath.empty()) {
+        file.open(outputPath, std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "Error: Could not create output file: " << outputPath << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = outputPath.empty() ? std::cout : file;
+
+    int status = 0;
+    std::vector<char> payload;
+    for (size_t i = 0; i < requests.size(); ++i) {
+        std::string header;
+        if (!connection.writeLine(requests[i]) || !connection.readLine(header)) {
+            std::cerr << "Error: The server closed the connection." << std::endl;
+            return 1;
+        }
+        std::cerr << header << std::endl;
+        std::istringstream fields(header);
+        std::string kind, name;
+        size_t size = 0;
+        fields >> kind;
+        if (kind == "OK" && fields >> size) {
+            payload.resize(size);
+            if (!connection.read(payload.data(), size)) {
+                std::cerr << "Error: The server closed the connection." << std::endl;
+                return 1;
+            }
+            out.write(payload.data(), size);
+        } else if (kind == "SHM" && fields >> name >> size) {
+            SharedPayload shared;
+            if (!shared.open(name) || shared.getSize() != size) {
+                std::cerr << "Error: Could not map shared memory object " << name << "." << std::endl;
+                return 1;
+            }
+            out.write(shared.getData(), size);
+        } else {
+            status = 1;
+        }
+    }
+    return status;
+}